@@ -125,7 +125,7 @@ SKASQENKTDQLLKRDAIVGEACIDKKKHNFGYKSVRVRSVTTNLAGLAF
                         alpha, tme.getGuideTree());
 
     be.optimizePairByPair();
-    auto distances = be.getOptimizedTimes();
+    const PairwiseStorage& distances = be.getOptimizedTimes();
     auto seqCount = inputSeqs.getSequenceCount();
 
     // OUTPUT DISTANCE MATRIX:
@@ -136,7 +136,7 @@ SKASQENKTDQLLKRDAIVGEACIDKKKHNFGYKSVRVRSVTTNLAGLAF
         distfile << inputSeqs.getSequenceName(seqId) << "        ";
         for(unsigned int j = 0; j<seqId; j++)
         {
-            distfile << " " << distances[(seqId - j - 1) + (j*seqCount) - (((1+j)/2)*j)];
+            distfile << " " << distances.getDistance(j, seqId);
         }
         distfile << "\n";
     }
@@ -52,6 +52,65 @@ extern "C"
 #define EBC_BE_DEFAULTS_INDEL_RATE 0.0
 #define EBC_BE_DEFAULTS_ALPHA 0.5
 #define EBC_BE_DEFAULTS_GAMMA_RATE_CATEGORIES 4
+#define EBC_BE_DEFAULTS_ESTIMATION_THREADS 0
+
+// Substitution models, see ebc_be_check_gradient()
+#define EBC_MODEL_GTR 0
+#define EBC_MODEL_HKY85 1
+#define EBC_MODEL_LG 2
+#define EBC_MODEL_WAG 3
+#define EBC_MODEL_JTT 4
+
+// P(t) cache modes
+#define EBC_PTCACHE_OFF 0
+#define EBC_PTCACHE_EXACT 1
+#define EBC_PTCACHE_INTERPOLATED 2
+
+#define EBC_BE_DEFAULTS_PTCACHE_MODE EBC_PTCACHE_OFF
+#define EBC_BE_DEFAULTS_PTCACHE_RESOLUTION 1e-4
+
+// Pairwise band construction
+#define EBC_BANDING_POSTERIOR 0
+#define EBC_BANDING_ANCHOR 1
+
+#define EBC_BE_DEFAULTS_BANDING EBC_BANDING_POSTERIOR
+#define EBC_BE_DEFAULTS_ANCHOR_MARGIN 16
+
+// Pairwise likelihood algorithms
+#define EBC_ALGORITHM_FORWARD 0
+#define EBC_ALGORITHM_ANCHORED_FORWARD 1
+#define EBC_ALGORITHM_VITERBI 2
+
+#define EBC_BE_DEFAULTS_ALGORITHM EBC_ALGORITHM_FORWARD
+#define EBC_BE_DEFAULTS_APPROXIMATION_GAP_INTERVAL 10
+
+#define EBC_BE_DEFAULTS_TRIANGLE_PIVOTS 0
+
+// Pairwise distance storage
+#define EBC_STORAGE_MEMORY 0
+#define EBC_STORAGE_MAPPED_FLOAT 1
+#define EBC_STORAGE_MAPPED_DOUBLE 2
+
+#define EBC_BE_DEFAULTS_STORAGE EBC_STORAGE_MEMORY
+
+// Checkpoint intervals
+#define EBC_DEFAULTS_CHECKPOINT_PAIRS 0
+#define EBC_DEFAULTS_CHECKPOINT_SECONDS 600.0
+
+// Streamed pairwise distance records
+#define EBC_STREAM_TEXT 0
+#define EBC_STREAM_BINARY 1
+
+// Distance matrices assembled from streamed records
+#define EBC_MATRIX_PHYLIP 0
+#define EBC_MATRIX_CONDENSED 1
+
+    /*
+     * Receives every pairwise distance as soon as it is calculated: the two sequence IDs,
+     * the distance and the log-likelihood (NAN for copies of duplicate sequence pairs).
+     */
+    typedef void (*ebc_distance_callback)(unsigned int seq_id1, unsigned int seq_id2,
+                                          double distance, double lnl, void *user_data);
 
     /*
      * The banding estimator used to load sequences from a string
@@ -77,6 +136,37 @@ extern "C"
         bool estimate_indel_params;
         bool estimate_alpha;
         bool estimate_categories;
+
+        // Worker threads of the model estimation, 0 uses all hardware threads
+        unsigned int estimation_threads;
+
+        // P(t) cache shared between pairs: EBC_PTCACHE_* mode, and the grid
+        // spacing of divergence times in the interpolated mode
+        int ptcache_mode;
+        double ptcache_resolution;
+
+        // EBC_BANDING_* mode and the rows kept on each side of the k-mer anchor chain
+        int banding_mode;
+        unsigned int anchor_margin;
+
+        // EBC_ALGORITHM_* used for the pairwise divergence times
+        int algorithm;
+
+        // Anchored forward pairs per sampled approximation gap, 0 disables sampling
+        unsigned int approximation_gap_interval;
+
+        // Pivot sequences for triangle-inequality Brent bounds, 0 disables them
+        unsigned int triangle_pivots;
+
+        // EBC_STORAGE_* backend of the pairwise distances, and the directory of
+        // memory-mapped stores, see ebc_be_set_pair_storage()
+        int pair_storage;
+        void *_storageDirectory;
+
+        // Model parameter file used instead of estimating, see ebc_be_set_model_file(),
+        // and the directory of cached estimates, see ebc_be_set_model_cache()
+        void *_modelFile;
+        void *_modelCacheDirectory;
     } EBCBandingEstimator;
 
     /*
@@ -84,12 +174,25 @@ extern "C"
      */
     typedef struct PAHMM_EXPORT EBCSequences {
         void *_sequences;
-        void *_modelEstimator;
         void *_bandingEstimator;
         EBCBandingEstimator *_ebcBandingEstimator;
         int sequenceType;
+        // Streams finished pairs, see ebc_seq_stream_to_fd()
+        void *_distanceWriter;
+        // Guide tree owned by the set
+        void *_guideTree;
     } EBCSequences;
 
+    /*
+     * Distances from a set of query sequences to a reference set (EBCSequences),
+     * which must outlive it.
+     */
+    typedef struct PAHMM_EXPORT EBCQueries {
+        void *_parser;
+        double *_distances;
+        EBCSequences *_ebcSequences;
+    } EBCQueries;
+
     /*
      * Construct a banding estimator object.
      *
@@ -159,6 +262,116 @@ extern "C"
     PAHMM_EXPORT void ebc_be_set_categories(EBCBandingEstimator *be, unsigned int categories);
     PAHMM_EXPORT void ebc_be_unset_categories(EBCBandingEstimator *be);
 
+    // Worker threads of the model estimation, 0 (default) uses all hardware threads
+    PAHMM_EXPORT void ebc_be_set_estimation_threads(EBCBandingEstimator *be, unsigned int threads);
+
+    /*
+     * Configure the cache of P(t) emission tables used for pairwise distances.
+     *
+     * EBC_PTCACHE_OFF (default) calculates the tables for every divergence time.
+     * EBC_PTCACHE_EXACT reuses tables for exactly the same divergence time and gives
+     * identical results, it pays off only when pairs repeat times, Brent rarely does.
+     * EBC_PTCACHE_INTERPOLATED interpolates P(t) linearly between cached tables on a grid
+     * of the given resolution, and takes the logarithms of the result, trading a little
+     * accuracy for far fewer matrix exponentials. Without the cache a P(t) evaluation
+     * makes no heap allocation, the cache modes allocate every table they store.
+     *
+     * Takes effect for EBCSequences created afterwards. Returns false for an invalid mode
+     * or resolution.
+     */
+    PAHMM_EXPORT bool ebc_be_set_ptcache(EBCBandingEstimator *be, int mode, double resolution);
+
+    /*
+     * Choose how the dynamic programming band of each pair is built.
+     *
+     * EBC_BANDING_POSTERIOR (default) runs several banded Forward calculations and a
+     * Backward pass and keeps the cells with a high posterior probability.
+     * EBC_BANDING_ANCHOR chains exact k-mer matches between the two sequences and uses
+     * a band of margin rows on either side of the chain, which avoids the posterior
+     * pre-pass. Highly divergent pairs, and pairs whose chain covers too little of the
+     * shorter sequence, fall back to the posterior band.
+     *
+     * Takes effect for EBCSequences created afterwards. Returns false for an invalid mode.
+     */
+    PAHMM_EXPORT bool ebc_be_set_banding(EBCBandingEstimator *be, int mode, unsigned int margin);
+
+    /*
+     * Choose the likelihood algorithm for pairwise distances.
+     *
+     * EBC_ALGORITHM_FORWARD (default) is the banded Forward algorithm.
+     * EBC_ALGORITHM_ANCHORED_FORWARD is an approximation for long, similar sequences:
+     * long unique exact matches are forced to align and the regions in between are
+     * calculated independently and in parallel. Every tenth pair is also evaluated with
+     * the full Forward algorithm by default, see ebc_be_set_approximation_gap_interval().
+     * EBC_ALGORITHM_VITERBI maximises the best alignment instead of summing over all of
+     * them, using a vectorised kernel without band calculation. It is several times faster
+     * than the Forward algorithm and gives slightly less accurate distances.
+     *
+     * Takes effect for EBCSequences created afterwards. Returns false for an invalid algorithm.
+     */
+    PAHMM_EXPORT bool ebc_be_set_algorithm(EBCBandingEstimator *be, int algorithm);
+
+    /*
+     * Evaluate every interval-th pair of EBC_ALGORITHM_ANCHORED_FORWARD also with the full
+     * Forward algorithm at its optimized divergence time, for the report of
+     * ebc_seq_get_approximation_gap. Each sample is one unbanded Forward calculation over
+     * the whole pair, O(n*m) time for sequences of lengths n and m, so the default of 10
+     * (EBC_BE_DEFAULTS_APPROXIMATION_GAP_INTERVAL) can cost more than the anchored
+     * optimizations of the other nine pairs. 0 disables sampling.
+     *
+     * Takes effect for EBCSequences created afterwards.
+     */
+    PAHMM_EXPORT void ebc_be_set_approximation_gap_interval(EBCBandingEstimator *be, unsigned int interval);
+
+    /*
+     * Narrow the divergence time search of each pair with triangle-inequality bounds
+     * |d(i,k) - d(k,j)| <= d(i,j) <= d(i,k) + d(k,j), taken from up to pivots sequences k
+     * whose distances to both i and j are already known. The bounds are widened by a
+     * safety margin, and a pair whose optimum lands on a narrowed bound is searched again
+     * over the full interval. 0 pivots (default) disables the bounds.
+     *
+     * Takes effect for EBCSequences created afterwards.
+     */
+    PAHMM_EXPORT void ebc_be_set_triangle_bounds(EBCBandingEstimator *be, unsigned int pivots);
+
+    /*
+     * Choose where the guide and optimized distances of all sequence pairs are kept,
+     * n(n-1)/2 values each for n sequences.
+     *
+     * EBC_STORAGE_MEMORY (default) keeps them on the heap in double precision.
+     * EBC_STORAGE_MAPPED_DOUBLE and EBC_STORAGE_MAPPED_FLOAT keep them in a memory-mapped
+     * file created in directory (NULL for $TMPDIR or /tmp), in double or single precision,
+     * so that the operating system pages them to disk when they do not fit into memory.
+     * The files are deleted as soon as they are mapped and never outlive the process.
+     *
+     * Takes effect for EBCSequences created afterwards. Returns false for an invalid storage.
+     */
+    PAHMM_EXPORT bool ebc_be_set_pair_storage(EBCBandingEstimator *be, int storage, const char *directory);
+
+    /*
+     * Skip the model estimation and take the parameters from a file written by
+     * ebc_seq_save_model() (or the --model-out option of paHMM-Tree), e.g. those estimated
+     * earlier for the same family. The file must hold parameters of the model executed.
+     * Parameters set explicitly (ebc_be_set_indel_parameters(), ebc_be_set_alpha(),
+     * ebc_be_set_categories() and the fixed-parameter model functions) still take precedence.
+     * Distances always use the frequencies observed in the input. NULL restores estimation.
+     *
+     * Takes effect for EBCSequences created afterwards. Returns false if the file cannot be read.
+     */
+    PAHMM_EXPORT bool ebc_be_set_model_file(EBCBandingEstimator *be, const char *path);
+
+    /*
+     * Keep estimated model parameters in directory, keyed by the fingerprint of the input
+     * sequences, the model, the rate categories and the alpha parameter if set. Executing a
+     * model on input found in the cache skips the estimation, otherwise the estimates are
+     * added to the cache. Explicitly set parameters take precedence as with
+     * ebc_be_set_model_file(), which in turn takes precedence over the cache. NULL disables it.
+     *
+     * Takes effect for EBCSequences created afterwards. Returns false if directory is not
+     * a directory.
+     */
+    PAHMM_EXPORT bool ebc_be_set_model_cache(EBCBandingEstimator *be, const char *directory);
+
     /*
      * Set sequence input. Should be in FASTA-format.
      *
@@ -171,6 +384,27 @@ extern "C"
     // Set sequence input from a file
     PAHMM_EXPORT bool ebc_be_set_input_from_file(EBCBandingEstimator *be, const char *file_name);
 
+    /*
+     * Continue a distance calculation from a checkpoint written by ebc_seq_set_checkpoint().
+     * The input must be set to the same sequences as before. Model parameters and guide
+     * distances are restored instead of estimated, and only distances missing from the
+     * checkpoint remain to be calculated. The options of the banding estimator (banding,
+     * algorithm, ...) apply as with the ebc_be_execute_*-functions.
+     *
+     * Returns NULL upon failure; clean up the result using ebc_seq_free().
+     */
+    PAHMM_EXPORT EBCSequences *ebc_be_resume(EBCBandingEstimator *be, const char *checkpoint_path);
+
+    /*
+     * Estimate the parameters of an EBC_MODEL_* model on the input, as the execute functions
+     * do, and compare the analytic gradient of the substitution model estimation with central
+     * finite differences, at the estimate and at the initial parameters. max_error receives
+     * the largest difference relative to max(1, |finite difference|). Meant for tests.
+     *
+     * Returns false on an error, e.g. no input or an unknown model.
+     */
+    PAHMM_EXPORT bool ebc_be_check_gradient(EBCBandingEstimator *be, int model, double *max_error);
+
     /*
      * Destroy a sequences object.
      */
@@ -183,6 +417,21 @@ extern "C"
      */
     PAHMM_EXPORT unsigned int ebc_seq_count(EBCSequences *seq);
 
+    /*
+     * Append sequences to an existing set. Input should be in FASTA-format.
+     *
+     * The new sequences get the IDs following the existing ones, and the names
+     * must be unique and must not clash with sequences already in the set. Model parameters are kept
+     * as they were estimated, distances calculated so far are kept in place, and only
+     * distances involving a new sequence remain to be calculated, so adding k sequences
+     * to n costs O(n*k) work and memory.
+     *
+     * Returns false upon failure, in which case the set is left unchanged.
+     * Strings returned earlier by ebc_seq_get_name() and ebc_seq_get_sequence()
+     * may be invalidated by a successful call.
+     */
+    PAHMM_EXPORT bool ebc_seq_add_sequences(EBCSequences *seq, const char *fasta);
+
     /*
      * Get the distance between two sequences.
      *
@@ -204,6 +453,184 @@ extern "C"
     PAHMM_EXPORT double ebc_seq_get_distance_from_names(EBCSequences *seq,
                                                         const char *seq_name1, const char *seq_name2);
 
+    /*
+     * Get P(t) cache counters: lookups served from the cache, lookups that had to
+     * calculate the tables, and the memory currently held by the cache in bytes.
+     *
+     * Any of the output pointers may be NULL. Returns false if no cache is in use.
+     */
+    PAHMM_EXPORT bool ebc_seq_get_ptcache_stats(EBCSequences *seq, unsigned long *hits,
+                                                unsigned long *misses, unsigned long *memory_bytes);
+
+    /*
+     * Get the approximation gap report of EBC_ALGORITHM_ANCHORED_FORWARD: the number of
+     * sampled pairs so far, and the mean and largest difference between the full and the
+     * anchored log-likelihood at the optimized divergence time.
+     *
+     * Any of the output pointers may be NULL. Returns false if no pair was sampled yet.
+     */
+    PAHMM_EXPORT bool ebc_seq_get_approximation_gap(EBCSequences *seq, unsigned int *samples,
+                                                    double *mean_gap, double *max_gap);
+
+    /*
+     * Get triangle-inequality bound counters: pairs optimized with narrowed bounds, and
+     * those among them that had to be searched again over the full interval.
+     *
+     * Any of the output pointers may be NULL.
+     */
+    PAHMM_EXPORT bool ebc_seq_get_triangle_bound_stats(EBCSequences *seq, unsigned long *bounded,
+                                                       unsigned long *repeated);
+
+    /*
+     * Compare the vectorised Viterbi kernel of EBC_ALGORITHM_VITERBI with the scalar
+     * Viterbi algorithm: both run on every ordered pair of sequences at the given
+     * divergence time, and max_error receives the largest difference of the
+     * log-likelihoods relative to the scalar one (at least 1 in magnitude).
+     *
+     * Returns false on an error, e.g. a divergence time that is not positive.
+     */
+    PAHMM_EXPORT bool ebc_seq_check_viterbi(EBCSequences *seq, double time, double *max_error);
+
+    /*
+     * Compare EBC_ALGORITHM_ANCHORED_FORWARD without anchors, a single sub-problem over
+     * the whole pair, with the full Forward algorithm: both run on every ordered pair of
+     * sequences at the given divergence time, and max_error receives the largest
+     * difference of the log-likelihoods relative to the full one (at least 1 in magnitude).
+     *
+     * Returns false on an error, e.g. a divergence time that is not positive.
+     */
+    PAHMM_EXPORT bool ebc_seq_check_anchored_forward(EBCSequences *seq, double time, double *max_error);
+
+    /*
+     * Compare the sparse posterior output of the band calculation with the posteriors of
+     * the full Forward and Backward matrices: both run on every ordered pair of sequences
+     * at the given divergence time with a band over the whole matrix, and max_error
+     * receives the largest difference of the log posteriors of the cells above the band
+     * limit, infinity if the sparse output misses such a cell or holds another one.
+     *
+     * Returns false on an error, e.g. a divergence time that is not positive.
+     */
+    PAHMM_EXPORT bool ebc_seq_check_posteriors(EBCSequences *seq, double time, double *max_error);
+
+    /*
+     * Stream every distance calculated from now on to a file descriptor, one record per
+     * write. EBC_STREAM_TEXT records are "id1<TAB>id2<TAB>distance<TAB>lnl" lines,
+     * EBC_STREAM_BINARY records are two uint32 IDs followed by two doubles, in native
+     * byte order. Records can be read while the calculation is running.
+     *
+     * The descriptor is not closed by libpahmm. Replaces any earlier stream.
+     */
+    PAHMM_EXPORT bool ebc_seq_stream_to_fd(EBCSequences *seq, int fd, int format);
+
+    /*
+     * Stream every distance calculated from now on to a callback. Replaces any earlier stream.
+     */
+    PAHMM_EXPORT bool ebc_seq_stream_to_callback(EBCSequences *seq, ebc_distance_callback callback,
+                                                 void *user_data);
+
+    /*
+     * Stop streaming distances.
+     */
+    PAHMM_EXPORT void ebc_seq_stream_stop(EBCSequences *seq);
+
+    /*
+     * Calculate every distance that has not been calculated yet, streaming each one
+     * if a stream is set.
+     */
+    PAHMM_EXPORT bool ebc_seq_calculate_distances(EBCSequences *seq);
+
+    /*
+     * Assemble a distance matrix of this set from a file of streamed records. Pairs
+     * missing from the records are NAN. EBC_MATRIX_PHYLIP writes a lower-triangular
+     * PHYLIP matrix, EBC_MATRIX_CONDENSED a binary file: the 8 bytes "PAHMMDM1", the
+     * uint64 pair count and the upper triangle row by row as doubles.
+     *
+     * Memory use does not grow with the number of records.
+     */
+    PAHMM_EXPORT bool ebc_seq_stream_finalise(EBCSequences *seq, const char *records_path, int record_format,
+                                              const char *output_path, int matrix_format);
+
+    /*
+     * Same as ebc_seq_stream_finalise(), for records spread over several files, e.g. one
+     * per shard. pair_count receives the number of distinct pairs found, which equals
+     * n*(n-1)/2 if the files cover the whole matrix; it may be NULL.
+     */
+    PAHMM_EXPORT bool ebc_seq_merge_records(EBCSequences *seq, const char *const *records_paths,
+                                            unsigned int path_count, int record_format,
+                                            const char *output_path, int matrix_format,
+                                            unsigned long *pair_count);
+
+    /*
+     * Calculate shard number shard (0 to shard_count - 1) of the distances: the pairs whose
+     * index in the lower-triangular matrix, row by row, modulo shard_count equals shard.
+     * Pairs with a duplicate sequence belong to the shard of the pair of representatives,
+     * so each shard only optimizes its own pairs.
+     * Stream the shard to its own file with ebc_seq_stream_to_fd() and assemble the shard
+     * files with ebc_seq_merge_records().
+     *
+     * Processes running shards agree as long as they use the same model parameters: the
+     * estimation is deterministic for the same input, or fixed parameters can be given
+     * with ebc_be_execute_*_model() and ebc_be_set_indel_parameters().
+     */
+    PAHMM_EXPORT bool ebc_seq_calculate_shard(EBCSequences *seq, unsigned int shard, unsigned int shard_count);
+
+    /*
+     * Save a checkpoint of the model parameters, the guide distances and the distances
+     * calculated so far to path, after every pair_interval calculated distances or
+     * seconds_interval seconds, whichever comes first. 0 disables either criterion.
+     * The first checkpoint is written to a temporary file and renamed over path, later
+     * ones append the distances calculated in between; resume with ebc_be_resume().
+     */
+    PAHMM_EXPORT bool ebc_seq_set_checkpoint(EBCSequences *seq, const char *path, unsigned long pair_interval,
+                                             double seconds_interval);
+
+    /*
+     * Save a checkpoint now, ebc_seq_set_checkpoint() must have been called before.
+     */
+    PAHMM_EXPORT bool ebc_seq_save_checkpoint(EBCSequences *seq);
+
+    /*
+     * Write the model parameters the distances of this set are calculated with, the
+     * observed frequencies and the fingerprint of the sequences to path, as text.
+     * Reuse them with ebc_be_set_model_file().
+     */
+    PAHMM_EXPORT bool ebc_seq_save_model(EBCSequences *seq, const char *path);
+
+    /*
+     * Sparse mode for large sets: calculate only the distances from every sequence to
+     * its k nearest sequences by k-mer distance. Duplicate sequences share the
+     * neighbours of their first copy. Distances are streamed like any other.
+     *
+     * Replaces the neighbour lists of an earlier call; adding sequences discards them.
+     */
+    PAHMM_EXPORT bool ebc_seq_calculate_neighbours(EBCSequences *seq, unsigned int k);
+
+    /*
+     * Get the number of neighbours of a sequence with a calculated distance. Neighbour
+     * lists are symmetric, so a sequence may have more than k neighbours.
+     *
+     * Returns 0 if ebc_seq_calculate_neighbours() was not called.
+     */
+    PAHMM_EXPORT unsigned int ebc_seq_neighbour_count(EBCSequences *seq, unsigned int seq_id);
+
+    /*
+     * Iterate the neighbours of a sequence: n runs from 0 to ebc_seq_neighbour_count() - 1,
+     * from the closest neighbour to the most distant one.
+     *
+     * Any of the output pointers may be NULL.
+     */
+    PAHMM_EXPORT bool ebc_seq_get_neighbour(EBCSequences *seq, unsigned int seq_id, unsigned int n,
+                                            unsigned int *neighbour_id, double *distance);
+
+    /*
+     * Get a distance in sparse mode without calculating it: the pair-HMM distance if the
+     * pair is a neighbour pair, otherwise the k-mer estimate, with computed set to false.
+     *
+     * computed may be NULL. If an error occurs, NAN is returned.
+     */
+    PAHMM_EXPORT double ebc_seq_get_sparse_distance(EBCSequences *seq, unsigned int seq_id1,
+                                                    unsigned int seq_id2, bool *computed);
+
     /*
      * Get the name of a sequence from a sequence ID.
      *
@@ -234,6 +661,50 @@ extern "C"
      */
     PAHMM_EXPORT const char *ebc_seq_get_sequence_from_name(EBCSequences *seq, const char *seq_name);
 
+    /*
+     * Calculate the distances from query sequences to every sequence of a reference set.
+     * Input should be in FASTA-format.
+     *
+     * The model parameters of the reference set are used as they are, and only the
+     * query x reference distances are calculated, never query x query or
+     * reference x reference. A query identical to a reference sequence gets the
+     * distances of that sequence, which are calculated with the reference set if missing.
+     *
+     * The return value is an EBCQueries-object upon successful execution,
+     * and it is your responsibility to clean it up using ebc_qry_free().
+     * If an error occurred, it will return NULL.
+     *
+     * The queries object reports its errors through seq, so it must not outlive seq:
+     * call ebc_qry_free() before ebc_seq_free().
+     */
+    PAHMM_EXPORT EBCQueries *ebc_seq_query(EBCSequences *seq, const char *fasta);
+    PAHMM_EXPORT EBCQueries *ebc_seq_query_from_file(EBCSequences *seq, const char *file_name);
+
+    /*
+     * Destroy a queries object.
+     */
+    PAHMM_EXPORT void ebc_qry_free(EBCQueries *qry);
+
+    /*
+     * Get query sequence count.
+     */
+    PAHMM_EXPORT unsigned int ebc_qry_count(EBCQueries *qry);
+
+    /*
+     * Get the name of a query sequence from a query ID.
+     *
+     * If an error occurs, NULL is returned.
+     */
+    PAHMM_EXPORT const char *ebc_qry_get_name(EBCQueries *qry, unsigned int qry_id);
+
+    /*
+     * Get the distances as a dense row-major buffer of ebc_qry_count() rows and
+     * ebc_seq_count() columns, counted when the queries ran: element
+     * [q * ebc_seq_count() + r] is the distance between query q and reference sequence r.
+     *
+     * The buffer is freed by ebc_qry_free().
+     */
+    PAHMM_EXPORT const double *ebc_qry_distances(EBCQueries *qry);
 
 #ifdef __cplusplus
 }
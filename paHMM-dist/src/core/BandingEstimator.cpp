@@ -25,52 +25,68 @@
 #include "models/AminoacidSubstitutionModel.hpp"
 #include "models/NegativeBinomialGapModel.hpp"
 #include "hmm/DpMatrixFull.hpp"
+#include "hmm/BackwardPairHMM.hpp"
+
+#include <map>
+#include <tuple>
 
 namespace EBC
 {
 
 
 BandingEstimator::BandingEstimator(Definitions::AlgorithmType at, Sequences* inputSeqs, Definitions::ModelType model ,std::vector<double> indel_params,
-        std::vector<double> subst_params, Definitions::OptimizationType /*ot*/, unsigned int rateCategories, double alpha, GuideTree* g) :
+        std::vector<double> subst_params, Definitions::OptimizationType /*ot*/, unsigned int rateCategories, double alpha, GuideTree* g,
+        SubstitutionModelBase* calculatedModel, Maths* modelMaths) :
                 inputSequences(inputSeqs), gt(g), algorithm(at), gammaRateCategories(rateCategories),
-                /*hmms(pairCount), bands(pairCount),*/ pairCount(inputSequences->getPairCount()), divergenceTimes(pairCount, NAN)
+                /*hmms(pairCount), bands(pairCount),*/ pairCount(inputSequences->getPairCount()), divergenceTimes(inputSequences->createPairStorage()),
+                parameters(model, subst_params, indel_params, alpha, rateCategories)
 {
 	//Banding estimator means banding enabled!
 
 	DEBUG("Starting Banding Estimator");
-	maths = new Maths();
 	dict = inputSequences->getDictionary();
 
-	//Helper models
-	if (model == Definitions::ModelType::GTR)
-	{
-		substModel = new GTRModel(dict, maths,gammaRateCategories);
-	}
-	else if (model == Definitions::ModelType::HKY85)
+	if (calculatedModel != nullptr)
 	{
-		substModel = new HKY85Model(dict, maths,gammaRateCategories);
+		//the estimation's model is calculated already, setting the same parameters again is free
+		maths = modelMaths;
+		substModel = calculatedModel;
 	}
-	else if (model >= Definitions::ModelType::LG)
+	else
 	{
-		switch(model){
-			case Definitions::ModelType::LG :
-				substModel = new AminoacidSubstitutionModel(dict, maths,gammaRateCategories,Definitions::aaLgModel);
-				DEBUG("Using LG model");
-			break;
-			case Definitions::ModelType::JTT :
-				substModel = new AminoacidSubstitutionModel(dict, maths,gammaRateCategories,Definitions::aaJttModel);
-				DEBUG("Using JTT model");
-			break;
-			case Definitions::ModelType::WAG :
-				substModel = new AminoacidSubstitutionModel(dict, maths,gammaRateCategories,Definitions::aaWagModel);
-				DEBUG("Using WAG model");
-			break;
-			case Definitions::ModelType::GTR :
-			  throw HmmException("Not implemented");
+		maths = new Maths();
+
+		//Helper models
+		if (model == Definitions::ModelType::GTR)
+		{
+			substModel = new GTRModel(dict, maths,gammaRateCategories);
+		}
+		else if (model == Definitions::ModelType::HKY85)
+		{
+			substModel = new HKY85Model(dict, maths,gammaRateCategories);
+		}
+		else if (model >= Definitions::ModelType::LG)
+		{
+			switch(model){
+				case Definitions::ModelType::LG :
+					substModel = new AminoacidSubstitutionModel(dict, maths,gammaRateCategories,Definitions::aaLgModel);
+					DEBUG("Using LG model");
+				break;
+				case Definitions::ModelType::JTT :
+					substModel = new AminoacidSubstitutionModel(dict, maths,gammaRateCategories,Definitions::aaJttModel);
+					DEBUG("Using JTT model");
+				break;
+				case Definitions::ModelType::WAG :
+					substModel = new AminoacidSubstitutionModel(dict, maths,gammaRateCategories,Definitions::aaWagModel);
+					DEBUG("Using WAG model");
+				break;
+				case Definitions::ModelType::GTR :
+				  throw HmmException("Not implemented");
 			  
-			case Definitions::ModelType::HKY85 :
-			  throw HmmException("Not implemented");
-					}
+				case Definitions::ModelType::HKY85 :
+				  throw HmmException("Not implemented");
+						}
+		}
 	}
 
 	indelModel = new NegativeBinomialGapModel();
@@ -91,7 +107,8 @@ BandingEstimator::BandingEstimator(Definitions::AlgorithmType at, Sequences* inp
 		modelParams->setUserSubstParams(subst_params);
 	modelParams->setAlpha(alpha);
 
-	substModel->setObservedFrequencies(inputSequences->getElementFrequencies());
+	if (calculatedModel == nullptr)
+		substModel->setObservedFrequencies(inputSequences->getElementFrequencies());
 	if (estimateSubstitutionParams == false)
 	{
 		//set parameters and calculate the model
@@ -111,79 +128,376 @@ BandingEstimator::BandingEstimator(Definitions::AlgorithmType at, Sequences* inp
 
     numopt = new BrentOptimizer(modelParams, nullptr);
 
+    ptCache = new PMatrixCache(Definitions::PtCacheMode::NoCache);
+    substModel->setPtCache(ptCache);
+
+    bandingType = Definitions::BandingType::PosteriorBanding;
+    anchorMargin = Definitions::anchorBandMargin;
+
+    anchoredPairCount = 0;
+    approximationGapInterval = Definitions::anchoredGapSampleInterval;
+
+    triangleBoundPivots = 0;
+    triangleBoundMargin = Definitions::triangleBoundMargin;
+    triangleBoundStats = std::make_pair(0, 0);
+
+    distanceWriter = nullptr;
+    lastLikelihood = NAN;
+
+    sparseDistances = nullptr;
+
+    checkpoint = nullptr;
+}
+
+void BandingEstimator::setPtCacheMode(Definitions::PtCacheMode mode, double resolution)
+{
+	PMatrixCache* cache = new PMatrixCache(mode, resolution);
+	substModel->setPtCache(cache);
+	delete ptCache;
+	ptCache = cache;
 }
 
 BandingEstimator::~BandingEstimator()
 {
   delete numopt;
+  delete ptCache;
   delete modelParams;
   delete maths;
   delete indelModel;
   delete substModel;
+  delete sparseDistances;
+  delete checkpoint;
+  delete divergenceTimes;
 }
 
 void BandingEstimator::optimizePairByPair()
 {
-	for(unsigned int i =0; i< pairCount; i++)
+	for(unsigned long i =0; i< pairCount; i++)
 	{
         optimizePair(i);
 	}
 
-	INFO("Optimized divergence times:");
-    INFO(this->divergenceTimes);
+	if (checkpoint != nullptr)
+		saveCheckpoint();
+
+	INFO("Optimized divergence times of " << pairCount << " pairs (" << inputSequences->getUniqueSequenceCount() << " unique sequences)");
+}
+
+void BandingEstimator::optimizeShard(unsigned int shard, unsigned int shardCount)
+{
+	if (shardCount == 0 || shard >= shardCount)
+		throw HmmException("Invalid shard " + to_string(shard) + " of " + to_string(shardCount));
+
+	INFO("Optimizing shard " << shard << " of " << shardCount << " (" << pairCount << " pairs in total)");
+
+	//strided rather than contiguous, pair costs vary along the sequence order
+	for(unsigned long i = 0; i< pairCount; i++)
+	{
+		if (isShardPair(i, shard, shardCount))
+			optimizePair(i);
+	}
+}
+
+bool BandingEstimator::isShardPair(unsigned long i, unsigned int shard, unsigned int shardCount)
+{
+	std::pair<unsigned int, unsigned int> idxs = inputSequences->getPairOfSequenceIndices(i);
+	unsigned int rep1 = inputSequences->getRepresentative(idxs.first);
+	unsigned int rep2 = inputSequences->getRepresentative(idxs.second);
+
+	unsigned long owner = rep1 == rep2 ? i : Sequences::getPairIndex(min(rep1,rep2), max(rep1,rep2),
+			inputSequences->getSequenceCount());
+	return owner % shardCount == shard;
 }
 
-double BandingEstimator::optimizePair(int i)
+double BandingEstimator::optimizePair(unsigned long i)
 {
-    if (!std::isnan(this->divergenceTimes[i])) {
-        return this->divergenceTimes[i];
+    if (!std::isnan(this->divergenceTimes->get(i))) {
+        return this->divergenceTimes->get(i);
     }
 
-    EvolutionaryPairHMM* hmm;
-    Band* band;
     DistanceMatrix* dm = gt->getDistanceMatrix();
-    PairHmmCalculationWrapper* wrapper = new PairHmmCalculationWrapper();
-    double result;
 
     DEBUG("Optimizing distance for pair #" << i);
     std::pair<unsigned int, unsigned int> idxs = inputSequences->getPairOfSequenceIndices(i);
+
+    //duplicates are resolved through their representatives, only unique pairs get optimized
+    unsigned int rep1 = inputSequences->getRepresentative(idxs.first);
+    unsigned int rep2 = inputSequences->getRepresentative(idxs.second);
+    if (rep1 == rep2)
+    {
+        setDivergenceTime(i, 0);
+        emitDistance(idxs, NAN);
+        return this->divergenceTimes->get(i);
+    }
+    if (rep1 != idxs.first || rep2 != idxs.second)
+    {
+        setDivergenceTime(i, optimizePair(Sequences::getPairIndex(min(rep1,rep2), max(rep1,rep2),
+                inputSequences->getSequenceCount())));
+        emitDistance(idxs, NAN);
+        return this->divergenceTimes->get(i);
+    }
+
     INFO("Running pairwise calculator for sequence id " << idxs.first << " and " << idxs.second
             << " ,number " << i+1 <<" out of " << pairCount << " pairs" );
-    BandCalculator* bc = new BandCalculator(inputSequences->getSequencesAt(idxs.first), inputSequences->getSequencesAt(idxs.second),
-            substModel, indelModel, dm->getDistance(idxs.first,idxs.second));
-    band = bc->getBand();
-    if (algorithm == Definitions::AlgorithmType::Viterbi)
+
+    std::pair<double, double> limits(0, numeric_limits<double>::infinity());
+    if (triangleBoundPivots > 0)
+        limits = getTriangleBounds(idxs.first, idxs.second);
+
+    setDivergenceTime(i, optimizeSequencePair(inputSequences->getSequencesAt(idxs.first), inputSequences->getSequencesAt(idxs.second),
+            dm->getDistance(idxs.first,idxs.second), limits));
+    emitDistance(idxs, lastLikelihood);
+    checkpointIfDue();
+    return this->divergenceTimes->get(i);
+}
+
+void BandingEstimator::setDivergenceTime(unsigned long i, double time)
+{
+    divergenceTimes->set(i, time);
+    if (checkpoint != nullptr)
+        checkpoint->addTime(i, divergenceTimes->get(i));
+}
+
+void BandingEstimator::setCheckpoint(const string& path, unsigned long pairInterval, double timeInterval)
+{
+    delete checkpoint;
+    checkpoint = new Checkpoint(parameters, inputSequences);
+    checkpointPath = path;
+    checkpointPairInterval = pairInterval;
+    checkpointTimeInterval = timeInterval;
+    pairsSinceCheckpoint = 0;
+    lastCheckpoint = chrono::steady_clock::now();
+}
+
+void BandingEstimator::saveCheckpoint()
+{
+    if (checkpoint == nullptr)
+        throw HmmException("Checkpoints are not enabled");
+
+    DEBUG("Saving checkpoint " << checkpointPath);
+    checkpoint->save(checkpointPath, gt->getDistances(), *divergenceTimes);
+    pairsSinceCheckpoint = 0;
+    lastCheckpoint = chrono::steady_clock::now();
+}
+
+void BandingEstimator::checkpointIfDue()
+{
+    if (checkpoint == nullptr)
+        return;
+
+    pairsSinceCheckpoint++;
+    bool due = checkpointPairInterval > 0 && pairsSinceCheckpoint >= checkpointPairInterval;
+    if (!due && checkpointTimeInterval > 0)
+        due = chrono::duration<double>(chrono::steady_clock::now() - lastCheckpoint).count() >= checkpointTimeInterval;
+
+    if (due)
+        saveCheckpoint();
+}
+
+void BandingEstimator::emitOptimizedDistances(unsigned int shard, unsigned int shardCount)
+{
+    for (unsigned long i = 0; i < pairCount; i++)
+        if (isShardPair(i, shard, shardCount) && !std::isnan(divergenceTimes->get(i)))
+            emitDistance(inputSequences->getPairOfSequenceIndices(i), NAN);
+}
+
+void BandingEstimator::restoreDivergenceTimes(Checkpoint& cp)
+{
+    cp.readDivergenceTimes(*divergenceTimes);
+}
+
+void BandingEstimator::emitDistance(std::pair<unsigned int, unsigned int> idxs, double lnl)
+{
+    if (distanceWriter == nullptr)
+        return;
+
+    DistanceRecord record;
+    record.seq1 = idxs.first;
+    record.seq2 = idxs.second;
+    record.distance = divergenceTimes->getDistance(idxs.first, idxs.second);
+    record.lnl = lnl;
+    distanceWriter->write(record);
+}
+
+void BandingEstimator::optimizeNearestNeighbours(unsigned int k)
+{
+    unsigned int count = inputSequences->getSequenceCount();
+    const PairwiseStorage& guideDistances = gt->getDistances();
+    vector<std::pair<double, unsigned int> > candidates;
+
+    delete sparseDistances;
+    sparseDistances = new SparseDistanceMatrix(count);
+
+    INFO("Optimizing the " << k << " nearest neighbours of " << count << " sequences by k-mer distance");
+
+    for (unsigned int i = 0; i < count; i++)
     {
-        DEBUG("Creating Viterbi algorithm to optimize the pairwise divergence time...");
-        hmm = new ViterbiPairHMM(inputSequences->getSequencesAt(idxs.first), inputSequences->getSequencesAt(idxs.second),
-                substModel, indelModel, Definitions::DpMatrixType::Full, band);
+        //duplicates share the neighbours of their representative, and are never
+        //neighbours of each other
+        unsigned int rep = inputSequences->getRepresentative(i);
+        candidates.clear();
+        for (unsigned int j = 0; j < count; j++)
+        {
+            if (j == rep || !inputSequences->isRepresentative(j))
+                continue;
+            candidates.push_back(std::make_pair(guideDistances.getDistance(rep, j), j));
+        }
+
+        unsigned int selected = min<size_t>(k, candidates.size());
+        partial_sort(candidates.begin(), candidates.begin() + selected, candidates.end());
+
+        for (unsigned int c = 0; c < selected; c++)
+        {
+            unsigned int j = candidates[c].second;
+            if (sparseDistances->hasDistance(i, j))
+                continue;
+            sparseDistances->addDistance(i, j, optimizePair(Sequences::getPairIndex(min(i,j), max(i,j), count)));
+        }
     }
-    else if (algorithm == Definitions::AlgorithmType::Forward)
+
+    INFO("Optimized " << sparseDistances->getPairCount() << " out of " << pairCount << " pairs");
+}
+
+double BandingEstimator::getSparseDistance(unsigned int i, unsigned int j, bool& computed)
+{
+    if (sparseDistances == nullptr)
+        throw HmmException("Nearest neighbours have not been optimized");
+
+    double distance = sparseDistances->getDistance(i, j);
+    computed = !std::isnan(distance);
+    if (computed)
+        return distance;
+
+    return gt->getDistances().getDistance(i, j);
+}
+
+std::pair<double, double> BandingEstimator::getTriangleBounds(unsigned int i, unsigned int j)
+{
+    unsigned int count = inputSequences->getSequenceCount();
+    unsigned int pivots = 0;
+    double lower = 0;
+    double upper = numeric_limits<double>::infinity();
+
+    //the lowest representatives act as pivots, pairs are optimized in row order so their
+    //distances are usually known early
+    for (unsigned int k = 0; k < count && pivots < triangleBoundPivots; k++)
     {
-        DEBUG("Creating forward algorithm to optimize the pairwise divergence time...");
-        hmm = new ForwardPairHMM(inputSequences->getSequencesAt(idxs.first), inputSequences->getSequencesAt(idxs.second),
-                substModel, indelModel, Definitions::DpMatrixType::Full, band);
+        if (k == i || k == j || !inputSequences->isRepresentative(k))
+            continue;
+
+        double dik = divergenceTimes->getDistance(i, k);
+        double dkj = divergenceTimes->getDistance(j, k);
+        if (std::isnan(dik) || std::isnan(dkj))
+            continue;
+
+        lower = max(lower, fabs(dik - dkj));
+        upper = min(upper, dik + dkj);
+        pivots++;
     }
 
-    //hmm->setDivergenceTimeAndCalculateModels(modelParams->getDivergenceTime(0)); //zero as there's only one pair!
+    if (pivots == 0)
+        return std::make_pair(0.0, numeric_limits<double>::infinity());
 
-    //LikelihoodSurfacePlotter lsp;
-    //lsp.setTargetHMM(hmm);
-    //lsp.getLikelihoodSurface();
+    //estimates are noisy and saturate, so the metric bounds only hold approximately
+    lower = lower * (1.0 - triangleBoundMargin) - Definitions::triangleBoundSlack;
+    upper = upper * (1.0 + triangleBoundMargin) + Definitions::triangleBoundSlack;
+
+    DUMP("Triangle bounds for pair " << i << "," << j << " from " << pivots << " pivots: " << lower << " - " << upper);
+    return std::make_pair(max(lower, 0.0), upper);
+}
+
+double BandingEstimator::optimizeSequencePair(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2, double guideDistance,
+        std::pair<double, double> limits)
+{
+    EvolutionaryPairHMM* hmm;
+    Band* band = nullptr;
+    BandCalculator* bc = nullptr;
+    PairHmmCalculationWrapper* wrapper = new PairHmmCalculationWrapper();
+    double result;
+    double initialTime, accuracy, leftBound, rightBound;
+    //no band for the anchored forward, the anchors restrict the DP instead
+    bool anchored = algorithm == Definitions::AlgorithmType::AnchoredForward;
+    //the striped viterbi fills the whole matrix, a band calculation would cost more than it saves
+    bool striped = algorithm == Definitions::AlgorithmType::Viterbi;
+
+    if (!anchored && !striped && bandingType == Definitions::BandingType::AnchorBanding && guideDistance < Definitions::kmerHighDivergence)
+    {
+        AnchorBandCalculator abc(s1, s2, gt->getKmerSize(), anchorMargin);
+        band = abc.getBand();
+    }
+
+    if (band != nullptr || anchored || striped)
+    {
+        initialTime = guideDistance > Definitions::almostZero ? guideDistance : Definitions::almostZero;
+        accuracy = Definitions::highDivergenceAccuracyDelta;
+        leftBound = Definitions::almostZero;
+        rightBound = modelParams->divergenceBound;
+    }
+    else
+    {
+        bc = new BandCalculator(s1, s2, substModel, indelModel, guideDistance);
+        band = bc->getBand();
+        initialTime = bc->getClosestDistance();
+        accuracy = bc->getBrentAccuracy();
+        leftBound = bc->getLeftBound();
+        rightBound = bc->getRightBound() < 0 ? modelParams->divergenceBound : bc->getRightBound();
+    }
+    if (algorithm == Definitions::AlgorithmType::Viterbi)
+    {
+        DEBUG("Creating striped Viterbi algorithm to optimize the pairwise divergence time...");
+        hmm = new StripedViterbiPairHMM(s1, s2, substModel, indelModel);
+    }
+    else if (anchored)
+    {
+        DEBUG("Creating anchored forward algorithm to optimize the pairwise divergence time...");
+        hmm = new AnchoredForwardPairHMM(s1, s2, substModel, indelModel, gt->getKmerSize());
+    }
+    else
+    {
+        DEBUG("Creating forward algorithm to optimize the pairwise divergence time...");
+        hmm = new ForwardPairHMM(s1, s2, substModel, indelModel, Definitions::DpMatrixType::Full, band);
+    }
 
     wrapper->setTargetHMM(hmm);
     DUMP("Set model parameter in the hmm...");
     wrapper->setModelParameters(modelParams);
-    modelParams->setUserDivergenceParams({bc->getClosestDistance()});
     numopt->setTarget(wrapper);
-    numopt->setAccuracy(bc->getBrentAccuracy());
-    numopt->setBounds(bc->getLeftBound(), bc->getRightBound() < 0 ? modelParams->divergenceBound : bc->getRightBound());
+    numopt->setAccuracy(accuracy);
 
-    result = numopt->optimize() * -1.0;
+    double lo = max(leftBound, limits.first);
+    double hi = min(rightBound, limits.second);
+    bool limited = (lo > leftBound || hi < rightBound) && lo < hi;
+
+    if (limited)
+    {
+        DEBUG("Brent bounds tightened to " << lo << " - " << hi);
+        modelParams->setUserDivergenceParams({min(max(initialTime, lo), hi)});
+        numopt->setBounds(lo, hi);
+        result = numopt->optimize() * -1.0;
+
+        //an optimum on a tightened bound means the bound was wrong, search the full interval
+        double time = modelParams->getDivergenceTime(0);
+        double tol = 2.0 * accuracy * time + Definitions::almostZero;
+        bool onBound = (lo > leftBound && time - lo < tol) || (hi < rightBound && hi - time < tol);
+        triangleBoundStats.first++;
+        if (onBound)
+        {
+            DEBUG("Optimum " << time << " on a tightened bound, repeating with the full interval");
+            triangleBoundStats.second++;
+            limited = false;
+        }
+    }
+
+    if (!limited)
+    {
+        modelParams->setUserDivergenceParams({initialTime});
+        numopt->setBounds(leftBound, rightBound);
+        result = numopt->optimize() * -1.0;
+    }
     DEBUG("Likelihood after pairwise optimization: " << result);
-    if (result <= (Definitions::minMatrixLikelihood /2.0))
+    if (result <= (Definitions::minMatrixLikelihood /2.0) && band != nullptr)
     {
-        DEBUG("Optimization failed for pair #" << i << " Zero probability FWD");
+        DEBUG("Optimization failed, zero probability FWD");
         band->output();
         dynamic_cast<DpMatrixFull*>(hmm->M->getDpMatrix())->outputValuesWithBands(band->getMatchBand() ,band->getInsertBand(),band->getDeleteBand(),'|', '-');
         dynamic_cast<DpMatrixFull*>(hmm->X->getDpMatrix())->outputValuesWithBands(band->getInsertBand(),band->getMatchBand() ,band->getDeleteBand(),'\\', '-');
@@ -193,10 +507,235 @@ double BandingEstimator::optimizePair(int i)
     delete band;
     delete bc;
     delete hmm;
+    delete wrapper;
+
+    lastLikelihood = result;
+
+    if (anchored && approximationGapInterval > 0 && anchoredPairCount++ % approximationGapInterval == 0)
+    {
+        sampleApproximationGap(s1, s2, result);
+    }
 
     return modelParams->getDivergenceTime(0);
 }
 
+void BandingEstimator::sampleApproximationGap(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2, double lnl)
+{
+    ApproximationGap gap;
+    //without anchors the engine runs the unbanded forward in linear memory
+    AnchoredForwardPairHMM exact(s1, s2, substModel, indelModel, gt->getKmerSize(), numeric_limits<unsigned int>::max());
+
+    gap.divergenceTime = modelParams->getDivergenceTime(0);
+    gap.approximateLnl = lnl;
+    exact.setDivergenceTimeAndCalculateModels(gap.divergenceTime);
+    gap.exactLnl = exact.runAlgorithm() * -1.0;
+
+    approximationGaps.push_back(gap);
+    INFO("Anchored forward approximation gap " << gap.exactLnl - gap.approximateLnl << " at divergence time "
+            << gap.divergenceTime << " (lnL " << gap.approximateLnl << " vs " << gap.exactLnl << ")");
+}
+
+double BandingEstimator::checkStripedViterbi(double time)
+{
+	unsigned int count = inputSequences->getSequenceCount();
+	double maxError = 0;
+
+	//both orders, the second sequence is the striped one
+	for(unsigned int i = 0; i < count; i++)
+		for(unsigned int j = 0; j < count; j++)
+		{
+			if (i == j)
+				continue;
+			vector<SequenceElement*>* s1 = inputSequences->getSequencesAt(i);
+			vector<SequenceElement*>* s2 = inputSequences->getSequencesAt(j);
+
+			ViterbiPairHMM scalar(s1, s2, substModel, indelModel);
+			scalar.setDivergenceTimeAndCalculateModels(time);
+			double expected = scalar.runAlgorithm() * -1.0;
+
+			StripedViterbiPairHMM striped(s1, s2, substModel, indelModel);
+			striped.setDivergenceTimeAndCalculateModels(time);
+			double lnl = striped.runAlgorithm() * -1.0;
+
+			double error = fabs(lnl - expected) / max(1.0, fabs(expected));
+			DUMP("Striped Viterbi of " << i << "," << j << ": " << lnl << " vs " << expected);
+			maxError = max(maxError, error);
+		}
+
+	return maxError;
+}
+
+double BandingEstimator::checkAnchoredForward(double time)
+{
+	unsigned int count = inputSequences->getSequenceCount();
+	double maxError = 0;
+
+	for(unsigned int i = 0; i < count; i++)
+		for(unsigned int j = 0; j < count; j++)
+		{
+			if (i == j)
+				continue;
+			vector<SequenceElement*>* s1 = inputSequences->getSequencesAt(i);
+			vector<SequenceElement*>* s2 = inputSequences->getSequencesAt(j);
+
+			ForwardPairHMM full(s1, s2, substModel, indelModel, Definitions::DpMatrixType::Full);
+			full.setDivergenceTimeAndCalculateModels(time);
+			double expected = full.runAlgorithm() * -1.0;
+
+			//no run is long enough to become an anchor
+			AnchoredForwardPairHMM anchored(s1, s2, substModel, indelModel, gt->getKmerSize(),
+					numeric_limits<unsigned int>::max());
+			anchored.setDivergenceTimeAndCalculateModels(time);
+			double lnl = anchored.runAlgorithm() * -1.0;
+
+			double error = fabs(lnl - expected) / max(1.0, fabs(expected));
+			DUMP("Anchored forward of " << i << "," << j << ": " << lnl << " vs " << expected);
+			maxError = max(maxError, error);
+		}
+
+	return maxError;
+}
+
+double BandingEstimator::checkSparsePosteriors(double time)
+{
+	unsigned int count = inputSequences->getSequenceCount();
+	double limit = Definitions::bandPosteriorLikelihoodLimit + Definitions::bandPosteriorLikelihoodDelta;
+	double maxError = 0;
+
+	for(unsigned int i = 0; i < count; i++)
+		for(unsigned int j = 0; j < count; j++)
+		{
+			if (i == j)
+				continue;
+			vector<SequenceElement*>* s1 = inputSequences->getSequencesAt(i);
+			vector<SequenceElement*>* s2 = inputSequences->getSequencesAt(j);
+
+			ForwardPairHMM fwd(s1, s2, substModel, indelModel, Definitions::DpMatrixType::Full);
+			fwd.setDivergenceTimeAndCalculateModels(time);
+			fwd.runAlgorithm();
+
+			BackwardPairHMM bwd(s1, s2, substModel, indelModel, Definitions::DpMatrixType::Full);
+			bwd.setDivergenceTimeAndCalculateModels(time);
+			bwd.runAlgorithm();
+
+			//coverage above 1 spans every row of every column
+			Band band(s1->size(), s2->size(), 2.0);
+			vector<PosteriorCell> sparse;
+			bwd.calculatePosteriorBand(&fwd, &band, limit, &sparse);
+
+			//the first row and column hold no posteriors in the full matrices
+			map<tuple<Definitions::StateId, unsigned int, unsigned int>, double> cells;
+			for (auto& cell : sparse)
+				if (cell.row > 0 && cell.col > 0)
+					cells[make_tuple(cell.state, cell.row, cell.col)] = cell.lnl;
+
+			//overwrites the backward matrices with the posteriors
+			bwd.calculatePosteriors(&fwd);
+			array<PairwiseHmmStateBase*, 3> states = {{bwd.getM(), bwd.getX(), bwd.getY()}};
+			array<Definitions::StateId, 3> ids = {{Definitions::StateId::Match, Definitions::StateId::Insert, Definitions::StateId::Delete}};
+
+			unsigned long found = 0;
+			for (unsigned int s = 0; s < states.size(); s++)
+				for (unsigned int row = 1; row <= s1->size(); row++)
+					for (unsigned int col = 1; col <= s2->size(); col++)
+					{
+						double lnl = states[s]->getValueAt(row, col);
+						if (lnl < limit)
+							continue;
+						auto it = cells.find(make_tuple(ids[s], row, col));
+						if (it == cells.end())
+						{
+							DUMP("Sparse posteriors of " << i << "," << j << " miss cell " << row << "," << col);
+							return numeric_limits<double>::infinity();
+						}
+						maxError = max(maxError, fabs(it->second - lnl));
+						found++;
+					}
+
+			if (found != cells.size())
+			{
+				DUMP("Sparse posteriors of " << i << "," << j << " hold " << cells.size() - found << " cells below the limit");
+				return numeric_limits<double>::infinity();
+			}
+		}
+
+	return maxError;
+}
+
+void BandingEstimator::optimizeQueries(IParser* queries, double* distances)
+{
+	vector<string>* rawQueries = queries->getSequences();
+	unsigned int refCount = inputSequences->getSequenceCount();
+	vector<SequenceElement*> query;
+	vector<double> guideDistances;
+	unsigned int same;
+
+	for(unsigned int q = 0; q < rawQueries->size(); q++)
+	{
+		INFO("Running query " << q+1 << " out of " << rawQueries->size() << " against " << refCount << " reference sequences");
+		query = dict->translate((*rawQueries)[q], true);
+
+		//a query identical to a reference sequence is its duplicate, so it gets the reference distances;
+		//the pairwise optimization depends on the order of the sequences at saturated distances
+		if (inputSequences->findIdentical(query, same))
+		{
+			for(unsigned int r = 0; r < refCount; r++)
+				distances[q*refCount + r] = r == same ? 0 :
+						optimizePair(Sequences::getPairIndex(min(same,r), max(same,r), refCount));
+			continue;
+		}
+
+		//otherwise the query takes the place of a sequence added after the reference ones
+		guideDistances = gt->getQueryDistances((*rawQueries)[q]);
+
+		for(unsigned int r = 0; r < refCount; r++)
+		{
+			//representatives come first, so a duplicate reference can copy its value
+			if (inputSequences->isRepresentative(r))
+				distances[q*refCount + r] = optimizeSequencePair(inputSequences->getSequencesAt(r), &query, guideDistances[r]);
+			else
+				distances[q*refCount + r] = distances[q*refCount + inputSequences->getRepresentative(r)];
+		}
+	}
+}
+
+void BandingEstimator::resizeStores(unsigned int count)
+{
+	PairwiseStorage& guide = gt->getDistances();
+	unsigned int guideCount = guide.getSequenceCount();
+
+	guide.resize(count);
+	try
+	{
+		divergenceTimes->resize(count);
+	}
+	catch (HmmException&)
+	{
+		//shrinking does not fail
+		guide.resize(guideCount);
+		throw;
+	}
+}
+
+void BandingEstimator::addSequences(unsigned int previousCount)
+{
+	unsigned int count = inputSequences->getSequenceCount();
+
+	//a no-op after resizeStores()
+	divergenceTimes->resize(count);
+	pairCount = inputSequences->getPairCount();
+
+	//neighbour lists would miss the new sequences, they have to be selected again
+	delete sparseDistances;
+	sparseDistances = nullptr;
+
+	//later checkpoints describe the extended input
+	if (checkpoint != nullptr)
+		*checkpoint = Checkpoint(parameters, inputSequences);
+
+	DEBUG("Banding Estimator extended from " << previousCount << " to " << count << " sequences, " << pairCount << " pairs");
+}
+
 
 double BandingEstimator::runIteration()
 {
@@ -207,9 +746,8 @@ double BandingEstimator::runIteration()
 
 void BandingEstimator::outputDistanceMatrix(stringstream& ss)
 {
-	unsigned int count, pairCount;
+	unsigned int count;
 	count = this->inputSequences->getSequenceCount();
-	pairCount = this->inputSequences->getPairCount();
 
 	ss << "\t" << this->inputSequences->getSequenceCount() << endl;
 
@@ -36,19 +36,29 @@
 #include "core/Optimizer.hpp"
 #include "core/BrentOptimizer.hpp"
 #include "core/PairHmmCalculationWrapper.hpp"
+#include "core/PMatrixCache.hpp"
+#include "core/DistanceWriter.hpp"
+#include "core/SparseDistanceMatrix.hpp"
+#include "core/ModelParameterFile.hpp"
+#include "core/Checkpoint.hpp"
+#include "core/PairwiseStorage.hpp"
 
 #include "models/SubstitutionModelBase.hpp"
 #include "models/IndelModel.hpp"
 
 #include "heuristics/GuideTree.hpp"
 #include "heuristics/BandCalculator.hpp"
+#include "heuristics/AnchorBandCalculator.hpp"
 #include "heuristics/Band.hpp"
 
 #include "hmm/ForwardPairHMM.hpp"
 #include "hmm/ViterbiPairHMM.hpp"
+#include "hmm/StripedViterbiPairHMM.hpp"
+#include "hmm/AnchoredForwardPairHMM.hpp"
 
 #include <vector>
 #include <sstream>
+#include <chrono>
 
 using namespace std;
 
@@ -59,6 +69,15 @@ namespace EBC
 //Estimate pairwise distances using bands
 class BandingEstimator : public IOptimizable
 {
+public:
+
+	//anchored forward likelihood against the full forward one, at the optimized time
+	struct ApproximationGap
+	{
+		double divergenceTime;
+		double approximateLnl;
+		double exactLnl;
+	};
 
 protected:
 
@@ -83,18 +102,77 @@ protected:
 	bool estimateDivergence;
 	bool estimateAlpha;
 
-	unsigned int pairCount;
+	unsigned long pairCount;
 
 	//vector<EvolutionaryPairHMM*> hmms;
 	//delete bands in the destructor
 	//vector<Band*> bands;
-	vector<double> divergenceTimes;
+	//owned, in the backend chosen for the input sequences
+	PairwiseStorage* divergenceTimes;
 
 	OptimizedModelParameters* modelParams;
 
+	//emission tables shared by every pair and Brent iteration
+	PMatrixCache* ptCache;
+
+	Definitions::BandingType bandingType;
+	unsigned int anchorMargin;
+
+	unsigned int anchoredPairCount;
+	//0 disables gap sampling
+	unsigned int approximationGapInterval;
+	vector<ApproximationGap> approximationGaps;
+
+	void sampleApproximationGap(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2, double lnl);
+
+	//0 disables triangle-inequality bounds
+	unsigned int triangleBoundPivots;
+	double triangleBoundMargin;
+
+	//bounded pairs, and bounded pairs repeated on the full interval
+	std::pair<unsigned long, unsigned long> triangleBoundStats;
+
+	//Brent interval for pair i,j from d(i,k) and d(k,j) of already optimized pivots k
+	std::pair<double, double> getTriangleBounds(unsigned int i, unsigned int j);
+
+	//not owned, receives every finished pair
+	DistanceWriter* distanceWriter;
+
+	//log likelihood at the last optimized divergence time
+	double lastLikelihood;
+
+	void emitDistance(std::pair<unsigned int, unsigned int> idxs, double lnl);
+
+	//shards split the pairs of representatives, copies of duplicates follow their
+	//representative pair so that no shard optimizes a pair owned by another one
+	bool isShardPair(unsigned long i, unsigned int shard, unsigned int shardCount);
+
+	//pairs optimized in nearest neighbour mode, nullptr until it was run
+	SparseDistanceMatrix* sparseDistances;
+
+	//parameters the estimator was created with, saved in checkpoints
+	ModelParameterFile parameters;
+
+	//nullptr if checkpoints are disabled
+	Checkpoint* checkpoint;
+	string checkpointPath;
+	unsigned long checkpointPairInterval;
+	double checkpointTimeInterval;
+	unsigned long pairsSinceCheckpoint;
+	chrono::steady_clock::time_point lastCheckpoint;
+
+	void checkpointIfDue();
+
+	//stores the time of pair i and queues it for the next checkpoint
+	void setDivergenceTime(unsigned long i, double time);
+
 public:
+    //calculatedModel (with the modelMaths it calculates with) is adopted instead of building
+    //a new substitution model, e.g. the one released by the ModelEstimator; owned afterwards.
+    //It has to have rateCategories categories, callers check before constructing
     BandingEstimator(Definitions::AlgorithmType at, Sequences* inputSeqs, Definitions::ModelType model,std::vector<double> indel_params,
-			std::vector<double> subst_params, Definitions::OptimizationType ot, unsigned int rateCategories, double alpha, GuideTree* gt);
+			std::vector<double> subst_params, Definitions::OptimizationType ot, unsigned int rateCategories, double alpha, GuideTree* gt,
+			SubstitutionModelBase* calculatedModel = nullptr, Maths* modelMaths = nullptr);
 
 	virtual ~BandingEstimator();
 
@@ -105,11 +183,134 @@ public:
 	void outputDistanceMatrix(stringstream&);
 
 	void optimizePairByPair();
-    double optimizePair(int pairIdx);
+    double optimizePair(unsigned long pairIdx);
+
+    //Divergence time between any two translated sequences, seeded with a k-mer guide distance;
+    //limits narrow the Brent interval, an optimum on a narrowed bound is searched again in full
+    double optimizeSequencePair(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2, double guideDistance,
+            std::pair<double, double> limits = std::make_pair(0.0, numeric_limits<double>::infinity()));
+
+    //Shard shard of shardCount: pairs whose representative pair index modulo shardCount is
+    //shard, so that separate processes can split the pair space deterministically
+    void optimizeShard(unsigned int shard, unsigned int shardCount);
+
+    //Save a checkpoint to path every pairInterval optimized pairs or every timeInterval
+    //seconds, whichever comes first; 0 disables either criterion. The first checkpoint holds
+    //the whole state, later ones append the pairs finished in between
+    void setCheckpoint(const string& path, unsigned long pairInterval = Definitions::checkpointPairInterval,
+            double timeInterval = Definitions::checkpointTimeInterval);
+
+    void saveCheckpoint();
+
+    //Continue from the divergence times of a loaded checkpoint, only missing pairs get optimized
+    void restoreDivergenceTimes(Checkpoint& checkpoint);
+
+    //Model parameters the distances are calculated with
+    const ModelParameterFile& getParameters()
+    {
+        return parameters;
+    }
+
+    //Largest difference between the striped and the scalar Viterbi log-likelihood of any
+    //ordered pair of input sequences at divergence time, relative to the scalar one
+    double checkStripedViterbi(double time);
+
+    //Largest difference between the anchored forward without anchors and the full forward
+    //log-likelihood of any ordered pair of input sequences at divergence time, relative to
+    //the full one
+    double checkAnchoredForward(double time);
+
+    //Largest difference between the sparse posteriors of a band over the whole matrix and
+    //the posteriors of the full matrices of any ordered pair of input sequences at divergence
+    //time, infinity if the sparse output misses a cell above the band limit or adds one
+    double checkSparsePosteriors(double time);
+
+    //Stream the pairs of a shard that already have a distance, e.g. restored ones,
+    //with a NaN likelihood
+    void emitOptimizedDistances(unsigned int shard = 0, unsigned int shardCount = 1);
+
+    //Sparse mode: optimize only the pairs of every sequence with its k nearest sequences by
+    //k-mer distance; duplicates get the neighbours of their representative
+    void optimizeNearestNeighbours(unsigned int k);
+
+    //Optimized distance of a pair from the sparse mode, the k-mer estimate if the pair
+    //was not optimized, computed tells which one it is
+    double getSparseDistance(unsigned int i, unsigned int j, bool& computed);
+
+    SparseDistanceMatrix* getSparseDistances()
+    {
+        return sparseDistances;
+    }
+
+    //Rectangular mode: distances from every query to every input (reference) sequence,
+    //written row-major into distances, which must hold queries x references elements
+    void optimizeQueries(IParser* queries, double* distances);
+
+    //Grow the guide distances and the divergence times to count sequences before they are
+    //appended to the input, or shrink them back; a failure leaves both stores as they were
+    void resizeStores(unsigned int count);
+
+    //Extend the distance store after sequences were appended to the input;
+    //model parameters stay as they are and only the new pairs are left to optimize
+    void addSequences(unsigned int previousCount);
+
+    //Replace the P(t) cache, resolution is the grid spacing of the interpolated mode
+    void setPtCacheMode(Definitions::PtCacheMode mode, double resolution = Definitions::ptCacheResolution);
+
+    PMatrixCache* getPtCache()
+    {
+        return ptCache;
+    }
+
+    //Anchor banding builds low and medium divergence bands from chained k-mer matches,
+    //pairs with poor chain coverage still get the posterior band
+    void setBanding(Definitions::BandingType type, unsigned int margin = Definitions::anchorBandMargin)
+    {
+        bandingType = type;
+        anchorMargin = margin;
+    }
+
+    //Narrow each pair's Brent interval with triangle-inequality bounds from up to pivots
+    //sequences, widened by the relative margin; 0 pivots disables it
+    void setTriangleBounds(unsigned int pivots, double margin = Definitions::triangleBoundMargin)
+    {
+        triangleBoundPivots = pivots;
+        triangleBoundMargin = margin;
+    }
+
+    //Compare every interval-th anchored forward pair against the full forward likelihood,
+    //0 disables it; each sample costs a full forward calculation of the pair
+    void setApproximationGapInterval(unsigned int interval)
+    {
+        approximationGapInterval = interval;
+    }
+
+    //Stream each pair as soon as its distance is known, nullptr stops streaming;
+    //copies of duplicate pairs carry a NaN likelihood
+    void setDistanceWriter(DistanceWriter* writer)
+    {
+        distanceWriter = writer;
+    }
+
+    const std::pair<unsigned long, unsigned long>& getTriangleBoundStats()
+    {
+        return triangleBoundStats;
+    }
+
+    //Gap report of the AnchoredForward algorithm, filled for sampled pairs only
+    const vector<ApproximationGap>& getApproximationGaps()
+    {
+        return approximationGaps;
+    }
+
+    GuideTree* getGuideTree()
+    {
+        return gt;
+    }
 
-    const vector<double> &getOptimizedTimes()
+    const PairwiseStorage& getOptimizedTimes()
 	{
-		return this->divergenceTimes;
+		return *this->divergenceTimes;
 	}
 
 	//ModelParameters getMlParameters()
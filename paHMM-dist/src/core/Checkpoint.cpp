@@ -0,0 +1,333 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+#include "core/Checkpoint.hpp"
+#include "core/Definitions.hpp"
+#include <fstream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace EBC
+{
+
+static const char checkpointMagic[8] = {'P','A','H','M','M','C','P','3'};
+
+//pairwise values go through a buffer of this many, whatever backend holds them
+static const unsigned long checkpointBlockValues = 1ul << 16;
+
+template<typename T>
+static void writeValue(ostream& out, T value)
+{
+	out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static T readValue(istream& in)
+{
+	T value;
+	in.read(reinterpret_cast<char*>(&value), sizeof(T));
+	return value;
+}
+
+static void writeDoubles(ostream& out, const vector<double>& values)
+{
+	writeValue<uint64_t>(out, values.size());
+	out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double));
+}
+
+static void writeDoubles(ostream& out, const PairwiseStorage& values)
+{
+	vector<double> block;
+	block.reserve(checkpointBlockValues);
+	writeValue<uint64_t>(out, values.getPairCount());
+	for (unsigned long i = 0; i < values.getPairCount(); i++)
+	{
+		block.push_back(values.get(i));
+		if (block.size() == checkpointBlockValues || i + 1 == values.getPairCount())
+		{
+			out.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(double));
+			block.clear();
+		}
+	}
+}
+
+static vector<double> readDoubles(istream& in)
+{
+	uint64_t size = readValue<uint64_t>(in);
+	if (!in || size > (1ull << 40))
+		throw HmmException("Corrupt checkpoint");
+	vector<double> values(size);
+	in.read(reinterpret_cast<char*>(values.data()), size * sizeof(double));
+	return values;
+}
+
+//FNV-1a, the checksum of appended blocks
+static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+//flush a file, or the entry of a renamed file with its directory, to the disk
+static void syncPath(const string& path, bool directory = false)
+{
+	int fd = open(path.c_str(), directory ? O_RDONLY : O_WRONLY);
+	if (fd < 0)
+		throw HmmException("Could not open " + path + ": " + strerror(errno));
+	int result = fsync(fd);
+	close(fd);
+	if (result != 0 && !directory)
+		throw HmmException("Could not sync " + path + ": " + strerror(errno));
+}
+
+Checkpoint::Checkpoint(const ModelParameterFile& params, Sequences* inputSeqs) : parameters(params),
+		fingerprint(inputSeqs ? getFingerprint(inputSeqs) : 0), sequenceCount(inputSeqs ? inputSeqs->getSequenceCount() : 0),
+		written(false), guideOffset(0), timesOffset(0), timesEnd(0), completedCount(0)
+{
+}
+
+uint64_t Checkpoint::getFingerprint(Sequences* inputSeqs)
+{
+	//FNV-1a over names and sequences, stable across runs and builds
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&hash](const string& s)
+	{
+		for (unsigned char c : s)
+			hash = (hash ^ c) * 1099511628211ull;
+		hash = (hash ^ 0xff) * 1099511628211ull;
+	};
+
+	for (unsigned int i = 0; i < inputSeqs->getSequenceCount(); i++)
+	{
+		add(inputSeqs->getSequenceName(i));
+		add(inputSeqs->getRawSequenceAt(i));
+	}
+	return hash;
+}
+
+void Checkpoint::addTime(unsigned long idx, double time)
+{
+	pendingTimes.push_back({idx, time});
+}
+
+void Checkpoint::appendTimes(ostream& out, const vector<TimeRecord>& records)
+{
+	//record count, records and their checksum; a block failing the checksum ends the file
+	writeValue<uint64_t>(out, records.size());
+	out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(TimeRecord));
+	writeValue<uint64_t>(out, hashBytes(records.data(), records.size() * sizeof(TimeRecord)));
+}
+
+void Checkpoint::save(const string& path, const PairwiseStorage& guide, const PairwiseStorage& times)
+{
+	if (written)
+	{
+		if (pendingTimes.empty())
+			return;
+
+		{
+			ofstream out(path, ios::binary | ios::app);
+			if (!out)
+				throw HmmException("Could not open " + path);
+			appendTimes(out, pendingTimes);
+			out.flush();
+			if (!out)
+				throw HmmException("Could not write " + path);
+		}
+		syncPath(path);
+		pendingTimes.clear();
+		return;
+	}
+
+	string tmpPath = path + ".tmp";
+	{
+		ofstream out(tmpPath, ios::binary | ios::trunc);
+		if (!out)
+			throw HmmException("Could not create " + tmpPath);
+
+		out.write(checkpointMagic, sizeof(checkpointMagic));
+		writeValue<uint64_t>(out, fingerprint);
+		writeValue<uint32_t>(out, sequenceCount);
+		writeValue<int32_t>(out, parameters.model);
+		writeValue<uint32_t>(out, parameters.rateCategories);
+		writeValue<double>(out, parameters.alpha);
+		writeDoubles(out, parameters.substitutionParameters);
+		writeDoubles(out, parameters.indelParameters);
+		writeDoubles(out, guide);
+
+		//every time finished so far, including restored ones, in blocks of records
+		vector<TimeRecord> block;
+		block.reserve(checkpointBlockValues);
+		for (unsigned long i = 0; i < times.getPairCount(); i++)
+		{
+			if (!std::isnan(times.get(i)))
+				block.push_back({i, times.get(i)});
+			if (block.size() == checkpointBlockValues || (i + 1 == times.getPairCount() && !block.empty()))
+			{
+				appendTimes(out, block);
+				block.clear();
+			}
+		}
+
+		out.flush();
+		if (!out)
+			throw HmmException("Could not write " + tmpPath);
+	}
+	syncPath(tmpPath);
+
+	if (rename(tmpPath.c_str(), path.c_str()) != 0)
+		throw HmmException("Could not replace " + path + ": " + strerror(errno));
+
+	size_t slash = path.find_last_of('/');
+	syncPath(slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash), true);
+
+	written = true;
+	pendingTimes.clear();
+}
+
+Checkpoint Checkpoint::load(const string& path)
+{
+	ifstream in(path, ios::binary);
+	if (!in)
+		throw HmmException("Can't open the checkpoint : " + path);
+
+	char magic[sizeof(checkpointMagic)];
+	in.read(magic, sizeof(magic));
+	if (!in || memcmp(magic, checkpointMagic, sizeof(magic)) != 0)
+		throw HmmException(path + " is not a checkpoint");
+
+	Checkpoint cp(ModelParameterFile(Definitions::ModelType::GTR, {}, {}, NAN, 0), nullptr);
+	cp.fingerprint = readValue<uint64_t>(in);
+	cp.sequenceCount = readValue<uint32_t>(in);
+	cp.parameters.model = static_cast<Definitions::ModelType>(readValue<int32_t>(in));
+	cp.parameters.rateCategories = readValue<uint32_t>(in);
+	cp.parameters.alpha = readValue<double>(in);
+	cp.parameters.substitutionParameters = readDoubles(in);
+	cp.parameters.indelParameters = readDoubles(in);
+
+	//only offsets are kept, the values are read into stores later
+	uint64_t pairs = PairwiseStorage::getPairCount(cp.sequenceCount);
+	cp.loadedPath = path;
+	cp.guideOffset = in.tellg();
+	if (readValue<uint64_t>(in) != pairs)
+		throw HmmException("Corrupt checkpoint " + path);
+	in.seekg(pairs * sizeof(double), ios::cur);
+
+	cp.timesOffset = in.tellg();
+	in.seekg(0, ios::end);
+	uint64_t fileSize = in.tellg();
+	if (!in || fileSize < cp.timesOffset)
+		throw HmmException("Corrupt checkpoint " + path);
+
+	//blocks are only counted here, a torn or corrupt block and everything after it is dropped
+	in.seekg(cp.timesOffset);
+	cp.timesEnd = cp.timesOffset;
+	vector<TimeRecord> block;
+	while (cp.timesEnd + sizeof(uint64_t) <= fileSize)
+	{
+		uint64_t count = readValue<uint64_t>(in);
+		uint64_t blockEnd = cp.timesEnd + 2 * sizeof(uint64_t) + count * sizeof(TimeRecord);
+		if (!in || count > pairs || blockEnd > fileSize)
+			break;
+		block.resize(count);
+		in.read(reinterpret_cast<char*>(block.data()), count * sizeof(TimeRecord));
+		if (!in || readValue<uint64_t>(in) != hashBytes(block.data(), count * sizeof(TimeRecord)))
+			break;
+		cp.completedCount += count;
+		cp.timesEnd = blockEnd;
+	}
+	if (cp.timesEnd != fileSize)
+		INFO("Ignoring " << fileSize - cp.timesEnd << " bytes of an unfinished checkpoint block in " << path);
+
+	return cp;
+}
+
+void Checkpoint::checkStore(PairwiseStorage& values)
+{
+	if (loadedPath.empty())
+		throw HmmException("The checkpoint was not loaded from a file");
+	if (values.getSequenceCount() != sequenceCount)
+		throw HmmException("The checkpoint holds " + to_string(sequenceCount) + " sequences, expected " +
+				to_string(values.getSequenceCount()));
+}
+
+void Checkpoint::readGuideDistances(PairwiseStorage& guide)
+{
+	checkStore(guide);
+
+	ifstream in(loadedPath, ios::binary);
+	in.seekg(guideOffset + sizeof(uint64_t));
+
+	vector<double> block(checkpointBlockValues);
+	for (unsigned long i = 0; i < guide.getPairCount() && in; )
+	{
+		unsigned long count = min<unsigned long>(guide.getPairCount() - i, block.size());
+		in.read(reinterpret_cast<char*>(block.data()), count * sizeof(double));
+		for (unsigned long b = 0; b < count; b++)
+			guide.set(i++, block[b]);
+	}
+
+	if (!in)
+		throw HmmException("Could not read the checkpoint " + loadedPath);
+}
+
+void Checkpoint::readDivergenceTimes(PairwiseStorage& times)
+{
+	checkStore(times);
+
+	ifstream in(loadedPath, ios::binary);
+	in.seekg(timesOffset);
+
+	//the blocks were verified by load()
+	vector<TimeRecord> block;
+	for (uint64_t offset = timesOffset; offset < timesEnd && in; )
+	{
+		uint64_t count = readValue<uint64_t>(in);
+		block.resize(count);
+		in.read(reinterpret_cast<char*>(block.data()), count * sizeof(TimeRecord));
+		readValue<uint64_t>(in);
+		for (const TimeRecord& record : block)
+			if (record.idx < times.getPairCount())
+				times.set(record.idx, record.time);
+		offset += 2 * sizeof(uint64_t) + count * sizeof(TimeRecord);
+	}
+
+	if (!in)
+		throw HmmException("Could not read the checkpoint " + loadedPath);
+}
+
+void Checkpoint::verify(Sequences* inputSeqs)
+{
+	if (inputSeqs->getSequenceCount() != sequenceCount || getFingerprint(inputSeqs) != fingerprint)
+		throw HmmException("The checkpoint was written for different input sequences");
+}
+
+unsigned long Checkpoint::getCompletedCount()
+{
+	return completedCount;
+}
+
+} /* namespace EBC */
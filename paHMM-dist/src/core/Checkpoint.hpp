@@ -0,0 +1,104 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+#ifndef CORE_CHECKPOINT_HPP_
+#define CORE_CHECKPOINT_HPP_
+
+#include "core/ModelParameterFile.hpp"
+#include "core/Sequences.hpp"
+#include "core/PairwiseStorage.hpp"
+#include "core/HmmException.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+namespace EBC
+{
+
+//State of a distance estimation run: model parameters, guide distances and the divergence
+//times finished so far, so that a run can be resumed without repeating any of it.
+//The first save writes the whole state, later saves only append the pairs finished since
+//the previous one as a block of (pair index, time) records.
+class Checkpoint
+{
+public:
+
+	ModelParameterFile parameters;
+
+	//identifies the input the checkpoint belongs to
+	uint64_t fingerprint;
+	unsigned int sequenceCount;
+
+	Checkpoint(const ModelParameterFile& params, Sequences* inputSeqs);
+
+	//A finished pair, appended by the next save
+	void addTime(unsigned long idx, double time);
+
+	//The first save writes a temporary file that is synced and renamed over path, so a crash
+	//never leaves a broken checkpoint behind; pairs not yet optimized are NaN in times.
+	//Later saves append the added times and sync, a torn last block is ignored on load.
+	void save(const string& path, const PairwiseStorage& guide, const PairwiseStorage& times);
+
+	//Reads the parameters, the distances stay on disk until read into a store
+	static Checkpoint load(const string& path);
+
+	//stores of a loaded checkpoint, created for the verified input sequences
+	void readGuideDistances(PairwiseStorage& guide);
+	void readDivergenceTimes(PairwiseStorage& times);
+
+	//throws if the checkpoint was written for different input
+	void verify(Sequences* inputSeqs);
+
+	unsigned long getCompletedCount();
+
+	static uint64_t getFingerprint(Sequences* inputSeqs);
+
+private:
+
+	struct TimeRecord
+	{
+		uint64_t idx;
+		double time;
+	};
+
+	//times added since the last save
+	vector<TimeRecord> pendingTimes;
+
+	//false until the full state was written, later saves append
+	bool written;
+
+	//set by load(), where the distances start in the file and where the valid blocks end
+	string loadedPath;
+	uint64_t guideOffset;
+	uint64_t timesOffset;
+	uint64_t timesEnd;
+	unsigned long completedCount;
+
+	void checkStore(PairwiseStorage& values);
+
+	static void appendTimes(ostream& out, const vector<TimeRecord>& records);
+};
+
+} /* namespace EBC */
+
+#endif /* CORE_CHECKPOINT_HPP_ */
@@ -50,6 +50,19 @@ CommandReader::CommandReader(int argc, char** argv)
 		parser.add_option("initAlpha", "Specify initial discrete Gamma shape parameter alpha , default is 0.5",1 );
 
 		parser.add_option("estimateAlpha", "Specify to estimate discrete Gamma shape parameter alpha 0|1, default is 1",1 );
+		parser.add_option("threads", "Worker threads of the model estimation, default is 0 for all hardware threads",1);
+
+		parser.add_option("stream", "Append each pairwise distance to the given file as soon as it is estimated (i, j, distance, lnL)",1);
+		parser.add_option("shard", "Estimate only shard i/N of the pairwise distances (i from 0 to N-1) into the input file name + .paHMM-Tree.shard-i-of-N",1);
+		parser.add_option("merge", "Assemble the distance matrix from the given number of shard files",1);
+		parser.add_option("model_out", "Save the model parameters to the given file",1);
+		parser.add_option("model_in", "Load the model parameters from the given file instead of estimating them",1);
+		parser.add_option("checkpoint", "Periodically save the progress to the given file",1);
+		parser.add_option("checkpoint_pairs", "Pairs between two checkpoints, 0 for no limit (default)",1);
+		parser.add_option("checkpoint_seconds", "Seconds between two checkpoints, 0 for no limit, default is 600",1);
+		parser.add_option("resume", "Resume from the given checkpoint, only missing pairs are estimated",1);
+		parser.add_option("storage", "Keep the pairwise distances in memory (default), or in a memory-mapped file with mapped32|mapped64 precision",1);
+		parser.add_option("storage_dir", "Directory of the memory-mapped distance files, default is $TMPDIR or /tmp",1);
 
 		parser.add_option("lE", "log error");
 		parser.add_option("lW", "log warning");
@@ -63,6 +76,10 @@ CommandReader::CommandReader(int argc, char** argv)
 		//parser.check_one_time_options(one_time_opts);
 
 		parser.check_incompatible_options("GTR", "HKY");
+		parser.check_incompatible_options("shard", "merge");
+		parser.check_incompatible_options("shard", "stream");
+		parser.check_incompatible_options("merge", "stream");
+		parser.check_incompatible_options("resume", "model_in");
 		//parser.check_incompatible_options("d", "F");
 
 		const char* rev_sub_opts[] = {"gtr_params"};
@@ -105,6 +122,19 @@ CommandReader::CommandReader(int argc, char** argv)
 
 		parser.check_option_arg_range("estimateAlpha", 0, 1);
 		parser.check_option_arg_range("rateCat", 0, 1000);
+		parser.check_option_arg_range("threads", 0, 4096);
+		parser.check_option_arg_range("merge", 1, 1000000);
+		parser.check_option_arg_range("checkpoint_seconds", 0.0, 1e9);
+
+		const char* checkpoint_sub_opts[] = {"checkpoint_pairs", "checkpoint_seconds"};
+		parser.check_sub_options("checkpoint", checkpoint_sub_opts);
+
+		const char* storage_sub_opts[] = {"storage_dir"};
+		parser.check_sub_options("storage", storage_sub_opts);
+
+		unsigned int shard, shardCount;
+		getShard(shard, shardCount);
+		getPairStorage();
 
 
 	}
@@ -166,6 +196,39 @@ vector<double> CommandReader::getIndelParams()
 	return vec;
 }
 
+bool CommandReader::getShard(unsigned int& shard, unsigned int& shardCount)
+{
+	if (!parser.option("shard"))
+		return false;
+
+	string arg = parser.option("shard").argument();
+	char slash;
+	istringstream fields(arg);
+	if (!(fields >> shard >> slash >> shardCount) || slash != '/' || !fields.eof() || shardCount == 0 || shard >= shardCount)
+		throw HmmException("Invalid shard " + arg + ", expected i/N with 0 <= i < N\n");
+	return true;
+}
+
+Definitions::PairStorageType CommandReader::getPairStorage()
+{
+	if (!parser.option("storage"))
+		return Definitions::PairStorageType::MemoryStorage;
+
+	string arg = parser.option("storage").argument();
+	if (arg == "memory")
+		return Definitions::PairStorageType::MemoryStorage;
+	if (arg == "mapped32")
+		return Definitions::PairStorageType::MappedFloatStorage;
+	if (arg == "mapped64")
+		return Definitions::PairStorageType::MappedDoubleStorage;
+	throw HmmException("Invalid storage " + arg + ", expected memory, mapped32 or mapped64\n");
+}
+
+string CommandReader::getShardFileName(unsigned int shard, unsigned int shardCount)
+{
+	return getInputFileName() + Definitions::shardExt + "-" + to_string(shard) + "-of-" + to_string(shardCount);
+}
+
 IParser* CommandReader::getParser() /*throw (HmmException&)*/
 {
 	if (parser.option("in"))
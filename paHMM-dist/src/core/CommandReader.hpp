@@ -75,6 +75,78 @@ public:
 		return parser.option("in").argument();
 	}
 
+	//empty if pairwise distances are not streamed
+	string getStreamFileName()
+	{
+		if (parser.option("stream"))
+			return parser.option("stream").argument();
+		return "";
+	}
+
+	//false if the run is not sharded
+	bool getShard(unsigned int& shard, unsigned int& shardCount);
+
+	string getShardFileName(unsigned int shard, unsigned int shardCount);
+
+	bool mergeShards()
+	{
+		return parser.option("merge");
+	}
+
+	unsigned int getMergeShardCount()
+	{
+		return get_option(parser,"merge",1);
+	}
+
+	string getModelInFileName()
+	{
+		if (parser.option("model_in"))
+			return parser.option("model_in").argument();
+		return "";
+	}
+
+	string getModelOutFileName()
+	{
+		if (parser.option("model_out"))
+			return parser.option("model_out").argument();
+		return "";
+	}
+
+	//checkpoints go to the resumed checkpoint unless another file is given
+	string getCheckpointFileName()
+	{
+		if (parser.option("checkpoint"))
+			return parser.option("checkpoint").argument();
+		return getResumeFileName();
+	}
+
+	unsigned long getCheckpointPairs()
+	{
+		return get_option(parser,"checkpoint_pairs",Definitions::checkpointPairInterval);
+	}
+
+	double getCheckpointSeconds()
+	{
+		return get_option(parser,"checkpoint_seconds",Definitions::checkpointTimeInterval);
+	}
+
+	string getResumeFileName()
+	{
+		if (parser.option("resume"))
+			return parser.option("resume").argument();
+		return "";
+	}
+
+	Definitions::PairStorageType getPairStorage();
+
+	//empty for the temporary directory
+	string getStorageDirectory()
+	{
+		if (parser.option("storage_dir"))
+			return parser.option("storage_dir").argument();
+		return "";
+	}
+
 	Definitions::OptimizationType getOptimizationType()
 	{
 			return (Definitions::OptimizationType::BFGS);
@@ -112,6 +184,11 @@ public:
 		int res = get_option(parser,"estimateAlpha",1);
 		return res == 1;
 	}
+
+	unsigned int getEstimationThreads()
+	{
+		return get_option(parser,"threads",0);
+	}
 	Definitions::SequenceType getSequenceType()
 	{
 		if (parser.option("GTR") || parser.option("HKY"))
@@ -69,6 +69,9 @@ public:
 
 	constexpr static const int maxSampledTriplets = 5;
 
+	//guide distance pairs kept for triplet sampling, larger inputs keep a uniform sample
+	constexpr static const unsigned int samplingPairsMax = 1u << 18;
+
 	//for band calculations
 	constexpr static const double bandPosteriorLikelihoodLimit = -3;
 	constexpr static const double bandPosteriorLikelihoodDelta = -9;
@@ -130,8 +133,60 @@ public:
 	//This makes the min band width of 15 characters
 	constexpr static const unsigned int minBandDelta = 7;
 
+	//anchor banding - rows around the k-mer chain, rows added per square root of the
+	//symbols between two chained k-mers, as indels drift the path off their diagonals,
+	//and the chain coverage below which the posterior band is calculated instead
+	constexpr static const unsigned int anchorBandMargin = 16;
+	constexpr static const double anchorBandGapFactor = 2.0;
+	constexpr static const double anchorMinCoverage = 0.3;
+	//anchor chaining - score lost per diagonal a chain shifts between two k-mers, so
+	//chance matches off the alignment are left out, and earlier k-mers tried per k-mer
+	constexpr static const double anchorChainShiftCost = 0.5;
+	constexpr static const unsigned int anchorChainLookback = 64;
+
+	//anchored forward - shortest exact match used as an anchor, symbols left free at
+	//both ends of an anchor, and DP size below which sub-problems are not run in parallel
+	constexpr static const unsigned int anchoredForwardMinRun = 48;
+	constexpr static const unsigned int anchoredForwardTrim = 8;
+	constexpr static const unsigned long anchoredForwardMinParallelCells = 65536;
+	//by default every n-th anchored pair is compared against the full forward likelihood
+	constexpr static const unsigned int anchoredGapSampleInterval = 10;
+
+	//triangle-inequality Brent bounds - pivots used, relative and absolute widening
+	constexpr static const unsigned int triangleBoundPivots = 8;
+	constexpr static const double triangleBoundMargin = 0.1;
+	constexpr static const double triangleBoundSlack = 0.01;
+
+	//streamed distances - matrix values held in memory while assembling a PHYLIP file
+	constexpr static const unsigned long distanceBlockValues = 1ul << 22;
+
+	//checkpoints - optimized pairs and seconds between two checkpoints, 0 disables either;
+	//time only by default, pair costs vary too much for a useful pair count
+	constexpr static const unsigned long checkpointPairInterval = 0;
+	constexpr static const double checkpointTimeInterval = 600.0;
+
 	constexpr static const double minMatrixLikelihood = -1000000.0;
 
+	//shared P(t) emission table cache - grid spacing in interpolated mode and size cap
+	constexpr static const double ptCacheResolution = 1e-4;
+	constexpr static const unsigned int ptCacheMaxEntries = 4096;
+
+	//eigen systems kept per substitution model for recently used parameters
+	constexpr static const unsigned int eigenCacheEntries = 8;
+
+	//analytic gradients - eigenvalue gap treated as degenerate in dP(t)/dQ, relative step
+	//of the numerical discrete gamma derivative and of the finite difference gradient check
+	constexpr static const double eigenvalueTolerance = 1e-12;
+	constexpr static const double gammaDerivativeStep = 1e-5;
+	constexpr static const double gradientCheckStep = 1e-6;
+
+	//state transition Newton solver - iteration cap, step halvings per iteration, the
+	//parameter change below which it stops and the gradient accepted when it stalls
+	constexpr static const unsigned int newtonMaxIterations = 100;
+	constexpr static const unsigned int newtonMaxHalvings = 40;
+	constexpr static const double newtonTolerance = 1e-10;
+	constexpr static const double newtonGradientTolerance = 1e-6;
+
 
 	constexpr static const unsigned int HKY85ParamCount = 1;
 	constexpr static const unsigned int GTRParamCount = 5;
@@ -144,6 +199,7 @@ public:
 	constexpr static auto distMatExt = ".paHMM-Tree.distmat";
 	constexpr static auto treeExt = ".paHMM-Tree.tree";
 	constexpr static auto logExt = ".paHMM-Tree.log";
+	constexpr static auto shardExt = ".paHMM-Tree.shard";
 
 
 	struct aaModelDefinition
@@ -159,10 +215,16 @@ public:
 
 	enum OptimizationType {BFGS, BOBYQA};
 
-	enum AlgorithmType {Forward, Viterbi, MLE};
+	enum AlgorithmType {Forward, Viterbi, MLE, AnchoredForward};
 
 	enum DpMatrixType {Full, Limited};
 
+	enum PtCacheMode {NoCache, ExactCache, InterpolatedCache};
+
+	enum BandingType {PosteriorBanding, AnchorBanding};
+
+	enum PairStorageType {MemoryStorage, MappedFloatStorage, MappedDoubleStorage};
+
 	enum StateId {Match, Insert , Delete};
 
 	static aaModelDefinition aaLgModel;
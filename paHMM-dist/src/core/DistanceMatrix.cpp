@@ -19,22 +19,28 @@
 
 #include "core/DistanceMatrix.hpp"
 #include "core/Definitions.hpp"
-#include <random>
+#include <algorithm>
 
 namespace EBC
 {
 
 
-EBC::DistanceMatrix::DistanceMatrix(int size) :taxas(size)
+EBC::DistanceMatrix::DistanceMatrix(PairwiseStorage* storage) : sampledSorted(true), offeredPairs(0),
+		distances(storage), taxas(storage->getSequenceCount())
 {
 
 }
 
+DistanceMatrix::~DistanceMatrix()
+{
+	delete distances;
+}
+
 double EBC::DistanceMatrix::getDistance(unsigned int i, unsigned int j)
 {
 	double dst = 0;
 
-	dst = this->distances[make_pair(i,j)];
+	dst = this->distances->getDistance(i,j);
 
 	//DEBUG("Distance matrix getting distance");
 
@@ -43,23 +49,59 @@ double EBC::DistanceMatrix::getDistance(unsigned int i, unsigned int j)
 
 void DistanceMatrix::buildMap()
 {
+	if (!sampledSorted)
+	{
+		stable_sort(sampledPairs.begin(), sampledPairs.end(),
+				[](const SampledPair& a, const SampledPair& b) { return a.distance < b.distance; });
+		sampledSorted = true;
+	}
+}
+
+vector<DistanceMatrix::SampledPair>::iterator DistanceMatrix::lowerBound(double lo)
+{
+	buildMap();
+	return lower_bound(sampledPairs.begin(), sampledPairs.end(), lo,
+			[](const SampledPair& a, double d) { return a.distance < d; });
+}
+
+vector<DistanceMatrix::SampledPair>::iterator DistanceMatrix::upperBound(double hi)
+{
+	buildMap();
+	return upper_bound(sampledPairs.begin(), sampledPairs.end(), hi,
+			[](double d, const SampledPair& a) { return d < a.distance; });
 }
 
 void DistanceMatrix::addDistance(unsigned int s1, unsigned int s2,
-		double distance)
+		double distance, bool sampled)
 {
-	distances[make_pair(s1,s2)] = distance;
-	distances[make_pair(s2,s1)] = distance;
+	distances->setDistance(s1,s2,distance);
+
+	if (!sampled)
+		return;
 
-	revdistances.insert(make_pair(distance,(make_pair(s1,s2))));
+	//reservoir sampling - every offered pair ends up in the sample with equal probability
+	offeredPairs++;
+	if (sampledPairs.size() < Definitions::samplingPairsMax)
+	{
+		sampledPairs.push_back({distance, s1, s2});
+	}
+	else
+	{
+		unsigned long slot = uniform_int_distribution<unsigned long>(0, offeredPairs-1)(sampleGenerator);
+		if (slot >= sampledPairs.size())
+			return;
+		sampledPairs[slot] = {distance, s1, s2};
+	}
+	sampledSorted = false;
 }
 
 void  DistanceMatrix::invalidate(std::pair<unsigned int, unsigned int>& pr)
 {
-	for(auto el = revdistances.begin(); el != revdistances.end(); el++)
+	buildMap();
+	for(auto el = sampledPairs.begin(); el != sampledPairs.end(); el++)
 	{
-		if ((el->second.first == pr.first || el->second.first == pr.second) && (el->second.second == pr.first || el->second.second == pr.second)){
-					revdistances.erase(el);
+		if ((el->s1 == pr.first || el->s1 == pr.second) && (el->s2 == pr.first || el->s2 == pr.second)){
+					sampledPairs.erase(el);
 					return;
 		}
 	}
@@ -69,21 +111,12 @@ vector<pair<unsigned int, unsigned int> > EBC::DistanceMatrix::getPairsWithinDis
 		double lo, double hi)
 {
 	vector<pair<unsigned int, unsigned int> > retvec;
-	auto itlow = revdistances.lower_bound(lo);
-	auto ithi = revdistances.upper_bound(hi);
-	auto end = revdistances.end();
-	auto begin = revdistances.begin();
+	auto itlow = lowerBound(lo);
+	auto ithi = upperBound(hi);
 
-	if (itlow != end && ithi != begin){
-		//we're in the bracket
-		//unsigned int dist = std::distance(itlow,ithi);
-		//uniform_int_distribution<int> dist2(0,dist);
-		//std::advance(itlow, dist2(generator));
-		while(itlow != ithi){
-			retvec.push_back(make_pair((*itlow).second.first,(*itlow).second.second));
-			itlow++;
-		}
-		//invalidate(ret);
+	while(itlow < ithi){
+		retvec.push_back(make_pair(itlow->s1, itlow->s2));
+		itlow++;
 	}
 	return retvec;
 }
@@ -91,33 +124,24 @@ vector<pair<unsigned int, unsigned int> > EBC::DistanceMatrix::getPairsWithinDis
 pair<unsigned int, unsigned int> EBC::DistanceMatrix::getPairWithinDistance(
 		double lo, double hi)
 {
-	//default_random_engine generator;
-	//uniform_int_distribution<int> distribution(0,revdistances.size()-1);
-	//iterate over keys
-	auto itlow = revdistances.lower_bound(lo);
-	auto ithi = revdistances.upper_bound(hi);
-	auto end = revdistances.end();
-	auto begin = revdistances.begin();
+	auto itlow = lowerBound(lo);
+	auto ithi = upperBound(hi);
+	auto end = sampledPairs.end();
+	auto begin = sampledPairs.begin();
 	pair<unsigned int, unsigned int> ret;
 
 	if (itlow != end && ithi != begin){
 		//we're in the bracket
-		//unsigned int dist = std::distance(itlow,ithi);
-		//uniform_int_distribution<int> dist2(0,dist);
-		//std::advance(itlow, dist2(generator));
-		ret = make_pair((*itlow).second.first,(*itlow).second.second);
-		invalidate(ret);
+		ret = make_pair(itlow->s1, itlow->s2);
 	}
 	//return the lowest anyway ?
 	else if(ithi == begin){
-		//std::advance(begin, distribution(generator) );
-		ret = make_pair((*begin).second.first,(*begin).second.second);
-		invalidate(ret);
+		ret = make_pair(begin->s1, begin->s2);
 	}
 	else {
-		ret = make_pair((*(--end)).second.first,(*(--end)).second.second);
-		invalidate(ret);
+		ret = make_pair((end-1)->s1, (end-1)->s2);
 	}
+	invalidate(ret);
 	return ret;
 }
 
@@ -128,7 +152,7 @@ unsigned int DistanceMatrix::getThirdLeafWithinDistance(double targetLen, unsign
 	map<double, unsigned int> mappings;
 	for (leaves =0; leaves < this->taxas; leaves++)
 	{
-		if(leaves == l1 || leaves ==l2)
+		if(leaves == l1 || leaves ==l2 || isExcluded(leaves))
 			continue;
 		tempSum = getDistance(l1,leaves) + getDistance(l2,leaves);
 		mappings[tempSum] = leaves;
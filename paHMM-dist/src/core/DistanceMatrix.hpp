@@ -20,7 +20,10 @@
 #ifndef DISTANCEMATRIX_HPP_
 #define DISTANCEMATRIX_HPP_
 
+#include "core/PairwiseStorage.hpp"
 #include <map>
+#include <random>
+#include <set>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -34,25 +37,69 @@ class DistanceMatrix
 {
 private:
 
-	//map the length to the pair of sequences
-	multimap <double, pair<unsigned int, unsigned int> > revdistances;
+	struct SampledPair
+	{
+		double distance;
+		unsigned int s1;
+		unsigned int s2;
+	};
+
+	//pairs available to triplet sampling, a uniform sample of at most samplingPairsMax
+	//kept in insertion order and sorted by distance before the first range query
+	vector<SampledPair> sampledPairs;
+	bool sampledSorted;
+
+	//pairs offered to the sample so far and the generator choosing replacements
+	unsigned long offeredPairs;
+	mt19937_64 sampleGenerator;
 
-	//pairwise distances ordered, double the size of dictionary!
-	map<pair<unsigned int, unsigned int>,double> distances;
+	//pairwise distances, owned
+	PairwiseStorage* distances;
 
 	unsigned int taxas;
 
+	//leaves left out of triplet sampling (e.g. duplicate sequences)
+	set<unsigned int> excludedLeaves;
+
 	void buildMap();
 
+	//first sampled pair with distance >= lo / > hi
+	vector<SampledPair>::iterator lowerBound(double lo);
+	vector<SampledPair>::iterator upperBound(double hi);
+
 public:
-	DistanceMatrix(int size);
+	//takes ownership of the storage, which determines the size
+	DistanceMatrix(PairwiseStorage* storage);
+
+	~DistanceMatrix();
 
 	unsigned int getSize()
 	{
 		return taxas;
 	}
 
-	void addDistance(unsigned int s1, unsigned int s2, double distance);
+	void resize(unsigned int size)
+	{
+		distances->resize(size);
+		taxas = size;
+	}
+
+	PairwiseStorage& getStorage()
+	{
+		return *distances;
+	}
+
+	void addDistance(unsigned int s1, unsigned int s2, double distance, bool sampled = true);
+
+	void excludeLeaf(unsigned int leaf)
+	{
+		excludedLeaves.insert(leaf);
+	}
+
+	bool isExcluded(unsigned int leaf)
+	{
+		return excludedLeaves.find(leaf) != excludedLeaves.end();
+	}
 
 	double getDistance(unsigned int s1, unsigned int s2);
 
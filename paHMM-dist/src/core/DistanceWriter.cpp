@@ -0,0 +1,241 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+
+#include "core/DistanceWriter.hpp"
+#include "core/Definitions.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <unistd.h>
+
+namespace EBC
+{
+
+//header of the condensed matrix file
+static const char condensedMagic[8] = {'P','A','H','M','M','D','M','1'};
+static const streamoff condensedHeaderSize = sizeof(condensedMagic) + sizeof(uint64_t);
+
+//offset of the pair (i,j), i < j, in the row-major upper triangle; 64 bit for large inputs
+static streamoff condensedOffset(uint64_t i, uint64_t j, uint64_t count)
+{
+	return condensedHeaderSize + static_cast<streamoff>(((2*count-3)*i - i*i)/2 + j - 1) * sizeof(double);
+}
+
+static void writeFully(int fd, const char* data, size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t written = ::write(fd, data, size);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			throw HmmException(string("Could not write a distance record: ") + strerror(errno));
+		}
+		data += written;
+		size -= written;
+	}
+}
+
+DistanceWriter::DistanceWriter(int fd, RecordFormat format)
+{
+	if (format == RecordFormat::Binary)
+	{
+		sink = [fd](const DistanceRecord& record)
+		{
+			writeFully(fd, reinterpret_cast<const char*>(&record), sizeof(DistanceRecord));
+		};
+	}
+	else
+	{
+		sink = [fd](const DistanceRecord& record)
+		{
+			char line[128];
+			int len = snprintf(line, sizeof(line), "%u\t%u\t%.17g\t%.17g\n", record.seq1, record.seq2,
+					record.distance, record.lnl);
+			writeFully(fd, line, len);
+		};
+	}
+}
+
+DistanceWriter::DistanceWriter(function<void(const DistanceRecord&)> callback) : sink(callback)
+{
+}
+
+void DistanceWriter::write(const DistanceRecord& record)
+{
+	lock_guard<mutex> lock(writeMutex);
+	sink(record);
+}
+
+bool DistanceWriter::readRecord(istream& input, RecordFormat format, DistanceRecord& record)
+{
+	if (format == RecordFormat::Binary)
+	{
+		input.read(reinterpret_cast<char*>(&record), sizeof(DistanceRecord));
+		return input.gcount() == sizeof(DistanceRecord);
+	}
+
+	string line;
+	while (getline(input, line))
+	{
+		//a line without the newline may still be in the middle of being written
+		if (input.eof())
+			return false;
+		if (line.empty())
+			continue;
+
+		istringstream fields(line);
+		string distance, lnl;
+		if (!(fields >> record.seq1 >> record.seq2 >> distance >> lnl))
+			throw HmmException("Malformed distance record: " + line);
+		record.distance = strtod(distance.c_str(), nullptr);
+		record.lnl = strtod(lnl.c_str(), nullptr);
+		return true;
+	}
+	return false;
+}
+
+unsigned long DistanceWriter::writeCondensed(const vector<string>& recordPaths, RecordFormat format, unsigned int count,
+		const string& condensedPath)
+{
+	uint64_t pairs = count < 2 ? 0 : static_cast<uint64_t>(count) * (count-1) / 2;
+	unsigned long found = 0;
+	fstream out(condensedPath, ios::in | ios::out | ios::binary | ios::trunc);
+	if (!out)
+		throw HmmException("Could not create " + condensedPath);
+
+	out.write(condensedMagic, sizeof(condensedMagic));
+	out.write(reinterpret_cast<const char*>(&pairs), sizeof(pairs));
+
+	double missing = NAN;
+	for (uint64_t p = 0; p < pairs; p++)
+		out.write(reinterpret_cast<const char*>(&missing), sizeof(double));
+
+	for (auto& path : recordPaths)
+	{
+		ifstream records(path, ios::binary);
+		if (!records)
+			throw HmmException("Could not open " + path);
+
+		DistanceRecord record;
+		while (readRecord(records, format, record))
+		{
+			unsigned int i = min(record.seq1, record.seq2);
+			unsigned int j = max(record.seq1, record.seq2);
+			if (i == j || j >= count)
+				throw HmmException("Distance record for pair " + to_string(record.seq1) + "," + to_string(record.seq2) +
+						" in " + path + " does not fit " + to_string(count) + " sequences");
+
+			//the same pair may come from several files, count it once
+			double previous;
+			out.seekg(condensedOffset(i, j, count));
+			out.read(reinterpret_cast<char*>(&previous), sizeof(double));
+			if (std::isnan(previous))
+				found++;
+
+			out.seekp(condensedOffset(i, j, count));
+			out.write(reinterpret_cast<const char*>(&record.distance), sizeof(double));
+		}
+	}
+
+	if (!out)
+		throw HmmException("Could not write " + condensedPath);
+	return found;
+}
+
+unsigned int DistanceWriter::getBlockRows(unsigned int count)
+{
+	unsigned long rows = Definitions::distanceBlockValues / max(count, 1u);
+	return rows == 0 ? 1 : static_cast<unsigned int>(min<unsigned long>(rows, count));
+}
+
+void DistanceWriter::writePhylip(const string& condensedPath, const vector<string>& names, ostream& output)
+{
+	unsigned int count = names.size();
+	uint64_t pairs;
+	char magic[sizeof(condensedMagic)];
+	ifstream in(condensedPath, ios::binary);
+
+	in.read(magic, sizeof(magic));
+	in.read(reinterpret_cast<char*>(&pairs), sizeof(pairs));
+	if (!in || memcmp(magic, condensedMagic, sizeof(magic)) != 0)
+		throw HmmException(condensedPath + " is not a condensed distance matrix");
+	if (pairs != (count < 2 ? 0 : static_cast<uint64_t>(count) * (count-1) / 2))
+		throw HmmException(condensedPath + " does not match " + to_string(count) + " sequences");
+
+	unsigned int blockRows = getBlockRows(count);
+	vector<double> block;
+
+	output << count << endl;
+	for (unsigned int first = 0; first < count; first += blockRows)
+	{
+		unsigned int last = min(first + blockRows, count);
+
+		//lower-triangular rows first..last-1 hold d(j,i) for j < i, a contiguous
+		//slice of every upper-triangular row j
+		block.assign(static_cast<size_t>(last - first) * last, NAN);
+		for (unsigned int j = 0; j + 1 < last; j++)
+		{
+			unsigned int from = max(j+1, first);
+			in.seekg(condensedOffset(j, from, count));
+			for (unsigned int i = from; i < last; i++)
+				in.read(reinterpret_cast<char*>(&block[static_cast<size_t>(i - first) * last + j]), sizeof(double));
+		}
+		if (!in)
+			throw HmmException("Could not read " + condensedPath);
+
+		for (unsigned int i = first; i < last; i++)
+		{
+			output << names[i] << "        ";
+			for (unsigned int j = 0; j < i; j++)
+				output << " " << block[static_cast<size_t>(i - first) * last + j];
+			output << endl;
+		}
+	}
+}
+
+unsigned long DistanceWriter::finalise(const vector<string>& recordPaths, RecordFormat format, const vector<string>& names,
+		const string& outputPath, MatrixFormat matrixFormat)
+{
+	if (matrixFormat == MatrixFormat::Condensed)
+		return writeCondensed(recordPaths, format, names.size(), outputPath);
+
+	string condensedPath = outputPath + ".condensed.tmp";
+	unsigned long found = writeCondensed(recordPaths, format, names.size(), condensedPath);
+
+	ofstream output(outputPath);
+	if (!output)
+	{
+		remove(condensedPath.c_str());
+		throw HmmException("Could not create " + outputPath);
+	}
+	writePhylip(condensedPath, names, output);
+	remove(condensedPath.c_str());
+	return found;
+}
+
+} /* namespace EBC */
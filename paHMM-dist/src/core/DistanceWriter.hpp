@@ -0,0 +1,99 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+#ifndef CORE_DISTANCEWRITER_HPP_
+#define CORE_DISTANCEWRITER_HPP_
+
+#include "core/HmmException.hpp"
+
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+using namespace std;
+
+namespace EBC
+{
+
+//A finished pair; lnl is NaN for pairs copied from another pair (duplicates)
+struct DistanceRecord
+{
+	uint32_t seq1;
+	uint32_t seq2;
+	double distance;
+	double lnl;
+};
+
+//Streams pairwise results as they complete, so partial output survives a crash
+//and can be read while the run is going. Records go to a file descriptor, one per
+//write, or to a callback.
+class DistanceWriter
+{
+public:
+
+	//Text is one "i<TAB>j<TAB>distance<TAB>lnL" line per record, Binary the raw DistanceRecord
+	enum RecordFormat {Text, Binary};
+
+	//Phylip is the lower-triangular matrix written by pHMMt, Condensed a binary upper triangle
+	enum MatrixFormat {Phylip, Condensed};
+
+protected:
+
+	function<void(const DistanceRecord&)> sink;
+
+	mutex writeMutex;
+
+	//rows of the lower-triangular matrix assembled at once
+	static unsigned int getBlockRows(unsigned int count);
+
+public:
+
+	//the descriptor is not closed by the writer
+	DistanceWriter(int fd, RecordFormat format = RecordFormat::Text);
+
+	DistanceWriter(function<void(const DistanceRecord&)> callback);
+
+	void write(const DistanceRecord& record);
+
+	//false at the end of the stream; a truncated last record counts as the end
+	static bool readRecord(istream& input, RecordFormat format, DistanceRecord& record);
+
+	//Finaliser: place the records of one or more record files (e.g. shards) into a condensed
+	//matrix file, pairs missing from all of them are NaN. Only one value is held in memory
+	//at a time. Returns the number of distinct pairs found.
+	static unsigned long writeCondensed(const vector<string>& recordPaths, RecordFormat format, unsigned int count,
+			const string& condensedPath);
+
+	//Lower-triangular PHYLIP matrix from a condensed matrix file, assembled in blocks of rows
+	static void writePhylip(const string& condensedPath, const vector<string>& names, ostream& output);
+
+	//Both steps; a PHYLIP output goes through a temporary condensed file next to it.
+	//Returns the number of distinct pairs found.
+	static unsigned long finalise(const vector<string>& recordPaths, RecordFormat format, const vector<string>& names,
+			const string& outputPath, MatrixFormat matrixFormat);
+};
+
+} /* namespace EBC */
+
+#endif /* CORE_DISTANCEWRITER_HPP_ */
@@ -27,6 +27,8 @@
 #ifndef IOPTIMIZABLE_H_
 #define IOPTIMIZABLE_H_
 
+#include <vector>
+
 namespace EBC
 {
 
@@ -35,6 +37,18 @@ class IOptimizable
 public:
 
 	virtual double runIteration() = 0;
+
+	//targets with analytic gradients fill one derivative per optimized parameter, in
+	//OptimizedModelParameters::toDlibVector order, and return the same value as runIteration
+	virtual bool hasGradient()
+	{
+		return false;
+	}
+
+	virtual double calculateGradient(std::vector<double>& /*gradient*/)
+	{
+		return runIteration();
+	}
 };
 
 } /* namespace EBC */
@@ -68,7 +68,12 @@ double Maths::logSum(double a, double b)
 double* Maths::matrixMultiply(double *matA, double *matB, int size)
 {
 	double* matResult = new double[size*size];
+	matrixMultiply(matA, matB, size, matResult);
+	return matResult;
+}
 
+void Maths::matrixMultiply(double *matA, double *matB, int size, double* matResult)
+{
 	for (int i=0; i<size; i++)
 	{
 		for (int j=0; j<size; j++)
@@ -80,16 +85,20 @@ double* Maths::matrixMultiply(double *matA, double *matB, int size)
 			}
 		}
 	}
-	return matResult;
 }
 
 double* Maths::matrixByDiagonalMultiply(double *matA, double *matDiag, int size)
 {
 	double* res = new double[size*size];
+	matrixByDiagonalMultiply(matA, matDiag, size, res);
+	return res;
+}
+
+void Maths::matrixByDiagonalMultiply(double *matA, double *matDiag, int size, double* res)
+{
 	for (int i=0; i<size; i++)
 		for (int j=0; j<size; j++)
 			res[i*size+j]  = matA[i*size+j] *  matDiag[j];
-	return res;
 }
 
 void Maths::matrixByDiagonalMultiplyMutable(double *matA, double *matDiag, int size)
@@ -121,10 +130,14 @@ void Maths::matrixScale(double* matrix, double factor, int size)
 double* Maths::expLambdaT(double* lambda, double t, int size)
 {
 	double *res = new double[size];
+	expLambdaT(lambda, t, size, res);
+	return res;
+}
+
+void Maths::expLambdaT(double* lambda, double t, int size, double* res)
+{
 	for(int i=0; i<size; i++)
 		res[i] = exp(lambda[i]*t);
-
-	return res;
 }
 
 double Maths::getRandom(double lo=0.0, double hi=1.0)
@@ -77,9 +77,15 @@ public:
 	//returns new matrix
 	double* matrixMultiply(double *matA, double *matB, int size);
 
+	//writes into result, which must not alias matA or matB
+	void matrixMultiply(double *matA, double *matB, int size, double* result);
+
 	//modifies an existing one
 	double* matrixByDiagonalMultiply(double *matA, double *matDiag, int size);
 
+	//writes into result
+	void matrixByDiagonalMultiply(double *matA, double *matDiag, int size, double* result);
+
 	void matrixByDiagonalMultiplyMutable(double *matA, double *matDiag, int size);
 
 	//modifies existing one
@@ -92,6 +98,9 @@ public:
 
 	double* expLambdaT(double* lambda, double t, int size);
 
+	//writes into result
+	void expLambdaT(double* lambda, double t, int size, double* result);
+
 	double logSum(double, double, double);
 
 	double logSum(double, double);
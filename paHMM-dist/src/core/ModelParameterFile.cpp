@@ -0,0 +1,167 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+#include "core/ModelParameterFile.hpp"
+#include "core/Checkpoint.hpp"
+#include "core/Sequences.hpp"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <cmath>
+#include <cstdio>
+
+namespace EBC
+{
+
+static const Definitions::ModelType knownModels[] = {Definitions::ModelType::GTR, Definitions::ModelType::HKY85,
+		Definitions::ModelType::LG, Definitions::ModelType::WAG, Definitions::ModelType::JTT};
+
+ModelParameterFile::ModelParameterFile(Definitions::ModelType m, const vector<double>& substParams,
+		const vector<double>& indelParams, double a, unsigned int categories) :
+				model(m), substitutionParameters(substParams), indelParameters(indelParams), alpha(a), rateCategories(categories),
+				fingerprint(0)
+{
+}
+
+string ModelParameterFile::getModelName(Definitions::ModelType model)
+{
+	switch(model)
+	{
+		case Definitions::ModelType::GTR:
+			return "GTR";
+		case Definitions::ModelType::HKY85:
+			return "HKY85";
+		case Definitions::ModelType::LG:
+			return "LG";
+		case Definitions::ModelType::WAG:
+			return "WAG";
+		case Definitions::ModelType::JTT:
+			return "JTT";
+	}
+	throw HmmException("Unknown model type");
+}
+
+void ModelParameterFile::setInput(Sequences* inputSeqs)
+{
+	double* observed = inputSeqs->getElementFrequencies();
+	frequencies.assign(observed, observed + inputSeqs->getDictionary()->getAlphabetSize());
+	fingerprint = Checkpoint::getFingerprint(inputSeqs);
+}
+
+void ModelParameterFile::write(const string& path)
+{
+	string tmpPath = path + ".tmp";
+	{
+		ofstream out(tmpPath, ios::trunc);
+		if (!out)
+			throw HmmException("Could not create " + tmpPath);
+
+		out << setprecision(numeric_limits<double>::max_digits10);
+		out << "model " << getModelName(model) << endl;
+		out << "categories " << rateCategories << endl;
+		out << "alpha " << alpha << endl;
+		out << "substitution";
+		for (double p : substitutionParameters)
+			out << " " << p;
+		out << endl << "indel";
+		for (double p : indelParameters)
+			out << " " << p;
+		out << endl;
+		if (!frequencies.empty())
+		{
+			out << "frequencies";
+			for (double f : frequencies)
+				out << " " << f;
+			out << endl;
+		}
+		if (fingerprint != 0)
+			out << "fingerprint " << hex << fingerprint << dec << endl;
+
+		if (!out)
+			throw HmmException("Could not write " + tmpPath);
+	}
+
+	if (rename(tmpPath.c_str(), path.c_str()) != 0)
+		throw HmmException("Could not replace " + path);
+}
+
+ModelParameterFile ModelParameterFile::read(const string& path)
+{
+	ifstream in(path);
+	if (!in)
+		throw HmmException("Can't open the model parameter file : " + path);
+
+	ModelParameterFile params(Definitions::ModelType::GTR, {}, {}, NAN, 0);
+	bool hasModel = false;
+	string line, key;
+
+	while (getline(in, line))
+	{
+		istringstream fields(line);
+		if (!(fields >> key))
+			continue;
+
+		if (key == "model")
+		{
+			string name;
+			fields >> name;
+			for (auto m : knownModels)
+				if (getModelName(m) == name)
+				{
+					params.model = m;
+					hasModel = true;
+				}
+			if (!hasModel)
+				throw HmmException("Unknown model " + name + " in " + path);
+		}
+		else if (key == "categories")
+			fields >> params.rateCategories;
+		else if (key == "alpha")
+			fields >> params.alpha;
+		else if (key == "fingerprint")
+			fields >> hex >> params.fingerprint;
+		else if (key == "substitution" || key == "indel" || key == "frequencies")
+		{
+			vector<double>& values = key == "indel" ? params.indelParameters :
+					key == "frequencies" ? params.frequencies : params.substitutionParameters;
+			double value;
+			while (fields >> value)
+				values.push_back(value);
+		}
+		else
+			throw HmmException("Unknown entry " + key + " in " + path);
+	}
+
+	unsigned int substCount = Definitions::AAParamCount;
+	if (params.model == Definitions::ModelType::GTR)
+		substCount = Definitions::GTRParamCount;
+	else if (params.model == Definitions::ModelType::HKY85)
+		substCount = Definitions::HKY85ParamCount;
+
+	if (!hasModel || std::isnan(params.alpha) || params.rateCategories == 0 ||
+			params.substitutionParameters.size() != substCount ||
+			params.indelParameters.size() != Definitions::NBIndelParamCount)
+		throw HmmException("Incomplete model parameter file " + path);
+
+	return params;
+}
+
+} /* namespace EBC */
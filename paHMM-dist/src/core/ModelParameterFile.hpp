@@ -0,0 +1,70 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+#ifndef CORE_MODELPARAMETERFILE_HPP_
+#define CORE_MODELPARAMETERFILE_HPP_
+
+#include "core/Definitions.hpp"
+#include "core/HmmException.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+namespace EBC
+{
+
+class Sequences;
+
+//Estimated model parameters saved as text, so that separate runs on the same input
+//(e.g. shards of the pair space) can share a single estimation.
+//Frequencies and fingerprint describe the input the parameters were estimated from,
+//they are optional and 0/empty when unknown.
+class ModelParameterFile
+{
+public:
+
+	Definitions::ModelType model;
+	vector<double> substitutionParameters;
+	vector<double> indelParameters;
+	double alpha;
+	unsigned int rateCategories;
+	vector<double> frequencies;
+	uint64_t fingerprint;
+
+	ModelParameterFile(Definitions::ModelType model, const vector<double>& substParams,
+			const vector<double>& indelParams, double alpha, unsigned int rateCategories);
+
+	//record the observed frequencies and the fingerprint of the estimation input
+	void setInput(Sequences* inputSeqs);
+
+	//replaces path atomically, concurrent readers see either the old or the new file
+	void write(const string& path);
+
+	static ModelParameterFile read(const string& path);
+
+	static string getModelName(Definitions::ModelType model);
+};
+
+} /* namespace EBC */
+
+#endif /* CORE_MODELPARAMETERFILE_HPP_ */
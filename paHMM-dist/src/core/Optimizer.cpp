@@ -58,6 +58,11 @@ double Optimizer::objectiveFunction(const column_vector& bfgsParameters)
 const column_vector Optimizer::objectiveFunctionDerivative(const column_vector& bfgsParameters)
 {
 	column_vector results(this->paramsCount);
+	vector<double> gradient(this->paramsCount);
+	omp->fromDlibVector(bfgsParameters);
+	target->calculateGradient(gradient);
+	for (unsigned int i = 0; i < paramsCount; i++)
+		results(i) = gradient[i];
 	return results;
 }
 
@@ -68,6 +73,11 @@ double Optimizer::optimize()
 
 	using std::placeholders::_1;
 	std::function<double(const column_vector&)> f_objective= std::bind( &Optimizer::objectiveFunction, this, _1 );
+	std::function<const column_vector(const column_vector&)> f_derivative;
+	if (target->hasGradient())
+		f_derivative = std::bind( &Optimizer::objectiveFunctionDerivative, this, _1 );
+	else
+		f_derivative = derivative(f_objective);
 	double likelihood;
 
 	switch(optimizationType)
@@ -77,7 +87,7 @@ double Optimizer::optimize()
 			likelihood = dlib::find_min_box_constrained(dlib::bfgs_search_strategy(),
 					dlib::objective_delta_stop_strategy(accuracy),  //changed the delta drastically
 					f_objective,
-					derivative(f_objective),
+					f_derivative,
 					initParams,
 					lowerBounds,
 					upperBounds);
@@ -28,10 +28,12 @@ PMatrix::PMatrix(SubstitutionModelBase* m) : model(m),  matrixSize(m->getMatrixS
 		rateCategories(model->getRateCategories()), ptMatrices(rateCategories, nullptr)
 {
 	this->matrixFullSize = matrixSize*matrixSize;
+	this->ptWorkspace = new double[model->getPtWorkspaceSize()];
 }
 
 PMatrix::~PMatrix()
 {
+	delete [] ptWorkspace;
 	for (int i = 0; i < ptMatrices.size(); i++)
 	{
 		delete [] ptMatrices[i];
@@ -46,6 +46,9 @@ protected:
 
 	vector<double*> ptMatrices;
 
+	//scratch space for the model's P(t) calculation
+	double* ptWorkspace;
+
 	unsigned int matrixFullSize;
 
 public:
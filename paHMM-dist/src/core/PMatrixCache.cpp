@@ -0,0 +1,135 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+
+#include "core/PMatrixCache.hpp"
+#include <cmath>
+
+namespace EBC
+{
+
+PMatrixCache::PMatrixCache(Definitions::PtCacheMode md, double res, unsigned int maxEnt) :
+		mode(md), resolution(res), maxEntries(maxEnt), currentRevision(0), hits(0), misses(0), memoryUsage(0)
+{
+	if (mode == Definitions::PtCacheMode::InterpolatedCache && resolution <= 0)
+		throw HmmException("P(t) cache : the interpolation resolution must be positive");
+	DEBUG("P(t) cache created, mode " << mode << " resolution " << resolution);
+}
+
+PMatrixCache::~PMatrixCache()
+{
+	DEBUG("P(t) cache : " << hits << " hits, " << misses << " misses, " << memoryUsage << " bytes");
+}
+
+shared_ptr<const PtCacheEntry> PMatrixCache::find(unsigned long revision, double time)
+{
+	lock_guard<mutex> lock(cacheMutex);
+
+	if (revision == currentRevision)
+	{
+		auto it = entries.find(time);
+		if (it != entries.end())
+		{
+			hits++;
+			usage.splice(usage.begin(), usage, it->second.usage);
+			return it->second.entry;
+		}
+	}
+	misses++;
+	return nullptr;
+}
+
+void PMatrixCache::store(unsigned long revision, double time, shared_ptr<const PtCacheEntry> entry)
+{
+	lock_guard<mutex> lock(cacheMutex);
+
+	if (revision < currentRevision)
+		return;
+
+	if (revision > currentRevision)
+	{
+		entries.clear();
+		usage.clear();
+		memoryUsage = 0;
+		currentRevision = revision;
+	}
+
+	if (entries.find(time) != entries.end())
+		return;
+
+	if (entries.size() >= maxEntries && !usage.empty())
+	{
+		auto evicted = entries.find(usage.back());
+		memoryUsage -= evicted->second.entry->byteSize();
+		entries.erase(evicted);
+		usage.pop_back();
+	}
+
+	usage.push_front(time);
+	entries.emplace(time, CachedTable{entry, usage.begin()});
+	memoryUsage += entry->byteSize();
+}
+
+void PMatrixCache::clear()
+{
+	lock_guard<mutex> lock(cacheMutex);
+	entries.clear();
+	usage.clear();
+	memoryUsage = 0;
+}
+
+void PMatrixCache::getGridPoints(double time, double& lo, double& hi)
+{
+	double idx = std::floor(time / resolution);
+	lo = idx * resolution;
+	hi = (idx + 1) * resolution;
+}
+
+unsigned long PMatrixCache::getHits() const
+{
+	lock_guard<mutex> lock(cacheMutex);
+	return hits;
+}
+
+unsigned long PMatrixCache::getMisses() const
+{
+	lock_guard<mutex> lock(cacheMutex);
+	return misses;
+}
+
+double PMatrixCache::getHitRate() const
+{
+	lock_guard<mutex> lock(cacheMutex);
+	return (hits + misses) == 0 ? 0 : hits / static_cast<double>(hits + misses);
+}
+
+size_t PMatrixCache::getMemoryUsage() const
+{
+	lock_guard<mutex> lock(cacheMutex);
+	return memoryUsage;
+}
+
+size_t PMatrixCache::getEntryCount() const
+{
+	lock_guard<mutex> lock(cacheMutex);
+	return entries.size();
+}
+
+} /* namespace EBC */
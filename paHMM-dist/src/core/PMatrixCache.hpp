@@ -0,0 +1,126 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+
+#ifndef PMATRIXCACHE_HPP_
+#define PMATRIXCACHE_HPP_
+
+#include "core/Definitions.hpp"
+#include "core/HmmException.hpp"
+#include <vector>
+#include <map>
+#include <list>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+namespace EBC
+{
+
+//Emission tables of PMatrixDouble for one model revision and divergence time
+struct PtCacheEntry
+{
+	vector<double> pairPt;
+	vector<double> logPairPt;
+	//(matrixSize+1)^2, row-major, last row/column for gaps
+	vector<double> sitePatterns;
+
+	size_t byteSize() const
+	{
+		return sizeof(PtCacheEntry) + (pairPt.size() + logPairPt.size() + sitePatterns.size()) * sizeof(double);
+	}
+};
+
+//Thread-safe cache of P(t) emission tables shared by all pair HMMs of one substitution model.
+//Only the most recent model revision is kept, older entries are dropped as soon as a newer
+//revision is stored. Within a revision the least recently used table makes room for a new
+//one once maxEntries are stored.
+class PMatrixCache
+{
+protected:
+
+	struct CachedTable
+	{
+		shared_ptr<const PtCacheEntry> entry;
+		//position in usage, moved to the front on every hit
+		list<double>::iterator usage;
+	};
+
+	Definitions::PtCacheMode mode;
+
+	//grid spacing used in the interpolated mode
+	double resolution;
+
+	unsigned int maxEntries;
+
+	unsigned long currentRevision;
+
+	map<double, CachedTable> entries;
+
+	//divergence times of the entries, most recently used first
+	list<double> usage;
+
+	mutable mutex cacheMutex;
+
+	unsigned long hits;
+	unsigned long misses;
+	size_t memoryUsage;
+
+public:
+	PMatrixCache(Definitions::PtCacheMode mode = Definitions::PtCacheMode::ExactCache,
+			double resolution = Definitions::ptCacheResolution,
+			unsigned int maxEntries = Definitions::ptCacheMaxEntries);
+
+	virtual ~PMatrixCache();
+
+	//returns nullptr on a miss
+	shared_ptr<const PtCacheEntry> find(unsigned long revision, double time);
+
+	void store(unsigned long revision, double time, shared_ptr<const PtCacheEntry> entry);
+
+	void clear();
+
+	//grid points bracketing time in the interpolated mode
+	void getGridPoints(double time, double& lo, double& hi);
+
+	Definitions::PtCacheMode getMode() const
+	{
+		return mode;
+	}
+
+	double getResolution() const
+	{
+		return resolution;
+	}
+
+	unsigned long getHits() const;
+
+	unsigned long getMisses() const;
+
+	double getHitRate() const;
+
+	size_t getMemoryUsage() const;
+
+	size_t getEntryCount() const;
+};
+
+} /* namespace EBC */
+#endif /* PMATRIXCACHE_HPP_ */
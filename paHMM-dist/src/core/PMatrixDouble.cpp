@@ -73,27 +73,92 @@ void PMatrixDouble::calculatePairSitePatterns()
 
 void PMatrixDouble::calculate()
 {
-	if (time != 0)
+	if (time == 0)
+		throw HmmException("PMatrixDouble : attempting to calculate p(t) with t set to 0");
+
+	//without a cache the tables are calculated in place, stored cache entries are allocated
+	PMatrixCache* cache = model->getPtCache();
+	if (cache == nullptr || cache->getMode() == Definitions::PtCacheMode::NoCache)
 	{
-		std::fill(fastPairGammaPt, fastPairGammaPt+matrixFullSize, 0);
+		calculateTables(time);
+		return;
+	}
 
-		for(unsigned int i = 0; i< rateCategories; i++)
+	unsigned long revision = model->getRevision();
+	if (cache->getMode() == Definitions::PtCacheMode::ExactCache)
+	{
+		auto entry = cache->find(revision, time);
+		if (entry)
+			loadEntry(*entry);
+		else
 		{
-			if (ptMatrices[i] != NULL)
-				delete [] ptMatrices[i];
-			ptMatrices[i] = this->model->calculatePt(time, i);
-			for (int j=0; j< matrixFullSize; j++)
-			{
-				fastPairGammaPt[j] += ptMatrices[i][j] * model->gammaFrequencies[i];
-				fastLogPairGammaPt[j] = log(fastPairGammaPt[j]);
-			}
-
+			calculateTables(time);
+			cache->store(revision, time, makeEntry());
 		}
+		return;
+	}
 
-		calculatePairSitePatterns();
+	double lo, hi;
+	cache->getGridPoints(time, lo, hi);
+	if (lo <= 0)
+	{
+		//no P(0) grid point, the first interval is always calculated exactly
+		calculateTables(time);
+		return;
 	}
-	else
-		throw HmmException("PMatrixDouble : attempting to calculate p(t) with t set to 0");
+
+	auto loEntry = getGridEntry(cache, revision, lo);
+	auto hiEntry = getGridEntry(cache, revision, hi);
+	double w = (time - lo) / (hi - lo);
+
+	//only P(t) is blended, its log and the site patterns follow from it like in calculateTables
+	for (unsigned int j=0; j< matrixFullSize; j++)
+	{
+		fastPairGammaPt[j] = (1.0-w) * loEntry->pairPt[j] + w * hiEntry->pairPt[j];
+		fastLogPairGammaPt[j] = log(fastPairGammaPt[j]);
+	}
+	calculatePairSitePatterns();
+}
+
+void PMatrixDouble::calculateTables(double t)
+{
+	this->model->calculateGammaPt(t, fastPairGammaPt, ptWorkspace);
+
+	for (unsigned int j=0; j< matrixFullSize; j++)
+		fastLogPairGammaPt[j] = log(fastPairGammaPt[j]);
+
+	calculatePairSitePatterns();
+}
+
+shared_ptr<const PtCacheEntry> PMatrixDouble::makeEntry()
+{
+	auto entry = make_shared<PtCacheEntry>();
+	entry->pairPt.assign(fastPairGammaPt, fastPairGammaPt+matrixFullSize);
+	entry->logPairPt.assign(fastLogPairGammaPt, fastLogPairGammaPt+matrixFullSize);
+	entry->sitePatterns.reserve((matrixSize+1)*(matrixSize+1));
+	for (unsigned int i =0; i<= matrixSize; i++ )
+		entry->sitePatterns.insert(entry->sitePatterns.end(), sitePatterns[i], sitePatterns[i]+matrixSize+1);
+	return entry;
+}
+
+void PMatrixDouble::loadEntry(const PtCacheEntry& entry)
+{
+	std::copy(entry.pairPt.begin(), entry.pairPt.end(), fastPairGammaPt);
+	std::copy(entry.logPairPt.begin(), entry.logPairPt.end(), fastLogPairGammaPt);
+	for (unsigned int i =0; i<= matrixSize; i++ )
+		std::copy(entry.sitePatterns.begin() + i*(matrixSize+1), entry.sitePatterns.begin() + (i+1)*(matrixSize+1), sitePatterns[i]);
+}
+
+shared_ptr<const PtCacheEntry> PMatrixDouble::getGridEntry(PMatrixCache* cache, unsigned long revision, double t)
+{
+	auto entry = cache->find(revision, t);
+	if (!entry)
+	{
+		calculateTables(t);
+		entry = makeEntry();
+		cache->store(revision, t, entry);
+	}
+	return entry;
 }
 
 
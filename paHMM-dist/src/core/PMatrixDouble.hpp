@@ -24,6 +24,7 @@
 #include "models/SubstitutionModelBase.hpp"
 #include "core/HmmException.hpp"
 #include "core/PMatrix.hpp"
+#include "core/PMatrixCache.hpp"
 #include "core/SequenceElement.hpp"
 #include <vector>
 #include <array>
@@ -45,6 +46,15 @@ protected:
 
 	void calculatePairSitePatterns();
 
+	//P(t), its log and the site patterns for time t, without the cache
+	void calculateTables(double t);
+
+	shared_ptr<const PtCacheEntry> makeEntry();
+
+	void loadEntry(const PtCacheEntry& entry);
+
+	shared_ptr<const PtCacheEntry> getGridEntry(PMatrixCache* cache, unsigned long revision, double t);
+
 public:
 	PMatrixDouble(SubstitutionModelBase* m);
 	virtual ~PMatrixDouble();
@@ -23,7 +23,7 @@
 namespace EBC
 {
 
-PMatrixTriple::PMatrixTriple(SubstitutionModelBase* m) : PMatrix(m)
+PMatrixTriple::PMatrixTriple(SubstitutionModelBase* m) : PMatrix(m), calculatedRevision(0), calculatedTime(0)
 {
 
 }
@@ -36,13 +36,17 @@ void PMatrixTriple::calculate()
 {
 	if (time != 0)
 	{
+		if (calculatedRevision == model->getRevision() && calculatedTime == time)
+			return;
 		for(unsigned int i = 0; i< rateCategories; i++)
 		{
-			if (ptMatrices[i] != NULL)
-				delete [] ptMatrices[i];
-			ptMatrices[i] = this->model->calculatePt(time, i);
+			if (ptMatrices[i] == NULL)
+				ptMatrices[i] = new double[matrixFullSize];
+			this->model->calculatePt(time, i, ptMatrices[i], ptWorkspace);
 
 		}
+		calculatedRevision = model->getRevision();
+		calculatedTime = time;
 	}
 	else
 		throw HmmException("PMatrixTriple : attempting to calculate p(t) with t set to 0");
@@ -64,6 +68,19 @@ double PMatrixTriple::getTripleSitePattern(unsigned int root,
 	return prob;
 }
 
+void PMatrixTriple::getPatternColumns(vector<double>& columns)
+{
+	unsigned int width = rateCategories * matrixSize;
+	columns.resize((matrixSize + 1) * width);
+
+	for (unsigned int child = 0; child < matrixSize; child++)
+		for (unsigned int rt = 0; rt < rateCategories; rt++)
+			for (unsigned int root = 0; root < matrixSize; root++)
+				columns[child*width + rt*matrixSize + root] = ptMatrices[rt][root*matrixSize + child];
+
+	std::fill(columns.begin() + matrixSize*width, columns.end(), 1.0);
+}
+
 double PMatrixTriple::getTransitionProb(unsigned int xi, unsigned int yi, unsigned int rateCat)
 {
 	if (yi >= matrixSize)
@@ -35,6 +35,11 @@ namespace EBC
 //TODO - split into 2 regular pt and pairwise
 class PMatrixTriple : public PMatrix
 {
+protected:
+
+	//model revision and time of the matrices held, revisions start at 1
+	unsigned long calculatedRevision;
+	double calculatedTime;
 
 public:
 	PMatrixTriple(SubstitutionModelBase* m);
@@ -47,6 +52,11 @@ public:
 
 	double getTripleSitePattern(unsigned int root,const array<unsigned char, 3>& nodes, PMatrixTriple* pm2, PMatrixTriple* pm3);
 
+	//P(t) laid out for batched site pattern likelihoods: one row per child state with
+	//rateCategories * matrixSize values ordered by category, then root; a last row of ones
+	//stands for gaps
+	void getPatternColumns(vector<double>& columns);
+
 	void summarize();
 
 };
@@ -0,0 +1,190 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+#include "core/PairwiseStorage.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace EBC
+{
+
+PairwiseStorage::PairwiseStorage(unsigned int count) : sequenceCount(count), pairCount(getPairCount(count))
+{
+}
+
+PairwiseStorage::~PairwiseStorage()
+{
+}
+
+std::pair<unsigned int, unsigned int> PairwiseStorage::getPairOfIndices(unsigned long idx, unsigned int /*count*/)
+{
+	//row j starts at j(j-1)/2, solve for the last row starting at or before idx and
+	//correct the floating point estimate
+	auto rowStart = [](unsigned long row) { return row*(row - 1)/2; };
+	unsigned long j = static_cast<unsigned long>((1 + sqrt(1 + 8.0*idx)) / 2);
+
+	while (j > 1 && rowStart(j) > idx)
+		j--;
+	while (rowStart(j+1) <= idx)
+		j++;
+
+	return std::make_pair(static_cast<unsigned int>(idx - rowStart(j)), static_cast<unsigned int>(j));
+}
+
+void PairwiseStorage::fill(double value)
+{
+	for (unsigned long i = 0; i < pairCount; i++)
+		set(i, value);
+}
+
+void PairwiseStorage::copyFrom(const PairwiseStorage& other)
+{
+	if (other.sequenceCount != sequenceCount)
+		throw HmmException("Pairwise storage of " + to_string(other.sequenceCount) + " sequences, expected " +
+				to_string(sequenceCount));
+
+	for (unsigned long i = 0; i < pairCount; i++)
+		set(i, other.get(i));
+}
+
+PairwiseStorage* PairwiseStorage::create(Definitions::PairStorageType type, unsigned int count, const string& directory)
+{
+	switch (type)
+	{
+	case Definitions::PairStorageType::MappedFloatStorage:
+		return new MappedPairwiseStorage(count, true, directory);
+	case Definitions::PairStorageType::MappedDoubleStorage:
+		return new MappedPairwiseStorage(count, false, directory);
+	default:
+		return new MemoryPairwiseStorage(count);
+	}
+}
+
+MemoryPairwiseStorage::MemoryPairwiseStorage(unsigned int count) : PairwiseStorage(count), values(pairCount, NAN)
+{
+}
+
+void MemoryPairwiseStorage::resize(unsigned int count)
+{
+	sequenceCount = count;
+	pairCount = getPairCount(count);
+	values.resize(pairCount, NAN);
+}
+
+MappedPairwiseStorage::MappedPairwiseStorage(unsigned int count, bool single, const string& dir) : PairwiseStorage(count),
+		directory(dir), singlePrecision(single), fd(-1), mapping(nullptr), mappedBytes(0)
+{
+	if (directory.empty())
+	{
+		const char* tmp = getenv("TMPDIR");
+		directory = tmp && *tmp ? tmp : "/tmp";
+	}
+
+	string path = directory + "/paHMM-pairs-XXXXXX";
+	vector<char> name(path.begin(), path.end());
+	name.push_back('\0');
+
+	fd = mkstemp(name.data());
+	if (fd < 0)
+		throw HmmException("Could not create pairwise storage in " + directory + ": " + strerror(errno));
+	unlink(name.data());
+
+	//the file starts sparse and all zero, which reads as NaN
+	try
+	{
+		map();
+	}
+	catch (HmmException&)
+	{
+		close(fd);
+		throw;
+	}
+}
+
+MappedPairwiseStorage::~MappedPairwiseStorage()
+{
+	unmap();
+	close(fd);
+}
+
+void MappedPairwiseStorage::map()
+{
+	unsigned long bytes = pairCount * (singlePrecision ? sizeof(float) : sizeof(double));
+	if (bytes == 0)
+		return;
+
+	//growing the file only adds zero pages at its end, the values before stay in place
+	if (ftruncate(fd, bytes) != 0)
+		throw HmmException("Could not allocate " + to_string(bytes) + " bytes of pairwise storage in " +
+				directory + ": " + strerror(errno));
+
+	void* larger = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (larger == MAP_FAILED)
+		throw HmmException("Could not map pairwise storage: " + string(strerror(errno)));
+
+	unmap();
+	mapping = larger;
+	mappedBytes = bytes;
+
+	DEBUG("Mapped " << pairCount << " pairs (" << mappedBytes << " bytes) of pairwise storage in " << directory);
+}
+
+void MappedPairwiseStorage::unmap()
+{
+	if (mapping != nullptr)
+		munmap(mapping, mappedBytes);
+	mapping = nullptr;
+	mappedBytes = 0;
+}
+
+void MappedPairwiseStorage::resize(unsigned int count)
+{
+	//the mapping stays as large as it is, the dropped pairs are reset so that growing
+	//again finds them NaN like the zero pages of the file
+	if (count <= sequenceCount)
+	{
+		unsigned long dropped = pairCount;
+		sequenceCount = count;
+		pairCount = getPairCount(count);
+		for (unsigned long idx = pairCount; idx < dropped; idx++)
+			set(idx, NAN);
+		return;
+	}
+
+	unsigned int previousCount = sequenceCount;
+	sequenceCount = count;
+	pairCount = getPairCount(count);
+	try
+	{
+		map();
+	}
+	catch (HmmException&)
+	{
+		sequenceCount = previousCount;
+		pairCount = getPairCount(previousCount);
+		throw;
+	}
+}
+
+} /* namespace EBC */
@@ -0,0 +1,205 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+#ifndef CORE_PAIRWISESTORAGE_HPP_
+#define CORE_PAIRWISESTORAGE_HPP_
+
+#include "core/Definitions.hpp"
+#include "core/HmmException.hpp"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+namespace EBC
+{
+
+//One value per unordered pair of sequences, in row-major lower-triangular order: the pairs
+//of sequence j with all earlier ones follow those of j-1, so sequences appended later only
+//add pairs at the end. Backends only differ in where the values are kept
+class PairwiseStorage
+{
+protected:
+
+	unsigned int sequenceCount;
+	unsigned long pairCount;
+
+	PairwiseStorage(unsigned int count);
+
+public:
+
+	PairwiseStorage(const PairwiseStorage&) = delete;
+	PairwiseStorage& operator=(const PairwiseStorage&) = delete;
+
+	virtual ~PairwiseStorage();
+
+	virtual double get(unsigned long idx) const = 0;
+
+	virtual void set(unsigned long idx, double value) = 0;
+
+	//Grow to count sequences, the pairs of the current sequences keep their values and
+	//place, new pairs are NaN. Shrinking drops the pairs of the last sequences and does
+	//not fail, so that a growth can be undone
+	virtual void resize(unsigned int count) = 0;
+
+	//either order, 0 on the diagonal
+	inline double getDistance(unsigned int i, unsigned int j) const
+	{
+		if (i == j)
+			return 0;
+		return get(i < j ? getPairIndex(i, j, sequenceCount) : getPairIndex(j, i, sequenceCount));
+	}
+
+	inline void setDistance(unsigned int i, unsigned int j, double value)
+	{
+		set(i < j ? getPairIndex(i, j, sequenceCount) : getPairIndex(j, i, sequenceCount), value);
+	}
+
+	void fill(double value);
+
+	//both stores must hold the same number of sequences
+	void copyFrom(const PairwiseStorage& other);
+
+	unsigned int getSequenceCount() const
+	{
+		return sequenceCount;
+	}
+
+	unsigned long getPairCount() const
+	{
+		return pairCount;
+	}
+
+	static inline unsigned long getPairCount(unsigned int count)
+	{
+		return count < 2 ? 0 : static_cast<unsigned long>(count) * (count - 1) / 2;
+	}
+
+	//Index of the pair (i,j), i < j, the same for any count
+	static inline unsigned long getPairIndex(unsigned int i, unsigned int j, unsigned int /*count*/)
+	{
+		unsigned long row = j;
+		return row*(row - 1)/2 + i;
+	}
+
+	//Inverse of getPairIndex
+	static std::pair<unsigned int, unsigned int> getPairOfIndices(unsigned long idx, unsigned int /*count*/);
+
+	//Every pair starts as NaN; mapped stores create their file in directory, the
+	//temporary directory if it is empty
+	static PairwiseStorage* create(Definitions::PairStorageType type, unsigned int count, const string& directory = "");
+};
+
+class MemoryPairwiseStorage : public PairwiseStorage
+{
+protected:
+
+	vector<double> values;
+
+public:
+
+	MemoryPairwiseStorage(unsigned int count);
+
+	double get(unsigned long idx) const
+	{
+		return values[idx];
+	}
+
+	void set(unsigned long idx, double value)
+	{
+		values[idx] = value;
+	}
+
+	void resize(unsigned int count);
+};
+
+//Values in a shared file mapping, so the page cache instead of the heap holds them and
+//stores larger than RAM spill to disk. The file is unlinked as soon as it is mapped and
+//vanishes with the store, single precision halves its size. Values are kept XOR the bits
+//of NaN, so the zero pages of a fresh sparse file read as NaN without being written.
+class MappedPairwiseStorage : public PairwiseStorage
+{
+protected:
+
+	template<typename T, typename Bits>
+	static inline T decode(Bits bits)
+	{
+		T value = NAN;
+		Bits nan;
+		std::memcpy(&nan, &value, sizeof(nan));
+		bits ^= nan;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	template<typename Bits, typename T>
+	static inline Bits encode(T value)
+	{
+		T missing = NAN;
+		Bits bits, nan;
+		std::memcpy(&bits, &value, sizeof(bits));
+		std::memcpy(&nan, &missing, sizeof(nan));
+		return bits ^ nan;
+	}
+
+	string directory;
+	bool singlePrecision;
+
+	int fd;
+	void* mapping;
+	unsigned long mappedBytes;
+
+	//(re)map the file at the current pair count, the file stays open so that growing it
+	//keeps the values in place; the previous mapping is kept if this fails
+	void map();
+
+	void unmap();
+
+public:
+
+	MappedPairwiseStorage(unsigned int count, bool singlePrecision, const string& directory = "");
+
+	~MappedPairwiseStorage();
+
+	double get(unsigned long idx) const
+	{
+		return singlePrecision ? decode<float>(static_cast<const uint32_t*>(mapping)[idx]) :
+				decode<double>(static_cast<const uint64_t*>(mapping)[idx]);
+	}
+
+	void set(unsigned long idx, double value)
+	{
+		if (singlePrecision)
+			static_cast<uint32_t*>(mapping)[idx] = encode<uint32_t>(static_cast<float>(value));
+		else
+			static_cast<uint64_t*>(mapping)[idx] = encode<uint64_t>(value);
+	}
+
+	void resize(unsigned int count);
+};
+
+} /* namespace EBC */
+
+#endif /* CORE_PAIRWISESTORAGE_HPP_ */
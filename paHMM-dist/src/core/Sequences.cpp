@@ -21,6 +21,7 @@
 
 #include "core/Sequences.hpp"
 #include <algorithm>
+#include <unordered_set>
 
 namespace EBC
 {
@@ -29,7 +30,9 @@ Sequences::Sequences(IParser* iParser,Definitions::SequenceType st, bool rg)
 {
 	//use the file parser to get sequences and build the dictionary
 	removeGaps = rg;
+    ownsInput = false;
     observedFrequencies = nullptr;
+    pairStorage = Definitions::PairStorageType::MemoryStorage;
 
 	unsigned int size = iParser->getSequenceCount();
 	if (size <= 0){
@@ -43,14 +46,6 @@ Sequences::Sequences(IParser* iParser,Definitions::SequenceType st, bool rg)
 
     buildDictionary(st);
 
-	pairs.reserve(this->getPairCount());
-
-	for(unsigned int i=0; i< size;i++)
-		for(unsigned int j=i+1; j<size;j++)
-			pairs.push_back(std::make_pair(i,j));
-
-    pairIterator = pairs.begin();
-
 	this->rawSequences = iParser->getSequences();
     this->sequenceNames = iParser->getNames();
 
@@ -58,10 +53,9 @@ Sequences::Sequences(IParser* iParser,Definitions::SequenceType st, bool rg)
         this->translatedSequences.push_back(getDictionary()->translate(*it,removeGaps));
     }
 
-    vector<string>::iterator iter = sequenceNames->begin();
-    for (unsigned int i = 0; iter != sequenceNames->cend(); ++iter, ++i) {
-        sequenceNamesToIds[*iter] = i;
-    }
+    uniqueCount = 0;
+    buildNameIndex();
+    collapseDuplicates(0);
 }
 
 
@@ -70,6 +64,129 @@ Sequences::~Sequences()
     if (observedFrequencies){
 		delete[] observedFrequencies;
     }
+
+    if (ownsInput) {
+        delete rawSequences;
+        delete sequenceNames;
+    }
+}
+
+unsigned int Sequences::addSequences(IParser* parser)
+{
+    vector<string>* newNames = parser->getNames();
+    vector<string>* newSequences = parser->getSequences();
+    unsigned int firstNew = getSequenceCount();
+
+    //validate everything first so a failed call leaves the object unchanged
+    unordered_set<string_view> batchNames;
+    for (auto it = newNames->begin(); it != newNames->end(); it++) {
+        if (sequenceNamesToIds.find(*it) != sequenceNamesToIds.end()) {
+            throw HmmException("Sequence " + *it + " is already present.");
+        }
+        if (!batchNames.insert(*it).second) {
+            throw HmmException("Sequence " + *it + " is repeated in the added sequences.");
+        }
+    }
+
+    vector<vector<SequenceElement*> > translated;
+    translated.reserve(newSequences->size());
+    for (auto it = newSequences->begin(); it != newSequences->end(); it++) {
+        translated.push_back(getDictionary()->translate(*it,removeGaps));
+    }
+
+    //the original vectors belong to the parser we were created with, stop sharing them
+    if (!ownsInput) {
+        rawSequences = new vector<string>(*rawSequences);
+        sequenceNames = new vector<string>(*sequenceNames);
+        ownsInput = true;
+    }
+
+    rawSequences->insert(rawSequences->end(), newSequences->begin(), newSequences->end());
+    sequenceNames->insert(sequenceNames->end(), newNames->begin(), newNames->end());
+    for (auto it = translated.begin(); it != translated.end(); it++) {
+        translatedSequences.push_back(std::move(*it));
+    }
+
+    sequenceCount = getSequenceCount();
+
+    //observed frequencies are a model input and stay frozen
+    buildNameIndex();
+    collapseDuplicates(firstNew);
+
+    DEBUG("Added " << newNames->size() << " sequences, " << sequenceCount << " sequences in total");
+
+    return firstNew;
+}
+
+size_t Sequences::hashSequence(const vector<SequenceElement*>& seq)
+{
+    //FNV-1a over the matrix indices, so T/U and lower/upper case hash the same
+    size_t hash = 14695981039346656037ULL;
+    for (auto el : seq) {
+        hash ^= el->getMatrixIndex();
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool Sequences::findIdentical(const vector<SequenceElement*>& seq, unsigned int& pos)
+{
+    auto range = sequenceHashes.equal_range(hashSequence(seq));
+
+    for (auto it = range.first; it != range.second; it++) {
+        const vector<SequenceElement*>& other = translatedSequences[it->second];
+        if (other.size() == seq.size() &&
+                std::equal(other.begin(), other.end(), seq.begin(),
+                        [](SequenceElement* a, SequenceElement* b) { return a->getMatrixIndex() == b->getMatrixIndex(); })) {
+            pos = it->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Sequences::collapseDuplicates(unsigned int firstNew)
+{
+    unsigned int count = getSequenceCount();
+    representatives.resize(count);
+
+    for (unsigned int i = firstNew; i < count; i++) {
+        representatives[i] = i;
+        findIdentical(translatedSequences[i], representatives[i]);
+
+        if (representatives[i] == i) {
+            sequenceHashes.insert(std::make_pair(hashSequence(translatedSequences[i]), i));
+            uniqueCount++;
+        } else {
+            DEBUG("Sequence " << (*sequenceNames)[i] << " is identical to " << (*sequenceNames)[representatives[i]]);
+        }
+    }
+
+    if (uniqueCount < count) {
+        INFO(count - uniqueCount << " duplicate sequences collapsed, " << uniqueCount << " unique sequences");
+    }
+}
+
+void Sequences::setPairStorage(Definitions::PairStorageType type, const string& directory)
+{
+    pairStorage = type;
+    pairStorageDirectory = directory;
+}
+
+PairwiseStorage* Sequences::createPairStorage()
+{
+    return PairwiseStorage::create(pairStorage, getSequenceCount(), pairStorageDirectory);
+}
+
+void Sequences::buildNameIndex()
+{
+    //string_views point into sequenceNames, rebuild them whenever the vector changes
+    sequenceNamesToIds.clear();
+
+    vector<string>::iterator iter = sequenceNames->begin();
+    for (unsigned int i = 0; iter != sequenceNames->cend(); ++iter, ++i) {
+        sequenceNamesToIds[*iter] = i;
+    }
 }
 
 void Sequences::calculateObservedFrequencies()
@@ -28,6 +28,7 @@
 #include "core/Dictionary.hpp"
 #include "core/HmmException.hpp"
 #include "core/SequenceElement.hpp"
+#include "core/PairwiseStorage.hpp"
 #include "core/Definitions.hpp"
 #include <array>
 #include <vector>
@@ -51,14 +52,24 @@ private:
     unordered_map<string_view, unsigned int> sequenceNamesToIds;
 
     vector<vector<SequenceElement*> > translatedSequences;
-    vector<std::pair<unsigned int, unsigned int> > pairs;
-    vector<std::pair<unsigned int, unsigned int> >::iterator pairIterator;
+
+    //identical translated sequences are collapsed onto the lowest id of the group
+    vector<unsigned int> representatives;
+    unordered_multimap<size_t, unsigned int> sequenceHashes;
+    unsigned int uniqueCount;
 
     unsigned int sequenceCount;
     double* observedFrequencies;
 
     bool removeGaps;
 
+    //backend of the pairwise values kept for these sequences, see createPairStorage
+    Definitions::PairStorageType pairStorage;
+    string pairStorageDirectory;
+
+    //true once the raw input has been copied away from the parser (see addSequences)
+    bool ownsInput;
+
     Dictionary *dict;
 
 public:
@@ -68,6 +79,10 @@ public:
 
     virtual ~Sequences();
 
+    //Append the sequences of another parser, returns the id of the first new sequence.
+    //Existing ids and pairs are left untouched, new pairs are (old,new) and (new,new).
+    unsigned int addSequences(IParser*);
+
     inline Dictionary *getDictionary()
     {
         return dict;
@@ -90,10 +105,9 @@ public:
             return &translatedSequences[pos];
     }
 
-    inline unsigned int getPairCount()
+    inline unsigned long getPairCount()
     {
-        unsigned int ct = static_cast<unsigned int>(translatedSequences.size());
-        return (ct*(ct-1))/2;
+        return PairwiseStorage::getPairCount(getSequenceCount());
     }
 
     inline unsigned int getSequenceCount()
@@ -129,12 +143,47 @@ public:
         return (*rawSequences)[pos];
     }
 
-    std::pair<unsigned int, unsigned int> getPairOfSequenceIndices(unsigned int idx)
+    inline unsigned int getRepresentative(unsigned int pos)
+    {
+        return representatives[pos];
+    }
+
+    inline bool isRepresentative(unsigned int pos)
+    {
+        return representatives[pos] == pos;
+    }
+
+    //Finds the representative of a sequence identical to seq, false if there is none
+    bool findIdentical(const vector<SequenceElement*>& seq, unsigned int& pos);
+
+    inline unsigned int getUniqueSequenceCount()
+    {
+        return uniqueCount;
+    }
+
+    std::pair<unsigned int, unsigned int> getPairOfSequenceIndices(unsigned long idx)
+    {
+        return PairwiseStorage::getPairOfIndices(idx, getSequenceCount());
+    }
+
+    //Index of the pair (i,j), i < j, in the row-major lower-triangular pair list
+    static inline unsigned long getPairIndex(unsigned int i, unsigned int j, unsigned int count)
     {
-        return pairs[idx];
+        return PairwiseStorage::getPairIndex(i, j, count);
     }
+
+    //Pairwise values for guide and optimized distances are kept in the chosen backend;
+    //takes effect for stores created afterwards
+    void setPairStorage(Definitions::PairStorageType type, const string& directory = "");
+
+    //A store for every pair of the current sequences, all NaN, owned by the caller
+    PairwiseStorage* createPairStorage();
 private:
 
+    void buildNameIndex();
+    void collapseDuplicates(unsigned int firstNew);
+    size_t hashSequence(const vector<SequenceElement*>&);
+
     void calculateObservedFrequencies();
     inline void buildDictionary(Definitions::SequenceType);
 
@@ -0,0 +1,67 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+#include "core/SparseDistanceMatrix.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace EBC
+{
+
+SparseDistanceMatrix::SparseDistanceMatrix(unsigned int size) : neighbours(size), pairCount(0)
+{
+}
+
+void SparseDistanceMatrix::insert(unsigned int s1, unsigned int s2, double distance)
+{
+	vector<Neighbour>& list = neighbours[s1];
+	auto pos = upper_bound(list.begin(), list.end(), distance,
+			[](double d, const Neighbour& n) { return d < n.distance; });
+	list.insert(pos, Neighbour{s2, distance});
+}
+
+void SparseDistanceMatrix::addDistance(unsigned int s1, unsigned int s2, double distance)
+{
+	if (hasDistance(s1, s2))
+		return;
+
+	insert(s1, s2, distance);
+	insert(s2, s1, distance);
+	pairCount++;
+}
+
+bool SparseDistanceMatrix::hasDistance(unsigned int s1, unsigned int s2)
+{
+	return !std::isnan(getDistance(s1, s2));
+}
+
+double SparseDistanceMatrix::getDistance(unsigned int s1, unsigned int s2)
+{
+	//lists are short, scan the shorter one
+	if (neighbours[s2].size() < neighbours[s1].size())
+		swap(s1, s2);
+
+	for (auto& n : neighbours[s1])
+		if (n.id == s2)
+			return n.distance;
+	return NAN;
+}
+
+} /* namespace EBC */
@@ -0,0 +1,80 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+#ifndef SPARSEDISTANCEMATRIX_HPP_
+#define SPARSEDISTANCEMATRIX_HPP_
+
+#include <vector>
+
+using namespace std;
+
+namespace EBC
+{
+
+//Symmetric distance matrix holding only selected pairs, as one neighbour list per
+//sequence ordered from the closest neighbour
+class SparseDistanceMatrix
+{
+public:
+
+	struct Neighbour
+	{
+		unsigned int id;
+		double distance;
+	};
+
+private:
+
+	vector<vector<Neighbour> > neighbours;
+
+	unsigned long pairCount;
+
+	void insert(unsigned int s1, unsigned int s2, double distance);
+
+public:
+	SparseDistanceMatrix(unsigned int size);
+
+	unsigned int getSize()
+	{
+		return neighbours.size();
+	}
+
+	unsigned long getPairCount()
+	{
+		return pairCount;
+	}
+
+	//adding a pair twice keeps the first distance
+	void addDistance(unsigned int s1, unsigned int s2, double distance);
+
+	bool hasDistance(unsigned int s1, unsigned int s2);
+
+	//NaN for pairs that are not stored
+	double getDistance(unsigned int s1, unsigned int s2);
+
+	const vector<Neighbour>& getNeighbours(unsigned int s)
+	{
+		return neighbours[s];
+	}
+};
+
+} /* namespace EBC */
+
+#endif /* SPARSEDISTANCEMATRIX_HPP_ */
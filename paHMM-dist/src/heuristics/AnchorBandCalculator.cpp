@@ -0,0 +1,245 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+
+#include <heuristics/AnchorBandCalculator.hpp>
+#include <unordered_map>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+
+namespace EBC
+{
+
+AnchorBandCalculator::AnchorBandCalculator(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2, unsigned int k,
+		unsigned int m, bool withBand) : seq1(s1), seq2(s2), kmerSize(k), margin(m), coverage(0), band(nullptr)
+{
+	vector<Anchor> anchors;
+
+	if (margin < Definitions::minBandDelta)
+		margin = Definitions::minBandDelta;
+
+	//5 bits per symbol
+	if (kmerSize == 0 || kmerSize > 12)
+		throw HmmException("AnchorBandCalculator : unsupported k-mer size");
+
+	findAnchors(anchors);
+	chainAnchors(anchors);
+	calculateCoverage();
+
+	DEBUG("Anchor banding: " << anchors.size() << " anchors, " << chain.size() << " chained, coverage " << coverage);
+
+	if (withBand && coverage >= Definitions::anchorMinCoverage)
+		buildBand();
+}
+
+AnchorBandCalculator::~AnchorBandCalculator()
+{
+}
+
+bool AnchorBandCalculator::encodeKmer(vector<SequenceElement*>* seq, unsigned int pos, uint64_t& key)
+{
+	key = 0;
+	for (unsigned int i = pos; i < pos + kmerSize; i++)
+	{
+		SequenceElement* el = (*seq)[i];
+		if (el->isIsGap() || el->isFastaClass())
+			return false;
+		key = (key << 5) | el->getMatrixIndex();
+	}
+	return true;
+}
+
+void AnchorBandCalculator::findAnchors(vector<Anchor>& anchors)
+{
+	//position of a unique k-mer, -1 once it repeats
+	unordered_map<uint64_t, int> kmers1;
+	unordered_map<uint64_t, int> kmers2;
+	uint64_t key;
+
+	if (seq1->size() < kmerSize || seq2->size() < kmerSize)
+		return;
+
+	for (unsigned int pos = 0; pos + kmerSize <= seq1->size(); pos++)
+	{
+		if (!encodeKmer(seq1, pos, key))
+			continue;
+		auto res = kmers1.emplace(key, pos);
+		if (!res.second)
+			res.first->second = -1;
+	}
+
+	for (unsigned int pos = 0; pos + kmerSize <= seq2->size(); pos++)
+	{
+		if (!encodeKmer(seq2, pos, key))
+			continue;
+		auto res = kmers2.emplace(key, pos);
+		if (!res.second)
+			res.first->second = -1;
+	}
+
+	for (auto& kmer : kmers2)
+	{
+		if (kmer.second < 0)
+			continue;
+		auto it = kmers1.find(kmer.first);
+		if (it != kmers1.end() && it->second >= 0)
+			anchors.push_back({static_cast<unsigned int>(it->second), static_cast<unsigned int>(kmer.second)});
+	}
+}
+
+void AnchorBandCalculator::chainAnchors(vector<Anchor>& anchors)
+{
+	//positions in the second sequence are unique, so any earlier anchor with a smaller
+	//first sequence position can precede an anchor in a co-linear chain
+	std::sort(anchors.begin(), anchors.end(), [](const Anchor& a, const Anchor& b) { return a.pos2 < b.pos2; });
+
+	//every anchor scores 1 and every diagonal shifted costs; the longest chain alone would
+	//follow chance matches far off the alignment, and the band with it
+	vector<double> score(anchors.size(), 1.0);
+	vector<int> previous(anchors.size(), -1);
+	int best = -1;
+
+	for (unsigned int i = 0; i < anchors.size(); i++)
+	{
+		long diag = static_cast<long>(anchors[i].pos1) - anchors[i].pos2;
+		unsigned int first = i > Definitions::anchorChainLookback ? i - Definitions::anchorChainLookback : 0;
+
+		for (unsigned int j = first; j < i; j++)
+		{
+			if (anchors[j].pos1 >= anchors[i].pos1)
+				continue;
+			double shift = std::labs(diag - (static_cast<long>(anchors[j].pos1) - anchors[j].pos2));
+			double candidate = score[j] + 1.0 - Definitions::anchorChainShiftCost * shift;
+			if (candidate > score[i])
+			{
+				score[i] = candidate;
+				previous[i] = j;
+			}
+		}
+		if (best < 0 || score[i] > score[best])
+			best = i;
+	}
+
+	chain.clear();
+	for (int idx = best; idx >= 0; idx = previous[idx])
+		chain.push_back(anchors[idx]);
+	std::reverse(chain.begin(), chain.end());
+}
+
+vector<AnchorBandCalculator::AnchorRun> AnchorBandCalculator::getAnchorRuns(unsigned int minLength)
+{
+	vector<AnchorRun> runs;
+	AnchorRun run;
+	bool open = false;
+
+	for (auto& anchor : chain)
+	{
+		//the next k-mer on the same diagonal that overlaps or touches the run extends it
+		if (open && anchor.pos1 - anchor.pos2 == run.pos1 - run.pos2 && anchor.pos2 <= run.pos2 + run.length)
+		{
+			run.length = anchor.pos2 + kmerSize - run.pos2;
+			continue;
+		}
+		if (open && run.length >= minLength)
+			runs.push_back(run);
+		run = {anchor.pos1, anchor.pos2, kmerSize};
+		open = true;
+	}
+	if (open && run.length >= minLength)
+		runs.push_back(run);
+
+	return runs;
+}
+
+void AnchorBandCalculator::calculateCoverage()
+{
+	unsigned int covered = 0;
+	unsigned int end = 0;
+	unsigned int shorter = std::min(seq1->size(), seq2->size());
+
+	for (auto& anchor : chain)
+	{
+		unsigned int from = std::max(anchor.pos2, end);
+		end = anchor.pos2 + kmerSize;
+		covered += end - from;
+	}
+
+	coverage = shorter == 0 ? 0 : static_cast<double>(covered) / shorter;
+}
+
+void AnchorBandCalculator::buildBand()
+{
+	int len1 = seq1->size();
+	int len2 = seq2->size();
+	int mg;
+
+	//DP cells the alignment path must pass near - start, anchor starts, end
+	vector<pair<int,int> > points;
+	points.reserve(chain.size() + 2);
+	points.push_back(std::make_pair(0,0));
+	for (auto& anchor : chain)
+		points.push_back(std::make_pair(anchor.pos1+1, anchor.pos2+1));
+	points.push_back(std::make_pair(len1, len2));
+
+	vector<int> lo(len2+1, INT_MAX);
+	vector<int> hi(len2+1, -1);
+
+	//between two points the path lies between the diagonals through each of them
+	for (unsigned int p = 1; p < points.size(); p++)
+	{
+		int rowA = points[p-1].first;
+		int colA = points[p-1].second;
+		int rowB = points[p].first;
+		int colB = points[p].second;
+		mg = margin + static_cast<int>(Definitions::anchorBandGapFactor * sqrt(std::max(rowB - rowA, colB - colA)));
+
+		for (int col = colA; col <= colB; col++)
+		{
+			int diagA = rowA + (col - colA);
+			int diagB = rowB - (colB - col);
+			lo[col] = std::min(lo[col], std::min(diagA, diagB) - mg);
+			hi[col] = std::max(hi[col], std::max(diagA, diagB) + mg);
+		}
+	}
+
+	band = new Band(len2+1);
+
+	hi[0] = std::min(hi[0], len1);
+	this->band->setMatchRangeAt(0,-1,-1);
+	if (hi[0] > 0)
+		this->band->setInsertRangeAt(0,1,hi[0]);
+	else
+		this->band->setInsertRangeAt(0,-1,-1);
+	this->band->setDeleteRangeAt(0,-1,-1);
+
+	for (int col = 1; col <= len2; col++)
+	{
+		int min = std::max(lo[col], 0);
+		int max = std::min(hi[col], len1);
+
+		this->band->setMatchRangeAt(col, std::max(min,1), max);
+		this->band->setInsertRangeAt(col, std::max(min,1), max);
+		this->band->setDeleteRangeAt(col, min, max);
+	}
+}
+
+} /* namespace EBC */
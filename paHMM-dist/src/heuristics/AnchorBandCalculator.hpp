@@ -0,0 +1,116 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+#ifndef HEURISTICS_ANCHORBANDCALCULATOR_HPP_
+#define HEURISTICS_ANCHORBANDCALCULATOR_HPP_
+
+#include "core/Definitions.hpp"
+#include "core/HmmException.hpp"
+#include "core/SequenceElement.hpp"
+#include "core/FileLogger.hpp"
+#include "heuristics/Band.hpp"
+
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+namespace EBC
+{
+
+//Builds the DP band from a co-linear chain of exact k-mer matches (anchors)
+//instead of the Forward/Backward posterior pre-pass used by BandCalculator
+class AnchorBandCalculator
+{
+public:
+
+	//exact match of length symbols starting at pos1 and pos2
+	struct AnchorRun
+	{
+		unsigned int pos1;
+		unsigned int pos2;
+		unsigned int length;
+	};
+
+protected:
+
+	struct Anchor
+	{
+		unsigned int pos1;
+		unsigned int pos2;
+	};
+
+	vector<SequenceElement*>* seq1;
+	vector<SequenceElement*>* seq2;
+
+	unsigned int kmerSize;
+
+	//rows added on each side of the chain
+	unsigned int margin;
+
+	vector<Anchor> chain;
+
+	//fraction of the shorter sequence covered by chained k-mers
+	double coverage;
+
+	Band* band;
+
+	//k-mers occurring exactly once in both sequences
+	void findAnchors(vector<Anchor>& anchors);
+
+	//best scoring chain increasing in both sequences, shifts between diagonals are penalised
+	void chainAnchors(vector<Anchor>& anchors);
+
+	void calculateCoverage();
+
+	void buildBand();
+
+	//false if the k-mer contains a gap or an ambiguity class
+	bool encodeKmer(vector<SequenceElement*>* seq, unsigned int pos, uint64_t& key);
+
+public:
+	AnchorBandCalculator(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2, unsigned int kmerSize,
+			unsigned int margin = Definitions::anchorBandMargin, bool withBand = true);
+
+	virtual ~AnchorBandCalculator();
+
+	//nullptr when the chain coverage is too low to trust, the caller owns the band
+	inline Band* getBand()
+	{
+		return this->band;
+	}
+
+	inline double getCoverage()
+	{
+		return this->coverage;
+	}
+
+	inline unsigned int getAnchorCount()
+	{
+		return chain.size();
+	}
+
+	//chained k-mers merged into maximal exact matches, keeping those of at least minLength
+	vector<AnchorRun> getAnchorRuns(unsigned int minLength);
+};
+
+} /* namespace EBC */
+
+#endif /* HEURISTICS_ANCHORBANDCALCULATOR_HPP_ */
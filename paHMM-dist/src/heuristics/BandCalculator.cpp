@@ -24,7 +24,8 @@
 namespace EBC
 {
 
-BandCalculator::BandCalculator(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2, SubstitutionModelBase* sm, IndelModel* im, double divergenceTime) :
+BandCalculator::BandCalculator(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2, SubstitutionModelBase* sm, IndelModel* im, double divergenceTime,
+		bool keepPosteriors) :
 		fwd(4,nullptr), seq1(s1), seq2(s2), substModel(sm), indelModel(im), time(divergenceTime)
 {
 	DEBUG("Band estimator running...");
@@ -104,10 +105,10 @@ BandCalculator::BandCalculator(vector<SequenceElement*>* s1, vector<SequenceElem
 	DUMP("Backward calculation runs...");
 	bwd->runAlgorithm();
 
-	//combine fwd and bwd metrics into one!
-
-	bwd->calculatePosteriors(fwd[best]);
-	this->processPosteriorProbabilities(bwd, band);
+	//combine fwd and bwd metrics into the band directly, the posterior matrices are never filled
+	bwd->calculatePosteriorBand(fwd[best], band, posteriorLikelihoodLimit + posteriorLikelihoodDelta,
+			keepPosteriors ? &posteriors : nullptr);
+	DEBUG("Posterior band kept " << posteriors.size() << " cells");
 
 	bestTime = time*multipliers[best];
 
@@ -128,87 +129,6 @@ BandCalculator::~BandCalculator()
 
 }
 
-void BandCalculator::processPosteriorProbabilities(BackwardPairHMM* hmm, Band* band)
-{
-	//Match state
-	PairwiseHmmStateBase* M;
-	//Insert state
-	PairwiseHmmStateBase* X;
-	//Delete state
-	PairwiseHmmStateBase* Y;
-
-	M = hmm->getM();
-	X = hmm->getX();
-	Y = hmm->getY();
-
-	//cumulative posterior likelihood
-	double cpl = posteriorLikelihoodLimit + posteriorLikelihoodDelta;
-
-	int xHi, xLo, yHi, yLo, mHi,mLo, rowCount;
-
-	int tmpRow;
-
-	double tmpX, tmpY, tmpM;
-
-	rowCount = M->getRows();
-
-	for(unsigned int col = 0; col < M->getCols(); col++)
-	{
-		xHi=mHi=yHi=xLo=mLo=yLo=-1;
-		tmpRow = 0;
-		while(tmpRow < rowCount && X->getValueAt(tmpRow, col) < cpl )
-			tmpRow++;
-		if (tmpRow != rowCount)
-		{
-			//found a value
-			xLo = tmpRow;
-			tmpRow = rowCount-1;
-			while(tmpRow >= 0 && X->getValueAt(tmpRow, col) < cpl)
-				tmpRow--;
-			if (tmpRow > 0)
-				xHi = tmpRow;
-		}
-
-		tmpRow = 0;
-		while(tmpRow < rowCount && Y->getValueAt(tmpRow, col) < cpl)
-			tmpRow++;
-		if (tmpRow != rowCount)
-		{
-			//found a value
-			yLo = tmpRow;
-			tmpRow = rowCount-1;
-			while(tmpRow >= 0 && Y->getValueAt(tmpRow, col) < cpl)
-				tmpRow--;
-			if (tmpRow > 0)
-				yHi = tmpRow;
-		}
-
-		tmpRow = 0;
-		while(tmpRow < rowCount && M->getValueAt(tmpRow, col) < cpl)
-			tmpRow++;
-		if (tmpRow != rowCount)
-		{
-			//found a value
-			mLo = tmpRow;
-			tmpRow = rowCount-1;
-			while(tmpRow >= 0 && M->getValueAt(tmpRow, col) < cpl)
-				tmpRow--;
-			if (tmpRow > 0)
-				mHi = tmpRow;
-		}
-
-
-
-		band->setInsertRangeAt(col, xLo,xHi);
-		band->setDeleteRangeAt(col, yLo,yHi);
-		band->setMatchRangeAt(col, mLo,mHi);
-
-		DUMP("Match/Ins/Del bands for column " << col << "\t" << band->getMatchRangeAt(col).first <<"\t" << band->getMatchRangeAt(col).second
-				<< "\t" << band->getInsertRangeAt(col).first <<"\t" << band->getInsertRangeAt(col).second
-				<< "\t" << band->getDeleteRangeAt(col).first <<"\t" << band->getDeleteRangeAt(col).second);
-	}
-}
-
 double BandCalculator::getClosestDistance() {
 	return this->bestTime;
 }
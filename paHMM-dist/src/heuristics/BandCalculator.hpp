@@ -74,10 +74,13 @@ protected:
 	double leftBound;
 	double rightBound;
 
-	void processPosteriorProbabilities(BackwardPairHMM* hmm, Band* band);
+	//cells of the posterior band, only collected on request
+	vector<PosteriorCell> posteriors;
 
 public:
-	BandCalculator(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2, SubstitutionModelBase* sm, IndelModel* im, double divergenceTime);
+	//keepPosteriors collects the cells above the band threshold, see getPosteriors
+	BandCalculator(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2, SubstitutionModelBase* sm, IndelModel* im, double divergenceTime,
+			bool keepPosteriors = false);
 	virtual ~BandCalculator();
 
 	inline Band* getBand()
@@ -96,6 +99,11 @@ public:
 	double getRightBound(){
 		return rightBound;
 	}
+
+	//sparse log posteriors of the band, empty unless requested at construction
+	const vector<PosteriorCell>& getPosteriors() const {
+		return posteriors;
+	}
 };
 
 } /* namespace EBC */
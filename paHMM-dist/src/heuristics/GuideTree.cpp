@@ -25,9 +25,14 @@
 namespace EBC
 {
 
-GuideTree::GuideTree(Sequences* is) : inputSequences(is)
+GuideTree::GuideTree(Sequences* is, PairwiseStorage* knownDistances) : inputSequences(is)
 {
-	distMat = new DistanceMatrix(inputSequences->getSequenceCount());
+	if (knownDistances && knownDistances->getSequenceCount() != inputSequences->getSequenceCount())
+	{
+		delete knownDistances;
+		throw HmmException("Guide distances do not match the number of sequences");
+	}
+	distMat = new DistanceMatrix(knownDistances ? knownDistances : inputSequences->createPairStorage());
 	this->dict = inputSequences->getDictionary();
 	if(dict->getAlphabetSize() == Definitions::nucleotideCount)
 		this->kmerSize = 7;
@@ -36,7 +41,7 @@ GuideTree::GuideTree(Sequences* is) : inputSequences(is)
 	this->sequenceCount = inputSequences->getSequenceCount();
 	this->kmers = new vector<unordered_map<string,short>*>(sequenceCount);
 	DEBUG("Creating guide tree");
-	this->constructTree();
+	this->constructTree(knownDistances != nullptr);
 }
 
 GuideTree::~GuideTree()
@@ -45,6 +50,7 @@ GuideTree::~GuideTree()
         delete map;
 
     delete kmers;
+    delete distMat;
 }
 
 double GuideTree::kimuraDist(double /*id*/)
@@ -53,11 +59,11 @@ double GuideTree::kimuraDist(double /*id*/)
 	return 0;
 }
 
-void GuideTree::constructTree()
+void GuideTree::constructTree(bool knownDistances)
 {
 	unsigned int i,j;
 	string currSeq;
-	double identity, estIdentity;
+	double estIdentity;
 
 
 
@@ -68,22 +74,18 @@ void GuideTree::constructTree()
 		currSeq = inputSequences->getRawSequenceAt(i);
 		extractKmers(currSeq, (*kmers)[i]);
 	}
+	//duplicates would only bias the triplet sampling towards their group
+	bool collapse = inputSequences->getUniqueSequenceCount() >= 3;
+	for(i = 0; i< sequenceCount; i++)
+		if (collapse && !inputSequences->isRepresentative(i))
+			distMat->excludeLeaf(i);
+
 	for(i = 0; i< sequenceCount; i++)
 		for(j = i+1; j< sequenceCount; j++)
 		{
-			string s1 = inputSequences->getRawSequenceAt(i);
-			string s2 = inputSequences->getRawSequenceAt(j);
-			identity = 1.0 - commonKmerCount(i,j)/((double)(min(s1.size(),s2.size())));
-
-			if(dict->getAlphabetSize() == Definitions::nucleotideCount)
-				estIdentity = this->nucFunction(identity);
-			else if(dict->getAlphabetSize() == Definitions::aminoacidCount)
-				estIdentity = aaFunction(identity);
-
-			DEBUG("k-mer distance between seq. " << i << " and " << j << " is " << identity << " adjusted distance " << estIdentity );
-
-			distMat->addDistance(i,j,estIdentity);
-			distances.push_back(estIdentity);
+			//distances restored from a checkpoint are already in place
+			estIdentity = knownDistances ? distMat->getDistance(i,j) : kmerDistance(i,j);
+			distMat->addDistance(i,j,estIdentity, !(distMat->isExcluded(i) || distMat->isExcluded(j)));
 		}
 
 	DEBUG("Initialized distance matrix");
@@ -93,6 +95,73 @@ void GuideTree::constructTree()
 
 }
 
+void GuideTree::addSequences(unsigned int firstNew)
+{
+	unsigned int i,j;
+	unsigned int count = inputSequences->getSequenceCount();
+	string currSeq;
+
+	DEBUG("Extending guide tree with sequences " << firstNew << " to " << count-1);
+	kmers->resize(count, nullptr);
+	for(i = firstNew; i< count; i++)
+	{
+		(*kmers)[i] = new unordered_map<string,short>();
+		currSeq = inputSequences->getRawSequenceAt(i);
+		extractKmers(currSeq, (*kmers)[i]);
+	}
+
+	//only the pairs involving a new sequence are computed
+	distMat->resize(count);
+	for(j = firstNew; j< count; j++)
+	{
+		if (!inputSequences->isRepresentative(j))
+			distMat->excludeLeaf(j);
+		for(i = 0; i< j; i++)
+			distMat->addDistance(i,j,kmerDistance(i,j), !(distMat->isExcluded(i) || distMat->isExcluded(j)));
+	}
+
+	this->sequenceCount = count;
+}
+
+double GuideTree::kmerDistance(unsigned int i, unsigned int j)
+{
+	double identity, estIdentity;
+	const string& s1 = inputSequences->getRawSequenceAt(i);
+	const string& s2 = inputSequences->getRawSequenceAt(j);
+	identity = 1.0 - commonKmerCount(i,j)/((double)(min(s1.size(),s2.size())));
+	estIdentity = adjustDistance(identity);
+
+	DEBUG("k-mer distance between seq. " << i << " and " << j << " is " << identity << " adjusted distance " << estIdentity );
+
+	return estIdentity;
+}
+
+double GuideTree::adjustDistance(double identity)
+{
+	if(dict->getAlphabetSize() == Definitions::nucleotideCount)
+		return this->nucFunction(identity);
+	else if(dict->getAlphabetSize() == Definitions::aminoacidCount)
+		return aaFunction(identity);
+	return 0;
+}
+
+vector<double> GuideTree::getQueryDistances(const string& query)
+{
+	unordered_map<string,short> queryKmers;
+	string currSeq = query;
+	vector<double> result(sequenceCount);
+	double identity;
+
+	extractKmers(currSeq, &queryKmers);
+	for(unsigned int i = 0; i< sequenceCount; i++)
+	{
+		const string& ref = inputSequences->getRawSequenceAt(i);
+		identity = 1.0 - commonKmerCount(&queryKmers, (*kmers)[i])/((double)(min(query.size(),ref.size())));
+		result[i] = adjustDistance(identity);
+	}
+	return result;
+}
+
 void GuideTree::extractKmers(string& seq, unordered_map<string, short>* umap)
 {
 	string kmer;
@@ -109,18 +178,20 @@ void GuideTree::extractKmers(string& seq, unordered_map<string, short>* umap)
 
 unsigned int GuideTree::commonKmerCount(unsigned int i, unsigned int j)
 {
-	unordered_map<string, short>* m1 = (*kmers)[i];
-	unordered_map<string, short>* m2 = (*kmers)[j];
+	return commonKmerCount((*kmers)[i], (*kmers)[j]);
+}
+
+unsigned int GuideTree::commonKmerCount(unordered_map<string, short>* m1, unordered_map<string, short>* m2)
+{
 	unsigned int commonCount = 0;
 
 	for(auto it = m1->begin(); it != m1->end(); it++)
 	{
-		commonCount += std::min((short)((*m2)[it->first]), (short)(it->second));
+		auto other = m2->find(it->first);
+		if (other != m2->end())
+			commonCount += std::min(other->second, it->second);
 	}
-	//DEBUG("Common k-mer count between seq. " << i << " and " << j << " is " << commonCount);
 	return commonCount;
-
-
 }
 
 } /* namespace EBC */
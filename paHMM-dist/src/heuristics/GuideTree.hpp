@@ -45,7 +45,6 @@ protected:
 	unsigned int kmerSize;
 	unsigned int sequenceCount;
 	vector<unordered_map<string,short>*>* kmers;
-	vector<double> distances;
 
 	vector<array<unsigned int, 3> > sampledTriplets;
 
@@ -55,11 +54,19 @@ protected:
 
 
 public:
-    GuideTree(Sequences*);
+    //knownDistances, if given, replace the k-mer distance calculation and become the
+    //distances of the tree, which takes ownership of them
+    GuideTree(Sequences*, PairwiseStorage* knownDistances = nullptr);
 
 	~GuideTree();
 
-	void constructTree();
+	void constructTree(bool knownDistances = false);
+
+	//Extend k-mer profiles and guide distances to sequences appended to the input
+	void addSequences(unsigned int firstNew);
+
+	//Adjusted k-mer distances from a sequence outside the input to every input sequence
+	vector<double> getQueryDistances(const string& query);
 
 	DistanceMatrix* getDistanceMatrix()
 	{
@@ -71,9 +78,15 @@ public:
 		return newickTree;
 	}
 
-	vector<double> getDistances()
+	//one per pair, in the store created by the input sequences
+	PairwiseStorage& getDistances()
+	{
+		return distMat->getStorage();
+	}
+
+	unsigned int getKmerSize()
 	{
-		return distances;
+		return kmerSize;
 	}
 
 private:
@@ -82,6 +95,12 @@ private:
 
 	unsigned int commonKmerCount(unsigned int i, unsigned int j);
 
+	unsigned int commonKmerCount(unordered_map<string,short>* m1, unordered_map<string,short>* m2);
+
+	double kmerDistance(unsigned int i, unsigned int j);
+
+	double adjustDistance(double identity);
+
 	double kimuraDist(double);
 
 	inline double aaFunction(double x)
@@ -24,6 +24,11 @@
 #include <chrono>
 #include <array>
 #include <map>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
 
 using namespace std;
 
@@ -31,10 +36,11 @@ namespace EBC
 {
 
 ModelEstimator::ModelEstimator(Sequences* inputSeqs, Definitions::ModelType model ,
-		Definitions::OptimizationType ot, unsigned int rateCategories, double alpha, bool estimateAlpha) :
+		Definitions::OptimizationType ot, unsigned int rateCategories, double alpha, bool estimateAlpha, unsigned int threads) :
 				inputSequences(inputSeqs), gammaRateCategories(rateCategories), model(model),
 				gtree(new GuideTree(inputSeqs)), tst(*gtree), userAlpha(alpha), estAlpha(estimateAlpha), estIndel(true), estSubst(true)
 {
+	threadCount = threads != 0 ? threads : std::max(std::thread::hardware_concurrency(), 1u);
 
 	DEBUG("About to sample some triplets");
 	DEBUG("Sampling triplets of sequences for gamma shape parameter estimation");
@@ -95,87 +101,152 @@ vector<double> ModelEstimator::getInitialModelParameters()
 
 }
 
-void ModelEstimator::recalculateHMMs()
-{//Fwd + bwd + MPD
+SubstitutionModelBase* ModelEstimator::createSubstitutionModel()
+{
+	SubstitutionModelBase* sm = nullptr;
 
-	ForwardPairHMM *f1, *f2;
-	double tb1, tb2, tb3;
+	if (model == Definitions::ModelType::HKY85){
+			DEBUG("Setting HKY85");
+			sm = new HKY85Model(dict, maths,gammaRateCategories);
+			sm->setParameters(getInitialModelParameters());
+	}
+	else if (model == Definitions::ModelType::GTR){
+			DEBUG("Setting GTR");
+			sm = new GTRModel(dict, maths,gammaRateCategories);
+			sm->setParameters(getInitialModelParameters());
+	}
+	//More AA models added
+	else if (model >= Definitions::ModelType::LG){
+			switch(model){
+			    case Definitions::ModelType::LG :
+			    	sm = new AminoacidSubstitutionModel(dict, maths,gammaRateCategories,Definitions::aaLgModel);
+			    break;
+			    case Definitions::ModelType::JTT :
+					sm = new AminoacidSubstitutionModel(dict, maths,gammaRateCategories,Definitions::aaJttModel);
+				break;
+			    case Definitions::ModelType::WAG :
+					sm = new AminoacidSubstitutionModel(dict, maths,gammaRateCategories,Definitions::aaWagModel);
+				break;
+			}
+	}
 
-	substModel->calculateModel();
+	sm->setObservedFrequencies(inputSequences->getElementFrequencies());
+	return sm;
+}
 
-	for (int i = 0; i < tripletIdxsSize; i++){
+void ModelEstimator::forEachTriplet(const std::function<void(unsigned int)>& task)
+{
+	unsigned int workers = std::min<unsigned int>(threadCount, tripletIdxsSize);
 
-		delete tripleAlignments[i][0];
-		delete tripleAlignments[i][1];
-		delete tripleAlignments[i][2];
+	if (workers <= 1)
+	{
+		for (unsigned int i = 0; i < tripletIdxsSize; i++)
+			task(i);
+		return;
+	}
 
-		delete pairAlignments[i][0];
-		delete pairAlignments[i][1];
-		delete pairAlignments[i][2];
-		delete pairAlignments[i][3];
+	std::atomic<unsigned int> next(0);
+	std::exception_ptr failure;
+	std::mutex failureMutex;
+	vector<std::thread> threads;
 
-		delete pairwisePosteriors[i][0];
-		delete pairwisePosteriors[i][1];
+	for (unsigned int w = 0; w < workers; w++)
+	{
+		threads.emplace_back([&]()
+		{
+			try
+			{
+				unsigned int i;
+				while ((i = next++) < tripletIdxsSize)
+					task(i);
+			}
+			catch (...)
+			{
+				//an exception leaving the thread would terminate, the remaining triplets are skipped
+				lock_guard<mutex> lock(failureMutex);
+				if (!failure)
+					failure = std::current_exception();
+				next = tripletIdxsSize;
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
 
-		f1 = fwdHMMs[i][0];
-		f2 = fwdHMMs[i][1];
+	if (failure)
+		std::rethrow_exception(failure);
+}
 
-		tb1 = sme->getTripletDivergence(i,0);
-		tb2 = sme->getTripletDivergence(i,1);
-		tb3 = sme->getTripletDivergence(i,2);
+void ModelEstimator::alignTriplet(unsigned int i, double time1, double time2, Band* band1, Band* band2)
+{
+	ForwardPairHMM* f1 = fwdHMMs[i][0];
+	ForwardPairHMM* f2 = fwdHMMs[i][1];
 
-		f1->setDivergenceTimeAndCalculateModels(tb1+tb2);
-		f2->setDivergenceTimeAndCalculateModels(tb2+tb3);
+	vector<SequenceElement*>* s1 = inputSequences->getSequencesAt(tripletIdxs[i][0]);
+	vector<SequenceElement*>* s2 = inputSequences->getSequencesAt(tripletIdxs[i][1]);
+	vector<SequenceElement*>* s3 = inputSequences->getSequencesAt(tripletIdxs[i][2]);
 
-		f1->runAlgorithm();
-		f2->runAlgorithm();
+	f1->setDivergenceTimeAndCalculateModels(time1);
+	f2->setDivergenceTimeAndCalculateModels(time2);
 
-		BackwardPairHMM b1(inputSequences->getSequencesAt(tripletIdxs[i][0]),inputSequences->getSequencesAt(tripletIdxs[i][1]),
-				substModel, indelModel, Definitions::DpMatrixType::Full, nullptr);
-		BackwardPairHMM b2(inputSequences->getSequencesAt(tripletIdxs[i][1]),inputSequences->getSequencesAt(tripletIdxs[i][2]),
-				substModel, indelModel, Definitions::DpMatrixType::Full, nullptr);
+	f1->runAlgorithm();
+	f2->runAlgorithm();
 
-		b1.setDivergenceTimeAndCalculateModels(tb1+tb2);
-		b2.setDivergenceTimeAndCalculateModels(tb2+tb3);
+	BackwardPairHMM b1(s1, s2, substModel, indelModel, Definitions::DpMatrixType::Full, band1);
+	BackwardPairHMM b2(s2, s3, substModel, indelModel, Definitions::DpMatrixType::Full, band2);
 
-		b1.runAlgorithm();
-		b2.runAlgorithm();
+	b1.setDivergenceTimeAndCalculateModels(time1);
+	b2.setDivergenceTimeAndCalculateModels(time2);
 
-		b1.calculatePosteriors(f1);
-		b2.calculatePosteriors(f2);
+	b1.runAlgorithm();
+	b2.runAlgorithm();
 
-		b1.calculateMaximumPosteriorMatrix();
-		b2.calculateMaximumPosteriorMatrix();
+	b1.calculatePosteriors(f1);
+	b2.calculatePosteriors(f2);
 
-		auto mp1 = b1.getMPAlignment();
-		auto mp2 = b2.getMPAlignment();
+	b1.calculateMaximumPosteriorMatrix();
+	b2.calculateMaximumPosteriorMatrix();
 
-		DUMP("Pair 1 MPD alignment recalc");
-		DUMP(mp1.first);
-		DUMP(mp1.second);
-		DUMP("Pair 2 MPD alignment recalc");
-		DUMP(mp2.first);
-		DUMP(mp2.second);
+	//store pairs, align triplets
+	pair<vector<double>*, pair<vector<unsigned char>*, vector<unsigned char>*> > alP1 = b1.getMPDWithPosteriors();
+	pair<vector<double>*, pair<vector<unsigned char>*, vector<unsigned char>*> > alP2 = b2.getMPDWithPosteriors();
 
+	pairAlignments[i][0] = alP1.second.first;
+	pairAlignments[i][1] = alP1.second.second;
+	pairAlignments[i][2] = alP2.second.first;
+	pairAlignments[i][3] = alP2.second.second;
 
-		//delete f1;
-		//delete f2;
+	pairwisePosteriors[i][0] = alP1.first;
+	pairwisePosteriors[i][1] = alP2.first;
 
-		//store pairs, align triplets
-		pair<vector<double>*, pair<vector<unsigned char>*, vector<unsigned char>*> > alP1 = b1.getMPDWithPosteriors();
-		pair<vector<double>*, pair<vector<unsigned char>*, vector<unsigned char>*> > alP2 = b2.getMPDWithPosteriors();
+	tripleAlignments[i] = tal->alignPosteriors(alP1.second, alP2.second, alP1.first, alP2.first);
+}
 
-		pairAlignments[i][0] = alP1.second.first;
-		pairAlignments[i][1] = alP1.second.second;
-		pairAlignments[i][2] = alP2.second.first;
-		pairAlignments[i][3] = alP2.second.second;
+void ModelEstimator::recalculateHMMs()
+{//Fwd + bwd + MPD
 
-		pairwisePosteriors[i][0] = alP1.first;
-		pairwisePosteriors[i][1] = alP2.first;
+	substModel->calculateModel();
 
-		tripleAlignments[i] = tal->alignPosteriors(alP1.second, alP2.second, alP1.first, alP2.first);
+	forEachTriplet([&](unsigned int i)
+	{
+		delete tripleAlignments[i][0];
+		delete tripleAlignments[i][1];
+		delete tripleAlignments[i][2];
 
-	}
+		delete pairAlignments[i][0];
+		delete pairAlignments[i][1];
+		delete pairAlignments[i][2];
+		delete pairAlignments[i][3];
+
+		delete pairwisePosteriors[i][0];
+		delete pairwisePosteriors[i][1];
+
+		double tb1 = sme->getTripletDivergence(i,0);
+		double tb2 = sme->getTripletDivergence(i,1);
+		double tb3 = sme->getTripletDivergence(i,2);
+
+		alignTriplet(i, tb1+tb2, tb2+tb3, nullptr, nullptr);
+	});
 
 	sme->clean();
 	ste->clean();
@@ -298,12 +369,9 @@ void ModelEstimator::estimateParameters()
 void ModelEstimator::calculateInitialHMMs(Definitions::ModelType model)
 {
 	DEBUG("Estimating Triple Aligments");
-	//amino acid mode
-	bool aaMode = false;
 	double tmpd;
 
 	double initAlpha = 0.75;
-	double initKappa = 2.0;
 	double initLambda = 0.05;
 	double initEpsilon = 0.5;
 	//k-mers tend to underestimate the distances;
@@ -322,36 +390,7 @@ void ModelEstimator::calculateInitialHMMs(Definitions::ModelType model)
 	else
 		alphas = {0.5,1.0,3.0};
 
-	ForwardPairHMM *f1, *f2;
-
-	if (model == Definitions::ModelType::HKY85){
-			DEBUG("Setting HKY85");
-			this->substModel = new HKY85Model(dict, maths,gammaRateCategories);
-			substModel->setParameters({initKappa});
-	}
-	else if (model == Definitions::ModelType::GTR){
-			DEBUG("Setting GTR");
-			this->substModel = new GTRModel(dict, maths,gammaRateCategories);
-			substModel->setParameters({1.0,1.0/initKappa,1.0/initKappa,1.0/initKappa,1.0/initKappa});
-	}
-	//More AA models added
-	else if (model >= Definitions::ModelType::LG){
-			aaMode = true;
-			switch(model){
-			    case Definitions::ModelType::LG :
-			    	substModel = new AminoacidSubstitutionModel(dict, maths,gammaRateCategories,Definitions::aaLgModel);
-			    break;
-			    case Definitions::ModelType::JTT :
-					substModel = new AminoacidSubstitutionModel(dict, maths,gammaRateCategories,Definitions::aaJttModel);
-				break;
-			    case Definitions::ModelType::WAG :
-					substModel = new AminoacidSubstitutionModel(dict, maths,gammaRateCategories,Definitions::aaWagModel);
-				break;
-			}
-	}
-
-
-	substModel->setObservedFrequencies(inputSequences->getElementFrequencies());
+	this->substModel = createSubstitutionModel();
 	//alpha setting will have no effect if we're dealing with 1 rate category
 	if (estAlpha)
 		substModel->setAlpha(initAlpha);
@@ -409,105 +448,114 @@ void ModelEstimator::calculateInitialHMMs(Definitions::ModelType model)
 
 
 	double bestLnl = Definitions::minMatrixLikelihood;
-	double currentLnl;
 	double bestA, bestL, bestTm;
 
+	//time modifier, lambda, alpha
+	vector<array<double,3> > grid;
+	for (auto tm : timeModifiers)
+		for(auto l : lambdas)
+			for(auto a : alphas)
+				grid.push_back({{tm, l, a}});
+	vector<double> gridLnl(grid.size());
+
+	//configurations are independent; every worker owns its models and hmms, the calling thread
+	//uses those of the estimator. The first exception stops the search and is rethrown after
+	//all workers have joined
+	std::atomic<unsigned int> next(0);
+	std::exception_ptr failure;
+	std::mutex failureMutex;
+	auto recordFailure = [&]()
+	{
+		lock_guard<mutex> lock(failureMutex);
+		if (!failure)
+			failure = std::current_exception();
+		next = grid.size();
+	};
+	auto evaluateGrid = [&](SubstitutionModelBase* sm, IndelModel* im, vector<array<ForwardPairHMM*,2> >& hmms)
+	{
+		unsigned int g;
+		while ((g = next++) < grid.size())
+		{
+			im->setParameters({grid[g][1],initEpsilon});
+			sm->setAlpha(grid[g][2]);
+			sm->calculateModel();
+			double lnl = 0;
+			for (unsigned int i = 0; i < tripletIdxsSize; i++){
+				hmms[i][0]->setDivergenceTimeAndCalculateModels(tripletDistances[i][0]*grid[g][0]);
+				hmms[i][1]->setDivergenceTimeAndCalculateModels(tripletDistances[i][1]*grid[g][0]);
+
+				lnl += (hmms[i][0]->runAlgorithm() + hmms[i][1]->runAlgorithm()) * -1.0;
+			}
+			gridLnl[g] = lnl;
+		}
+	};
 
-	for (auto tm : timeModifiers){
-		for(auto l : lambdas){
-			indelModel->setParameters({l,initEpsilon});
-			for(auto a : alphas){
-				substModel->setAlpha(a);
-				substModel->calculateModel();
-				currentLnl = 0;
-				for (int i = 0; i < tripletIdxsSize; i++){
-					f1 = fwdHMMs[i][0];
-					f2 = fwdHMMs[i][1];
-
-					f1->setDivergenceTimeAndCalculateModels(tripletDistances[i][0]*tm);
-					f2->setDivergenceTimeAndCalculateModels(tripletDistances[i][1]*tm);
-
-					currentLnl += (f1->runAlgorithm() + f2->runAlgorithm()) * -1.0;
-
-				}
-				if (currentLnl > bestLnl){
-					bestLnl = currentLnl;
-					this->bestFwdAlpha = bestA = a;
-					bestL = l;
-					this->bestFwdTm = bestTm = tm;
+	unsigned int workers = std::min<unsigned int>(threadCount, grid.size());
+	vector<std::thread> threads;
 
+	for (unsigned int w = 1; w < workers; w++)
+	{
+		threads.emplace_back([&]()
+		{
+			SubstitutionModelBase* sm = nullptr;
+			NegativeBinomialGapModel im;
+			vector<array<ForwardPairHMM*,2> > hmms(tripletIdxsSize, {{nullptr, nullptr}});
+			try
+			{
+				sm = createSubstitutionModel();
+				for (unsigned int i = 0; i < tripletIdxsSize; i++){
+					hmms[i][0] = new ForwardPairHMM(seqsA[i][0],seqsA[i][1], sm, &im, Definitions::DpMatrixType::Full, bandPairs[i].first,true);
+					hmms[i][1] = new ForwardPairHMM(seqsA[i][1],seqsA[i][2], sm, &im, Definitions::DpMatrixType::Full, bandPairs[i].second,true);
 				}
+				evaluateGrid(sm, &im, hmms);
+			}
+			catch (...)
+			{
+				recordFailure();
 			}
+			for (auto& hmmPair : hmms){
+				delete hmmPair[0];
+				delete hmmPair[1];
+			}
+			delete sm;
+		});
+	}
+	try
+	{
+		evaluateGrid(substModel, indelModel, fwdHMMs);
+	}
+	catch (...)
+	{
+		recordFailure();
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	if (failure)
+		std::rethrow_exception(failure);
+
+	//the same order and comparison as a serial search, so ties resolve identically
+	for (unsigned int g = 0; g < grid.size(); g++){
+		if (gridLnl[g] > bestLnl){
+			bestLnl = gridLnl[g];
+			this->bestFwdTm = bestTm = grid[g][0];
+			bestL = grid[g][1];
+			this->bestFwdAlpha = bestA = grid[g][2];
 		}
 	}
+	DEBUG("Initial grid search over " << grid.size() << " configurations on " << workers << " threads");
+
 	substModel->setAlpha(bestA);
-	if (estAlpha)
-		substModel->calculateModel();
+	substModel->calculateModel();
 	indelModel->setParameters({bestL,initEpsilon});
 
 	DUMP("Best a " << bestA << "\tbest l " << bestL << "\ttimeMult " << bestTm );
 
 	//Fwd + bwd + MPD
-	for (int i = 0; i < tripletIdxsSize; i++){
-		f1 = fwdHMMs[i][0];
-		f2 = fwdHMMs[i][1];
-
-		//remove bands for more accurate estimates
-		//f1->setBand(nullptr);
-		//f2->setBand(nullptr);
-
-		f1->setDivergenceTimeAndCalculateModels(tripletDistances[i][0]*bestTm);
-		f2->setDivergenceTimeAndCalculateModels(tripletDistances[i][1]*bestTm);
-
-		f1->runAlgorithm();
-		f2->runAlgorithm();
-
-		BackwardPairHMM b1(seqsA[i][0],seqsA[i][1], substModel, indelModel, Definitions::DpMatrixType::Full, bandPairs[i].first);
-		BackwardPairHMM b2(seqsA[i][1],seqsA[i][2], substModel, indelModel, Definitions::DpMatrixType::Full, bandPairs[i].second);
-
-		b1.setDivergenceTimeAndCalculateModels(tripletDistances[i][0]*bestTm);
-		b2.setDivergenceTimeAndCalculateModels(tripletDistances[i][1]*bestTm);
-
-		b1.runAlgorithm();
-		b2.runAlgorithm();
-
-		b1.calculatePosteriors(f1);
-		b2.calculatePosteriors(f2);
-
-		b1.calculateMaximumPosteriorMatrix();
-		b2.calculateMaximumPosteriorMatrix();
-
-		//auto mp1 = b1.getMPAlignment();
-		//auto mp2 = b2.getMPAlignment();
-
-		//DUMP("Pair 1 MPD alignment");
-		//DUMP(mp1.first);
-		//DUMP(mp1.second);
-		//DUMP("Pair 2 MPD alignment");
-		//DUMP(mp2.first);
-		//DUMP(mp2.second);
-
-
-		//delete f1;
-		//delete f2;
-
-		//store pairs, align triplets
-		pair<vector<double>*, pair<vector<unsigned char>*, vector<unsigned char>*> > alP1 = b1.getMPDWithPosteriors();
-		pair<vector<double>*, pair<vector<unsigned char>*, vector<unsigned char>*> > alP2 = b2.getMPDWithPosteriors();
-
-		pairAlignments[i][0] = alP1.second.first;
-		pairAlignments[i][1] = alP1.second.second;
-		pairAlignments[i][2] = alP2.second.first;
-		pairAlignments[i][3] = alP2.second.second;
-
-		pairwisePosteriors[i][0] = alP1.first;
-		pairwisePosteriors[i][1] = alP2.first;
-
-		tripleAlignments[i] = tal->alignPosteriors(alP1.second, alP2.second, alP1.first, alP2.first);
-
-		//TODO - delete band pairs
-
-	}
+	forEachTriplet([&](unsigned int i)
+	{
+		alignTriplet(i, tripletDistances[i][0]*bestTm, tripletDistances[i][1]*bestTm, bandPairs[i].first, bandPairs[i].second);
+	});
 
     for (auto &bandPair : bandPairs) {
         delete bandPair.first;
@@ -548,6 +596,57 @@ ModelEstimator::~ModelEstimator()
     delete substModel;
 }
 
+SubstitutionModelBase* ModelEstimator::releaseSubstitutionModel(Maths*& modelMaths)
+{
+	SubstitutionModelBase* model = substModel;
+	modelMaths = maths;
+	substModel = nullptr;
+	maths = nullptr;
+	return model;
+}
+
+GuideTree* ModelEstimator::releaseGuideTree()
+{
+	GuideTree* tree = gtree;
+	gtree = nullptr;
+	return tree;
+}
+
+double ModelEstimator::checkGradient()
+{
+	if (substModel == nullptr)
+		throw HmmException("The substitution model was released, its gradient can't be checked");
+
+	OptimizedModelParameters* params = sme->getModelParams();
+	vector<double> estimatedSubst = params->getSubstParameters();
+	double estimatedAlpha = params->getAlpha();
+	vector<double> estimatedTimes = params->getDivergenceTimes();
+
+	double maxError = sme->checkGradient();
+	DEBUG("Gradient check at the estimate, largest relative error " << maxError);
+
+	//the gradient nearly vanishes at the estimate, away from it every term has to agree
+	vector<double> times(estimatedTimes);
+	for (auto& time : times)
+		time *= 1.5;
+	params->setUserDivergenceParams(times);
+	if (model == Definitions::ModelType::HKY85 || model == Definitions::ModelType::GTR)
+		params->setUserSubstParams(getInitialModelParameters());
+	if (estAlpha)
+		params->setAlpha(0.75);
+
+	double error = sme->checkGradient();
+	DEBUG("Gradient check at the initial parameters, largest relative error " << error);
+	maxError = std::max(maxError, error);
+
+	params->setUserDivergenceParams(estimatedTimes);
+	params->setUserSubstParams(estimatedSubst);
+	params->setAlpha(estimatedAlpha);
+	sme->runIteration();
+
+	return maxError;
+}
+
 vector<double> ModelEstimator::getSubstitutionParameters()
 {
 	//return this->sme->getModelParams()->getSubstParameters();
@@ -54,6 +54,7 @@
 #include <sstream>
 #include <vector>
 #include <array>
+#include <functional>
 
 using namespace std;
 
@@ -105,6 +106,9 @@ protected:
 
 	unsigned int tripletIdxsSize;
 
+	//worker threads of the estimation, never 0
+	unsigned int threadCount;
+
 	double userAlpha;
 
 	bool estimateAlpha;
@@ -117,12 +121,23 @@ protected:
 
 	vector<double> getInitialModelParameters();
 
+	//substitution model of the estimator's type with initial parameters and observed frequencies
+	SubstitutionModelBase* createSubstitutionModel();
+
+	//runs task for every sampled triplet on worker threads, each triplet writes only its own slots;
+	//the first exception of a task is rethrown once all workers have stopped
+	void forEachTriplet(const std::function<void(unsigned int)>& task);
+
+	//fwd + bwd + MPD of both pairs of triplet i and the triple alignment built from them
+	void alignTriplet(unsigned int i, double time1, double time2, Band* band1, Band* band2);
+
 	void doSME();
 
 public:
+    //threads 0 uses all hardware threads
     ModelEstimator(Sequences* inputSeqs, Definitions::ModelType model,
 			Definitions::OptimizationType ot,
-			unsigned int rateCategories, double alpha, bool estimateAlpha);
+			unsigned int rateCategories, double alpha, bool estimateAlpha, unsigned int threads = 0);
 
 	virtual ~ModelEstimator();
 
@@ -138,6 +153,17 @@ public:
 	{
 		return gtree;
 	}
+
+	//Hand the estimated substitution model, with the Maths it calculates with, and the guide
+	//tree over to the caller, e.g. a BandingEstimator, so that the estimator with its triplet
+	//alignments and HMMs can be deleted right after the estimation
+	SubstitutionModelBase* releaseSubstitutionModel(Maths*& modelMaths);
+
+	GuideTree* releaseGuideTree();
+
+	//largest relative error of the analytic substitution model gradient against finite
+	//differences, at the estimate and at the initial parameters; the estimate is kept
+	double checkGradient();
 };
 
 } /* namespace EBC */
@@ -43,18 +43,201 @@ StateTransitionEstimator::StateTransitionEstimator(IndelModel* im, Definitions::
 
 double StateTransitionEstimator::runIteration()
 {
-	double result = 0;
+	vector<double> params = modelParams->getIndelParameters();
+	indelModel->setParameters(params);
+	return calculateLnL(params[0], params[1]) * -1.0;
+}
 
-	//modelParams->outputParameters();
-	indelModel->setParameters(modelParams->getIndelParameters());
-	//go through matrices
+double StateTransitionEstimator::calculateGradient(vector<double>& gradient)
+{
+	vector<double> params = modelParams->getIndelParameters();
+	indelModel->setParameters(params);
+	gradient.assign(2, 0.0);
+	double lnl = calculateLnL(params[0], params[1], gradient.data());
+	gradient[0] *= -1.0;
+	gradient[1] *= -1.0;
+	return lnl * -1.0;
+}
+
+void StateTransitionEstimator::collectStatistics()
+{
+	statistics.clear();
 	for(auto tm : stmSamples)
 	{
-		//set parameter for every sample
-		result += tm->getLnL();
-		//calculate and add to result
+		if (tm != nullptr)
+			statistics.push_back(tm->getStatistics());
+	}
+}
+
+double StateTransitionEstimator::calculateLnL(double lambda, double epsilon, double* gradient, double* hessian)
+{
+	double lnl = 0;
+	double gLambda = 0, gEpsilon = 0;
+	double hLambda = 0, hCross = 0, hEpsilon = 0;
+	double e = epsilon;
+	double ce = 1.0 - e;
+
+	for(auto& st : statistics)
+	{
+		//g = 1 - exp(-lambda t), see NegativeBinomialGapModel
+		double q = exp(-1.0*lambda*st.time);
+		double g = 1.0 - q;
+		if (g < 0.0)
+			g = Definitions::almostZero;
+		double dg = st.time * q;
+		double d2g = -1.0 * st.time * st.time * q;
+
+		double u = 1.0 - 2*g;
+		double v = e + ce*g;
+		double norm = ce*u + 2*g;
+
+		//derivatives over g and e of the per sample lnL, zero counts skipped as in getLnL
+		double hg = 0, he = 0, hgg = 0, hge = 0, hee = 0;
+		if (st.matchStay != 0)
+		{
+			lnl += st.matchStay * log(u);
+			hg -= 2*st.matchStay / u;
+			hgg -= 4*st.matchStay / (u*u);
+		}
+		if (st.gapOpen != 0)
+		{
+			lnl += st.gapOpen * log(g);
+			hg += st.gapOpen / g;
+			hgg -= st.gapOpen / (g*g);
+		}
+		if (st.gapClose != 0)
+		{
+			lnl += st.gapClose * log(ce);
+			he -= st.gapClose / ce;
+			hee -= st.gapClose / (ce*ce);
+		}
+		if (st.gapStay != 0)
+		{
+			lnl += st.gapStay * log(v);
+			hg += st.gapStay * ce / v;
+			he += st.gapStay * (1.0 - g) / v;
+			hgg -= st.gapStay * ce * ce / (v*v);
+			hge -= st.gapStay / (v*v);
+			hee -= st.gapStay * (1.0 - g) * (1.0 - g) / (v*v);
+		}
+		if (st.equilibrium != 0)
+		{
+			lnl -= st.equilibrium * log(norm);
+			hg -= 2*e*st.equilibrium / norm;
+			he += st.equilibrium * u / norm;
+			hgg += 4*e*e*st.equilibrium / (norm*norm);
+			hge -= 2*st.equilibrium / (norm*norm);
+			hee += st.equilibrium * u * u / (norm*norm);
+		}
+
+		gLambda += hg * dg;
+		gEpsilon += he;
+		hLambda += hgg * dg * dg + hg * d2g;
+		hCross += hge * dg;
+		hEpsilon += hee;
+	}
+
+	if (gradient != nullptr)
+	{
+		gradient[0] = gLambda;
+		gradient[1] = gEpsilon;
 	}
-	return result * -1.0;
+	if (hessian != nullptr)
+	{
+		hessian[0] = hLambda;
+		hessian[1] = hCross;
+		hessian[2] = hEpsilon;
+	}
+	return lnl;
+}
+
+bool StateTransitionEstimator::newtonOptimize()
+{
+	column_vector values(2), lo(2), hi(2);
+	modelParams->toDlibVector(values, lo, hi);
+
+	double x[2], grad[2], hess[3], step[2], next[2];
+	for (unsigned int i = 0; i < 2; i++)
+		x[i] = std::min(std::max(values(i), lo(i)), hi(i));
+
+	double lnl = calculateLnL(x[0], x[1], grad, hess);
+	if (!std::isfinite(lnl))
+		return false;
+
+	for (unsigned int it = 0; it < Definitions::newtonMaxIterations; it++)
+	{
+		//parameters held at a bound by the gradient are not moved
+		bool active[2];
+		for (unsigned int i = 0; i < 2; i++)
+			active[i] = (x[i] <= lo(i) && grad[i] < 0) || (x[i] >= hi(i) && grad[i] > 0);
+
+		double det = hess[0]*hess[2] - hess[1]*hess[1];
+		if (!active[0] && !active[1] && hess[0] < 0 && det > 0)
+		{
+			step[0] = (-hess[2]*grad[0] + hess[1]*grad[1]) / det;
+			step[1] = (hess[1]*grad[0] - hess[0]*grad[1]) / det;
+		}
+		else
+		{
+			//one free parameter or no ascent from the quadratic model - diagonal Newton, or
+			//towards the bound the gradient points at where the curvature is not negative
+			for (unsigned int i = 0; i < 2; i++)
+			{
+				double curvature = hess[i == 0 ? 0 : 2];
+				if (active[i])
+					step[i] = 0;
+				else if (curvature < 0)
+					step[i] = -grad[i] / curvature;
+				else
+					step[i] = (grad[i] > 0 ? hi(i) : lo(i)) - x[i];
+			}
+		}
+
+		double scale = 1.0;
+		double nextLnl = lnl;
+		bool improved = false;
+		for (unsigned int h = 0; h < Definitions::newtonMaxHalvings; h++)
+		{
+			for (unsigned int i = 0; i < 2; i++)
+				next[i] = std::min(std::max(x[i] + scale*step[i], lo(i)), hi(i));
+			nextLnl = calculateLnL(next[0], next[1]);
+			if (std::isfinite(nextLnl) && nextLnl >= lnl)
+			{
+				improved = true;
+				break;
+			}
+			scale /= 2;
+		}
+		if (!improved)
+			break;
+
+		double change = std::max(fabs(next[0] - x[0]) / std::max(1.0, fabs(x[0])),
+				fabs(next[1] - x[1]) / std::max(1.0, fabs(x[1])));
+		x[0] = next[0];
+		x[1] = next[1];
+		lnl = calculateLnL(x[0], x[1], grad, hess);
+
+		if (change < Definitions::newtonTolerance)
+		{
+			values(0) = x[0];
+			values(1) = x[1];
+			modelParams->fromDlibVector(values);
+			DUMP("State Transition Estimator Newton converged after " << it+1 << " iterations, lnL " << lnl);
+			return true;
+		}
+	}
+
+	//no further ascent possible - stationary unless the gradient points into the box
+	values(0) = x[0];
+	values(1) = x[1];
+	modelParams->fromDlibVector(values);
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		bool blocked = (x[i] <= lo(i) && grad[i] < 0) || (x[i] >= hi(i) && grad[i] > 0);
+		if (!blocked && fabs(grad[i]) * std::max(1.0, fabs(x[i])) > Definitions::newtonGradientTolerance * std::max(1.0, fabs(lnl)))
+			return false;
+	}
+	return true;
 }
 
 void StateTransitionEstimator::addTime(double time, unsigned int triplet, unsigned int pr)
@@ -76,7 +259,14 @@ void StateTransitionEstimator::addPair(vector<unsigned char>* s1,
 void StateTransitionEstimator::optimize()
 {
 	modelParams->boundLambdaBasedOnDivergence(maxTime);
-	bfgs->optimize();
+	collectStatistics();
+	//the likelihood is a 2-D function of a few summed counts, Newton converges in a handful
+	//of evaluations; the numerical optimizer is only a fallback
+	if (!newtonOptimize())
+	{
+		DEBUG("State Transition Estimator Newton did not converge, using the numerical optimizer");
+		bfgs->optimize();
+	}
 	indelModel->setParameters(modelParams->getIndelParameters());
 	INFO("StateTransitionEstimator results:");
 	modelParams->logParameters();
@@ -50,6 +50,18 @@ protected:
 
 	bool useStateEq;
 
+	//per sample sufficient statistics, collected before optimizing
+	vector<StateTransitionStatistics> statistics;
+
+	void collectStatistics();
+
+	//lnL over the negative binomial gap model parameters (lambda, epsilon), optionally
+	//with its gradient and the hessian as (lambda lambda, lambda epsilon, epsilon epsilon)
+	double calculateLnL(double lambda, double epsilon, double* gradient = nullptr, double* hessian = nullptr);
+
+	//projected Newton with step halving inside the parameter bounds, false if it did not converge
+	bool newtonOptimize();
+
 
 public:
 	StateTransitionEstimator(IndelModel* im, Definitions::OptimizationType ot, unsigned int pairCategories, unsigned char gapchar, bool useEq = true);
@@ -60,6 +72,13 @@ public:
 
 	double runIteration();
 
+	bool hasGradient()
+	{
+		return true;
+	}
+
+	double calculateGradient(vector<double>& gradient);
+
 	void optimize();
 
 	void clean(int ndel = 0);
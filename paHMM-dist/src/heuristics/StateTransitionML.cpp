@@ -170,4 +170,39 @@ double StateTransitionML::getLnL()
 	//return likelihood
 }
 
+StateTransitionStatistics StateTransitionML::getStatistics()
+{
+	const unsigned int M = Definitions::StateId::Match;
+	const unsigned int I = Definitions::StateId::Insert;
+	const unsigned int D = Definitions::StateId::Delete;
+
+	StateTransitionStatistics stats;
+	stats.time = time;
+	stats.matchStay = counts[M][M] + counts[I][M] + counts[D][M];
+	stats.gapOpen = counts[M][I] + counts[M][D] + counts[I][D] + counts[D][I];
+	stats.gapClose = counts[I][M] + counts[D][M] + counts[I][D] + counts[D][I];
+	stats.gapStay = counts[I][I] + counts[D][D];
+	stats.equilibrium = 0;
+
+	//the chain is stationary with pi_M = (1-e)(1-2g)/norm and pi_I = pi_D = g/norm, so both
+	//the equilibrium weighted counts and the first state term of getLnL are log(pi) terms
+	double matchStates, gapStates;
+	if (useStateEq)
+	{
+		matchStates = counts[M][M] + counts[M][I] + counts[M][D];
+		gapStates = counts[I][M] + counts[I][I] + counts[I][D] + counts[D][M] + counts[D][I] + counts[D][D];
+	}
+	else
+	{
+		matchStates = firstState == Definitions::StateId::Match ? 1 : 0;
+		gapStates = 1 - matchStates;
+	}
+	stats.matchStay += matchStates;
+	stats.gapClose += matchStates;
+	stats.gapOpen += gapStates;
+	stats.equilibrium += matchStates + gapStates;
+
+	return stats;
+}
+
 } /* namespace EBC */
@@ -30,6 +30,20 @@ namespace EBC
 {
 
 
+//Sufficient statistics of a sample: with g the gap opening and e the gap extension
+//probability its log-likelihood is
+//matchStay*log(1-2g) + gapOpen*log(g) + gapClose*log(1-e) + gapStay*log(e+(1-e)g)
+//- equilibrium*log((1-e)(1-2g)+2g)
+struct StateTransitionStatistics
+{
+	double time;
+	double matchStay;
+	double gapOpen;
+	double gapClose;
+	double gapStay;
+	double equilibrium;
+};
+
 //This is a 3x3 state transition matrix
 class StateTransitionML
 {
@@ -68,6 +82,9 @@ public:
 	void addSample(vector<unsigned char>*, vector<unsigned char>* s2);
 
 	double getLnL();
+
+	//transition counts (and the first state or equilibrium terms) folded by log term
+	StateTransitionStatistics getStatistics();
 };
 
 } /* namespace EBC */
@@ -33,8 +33,8 @@ namespace EBC
 SubstitutionModelEstimator::SubstitutionModelEstimator(Sequences* inputSeqs, SubstitutionModelBase* model,
 		Definitions::OptimizationType ot,unsigned int rateCategories, double alpha,
 		bool estimateAlpha, unsigned int matCount) :
-				inputSequences(inputSeqs), substModel(model), gammaRateCategories(rateCategories),
-				patterns(matCount), ptMatrices(matCount), distances(3*matCount)
+				inputSequences(inputSeqs), substModel(model), ptMatrices(matCount), patternRows(matCount),
+				patternWeights(matCount), patternIndex(matCount), distances(3*matCount), gammaRateCategories(rateCategories)
 
 
 {
@@ -52,7 +52,7 @@ SubstitutionModelEstimator::SubstitutionModelEstimator(Sequences* inputSeqs, Sub
 	maths = new Maths();
 	dict = inputSequences->getDictionary();
 
-	modelParams = new OptimizedModelParameters(substModel, NULL,3, 3*patterns.size(), estimateSubstitutionParams,
+	modelParams = new OptimizedModelParameters(substModel, NULL,3, 3*patternRows.size(), estimateSubstitutionParams,
 			false, estimateAlpha, true, maths);
 	modelParams->useSubstitutionModelInitialParameters();
 
@@ -82,18 +82,17 @@ void SubstitutionModelEstimator::clean(int nelems)
 			delete ptMatrices[i][1];
 			delete ptMatrices[i][2];
 		}
-		patterns.erase(patterns.begin(),patterns.begin() + nelems);
+		patternRows.erase(patternRows.begin(),patternRows.begin() + nelems);
+		patternWeights.erase(patternWeights.begin(),patternWeights.begin() + nelems);
+		patternIndex.erase(patternIndex.begin(),patternIndex.begin() + nelems);
 		ptMatrices.erase(ptMatrices.begin(),ptMatrices.begin() + nelems);
 		distances.erase(distances.begin(), distances.begin() + (nelems*3));
 
 	}
 
-	for (auto itp = patterns.begin(); itp != patterns.end(); itp++)
+	for (auto& weights : patternWeights)
 	{
-		for (auto itMap = itp->begin(); itMap != itp->end(); itMap++)
-		{
-			itMap->second = 0.0;
-		}
+		std::fill(weights.begin(), weights.end(), 0.0);
 	}
 }
 
@@ -116,9 +115,18 @@ void SubstitutionModelEstimator::addTriplet(array<vector<unsigned char>*, 3> tri
 		double d1, double d2, double d3)
 {
 	DUMP("SME : adding patterns for triplet " << trp);
+	unsigned char gapRow = substModel->getMatrixSize();
 	for(int pos = 0; pos < tripleAlignment[0]->size(); pos++)
 	{
-		patterns[trp][{{(*tripleAlignment[0])[pos], (*tripleAlignment[1])[pos],(*tripleAlignment[2])[pos]}}] += 1;
+		array<unsigned char, 3> code = {{(*tripleAlignment[0])[pos], (*tripleAlignment[1])[pos],(*tripleAlignment[2])[pos]}};
+		auto it = patternIndex[trp].find(code);
+		if (it == patternIndex[trp].end())
+		{
+			it = patternIndex[trp].emplace(code, patternRows[trp].size()).first;
+			patternRows[trp].push_back({{std::min(code[0], gapRow), std::min(code[1], gapRow), std::min(code[2], gapRow)}});
+			patternWeights[trp].push_back(0.0);
+		}
+		patternWeights[trp][it->second] += 1;
 	}
 	//for (auto pat : patterns[trp])
 	//{
@@ -182,11 +190,10 @@ void SubstitutionModelEstimator::optimize()
 
 }
 
-double SubstitutionModelEstimator::runIteration()
+void SubstitutionModelEstimator::updateModel()
 {
-	double result = 0;
-
-	double partial1;
+	unsigned int states = substModel->getMatrixSize();
+	unsigned int width = states * substModel->getRateCategories();
 
 	substModel->setAlpha(modelParams->getAlpha());
 	substModel->setParameters(modelParams->getSubstParameters());
@@ -201,17 +208,57 @@ double SubstitutionModelEstimator::runIteration()
 		}
 	}
 
-	for(int al = 0; al < patterns.size(); al++)
+	rootWeights.resize(width);
+	for (unsigned int rt = 0; rt < substModel->getRateCategories(); rt++)
+		for (unsigned int root = 0; root < states; root++)
+			rootWeights[rt*states + root] = substModel->getEquilibriumFrequencies(root) * substModel->gammaFrequencies[rt];
+}
+
+void SubstitutionModelEstimator::getDerivativeColumns(const vector<double>& matrices, vector<double>& columns)
+{
+	unsigned int states = substModel->getMatrixSize();
+	unsigned int fullSize = states*states;
+	unsigned int width = states * substModel->getRateCategories();
+	columns.resize((states + 1) * width);
+
+	for (unsigned int child = 0; child < states; child++)
+		for (unsigned int rt = 0; rt < substModel->getRateCategories(); rt++)
+			for (unsigned int root = 0; root < states; root++)
+				columns[child*width + rt*states + root] = matrices[rt*fullSize + root*states + child];
+
+	std::fill(columns.begin() + states*width, columns.end(), 0.0);
+}
+
+double SubstitutionModelEstimator::runIteration()
+{
+	double result = 0;
+
+	double partial1;
+
+	unsigned int states = substModel->getMatrixSize();
+	unsigned int width = states * substModel->getRateCategories();
+
+	updateModel();
+
+	//every pattern is a dot product over root x category of the three P(t) rows it selects
+	const double* weights = rootWeights.data();
+	for(unsigned int al = 0; al < patternRows.size(); al++)
 	{
-		for(auto it : patterns[al])
+		for (unsigned int j = 0; j < Definitions::heuristicsTreeSize; j++)
+			ptMatrices[al][j]->getPatternColumns(patternColumns[j]);
+
+		const vector<array<unsigned char, 3> >& rows = patternRows[al];
+		for(unsigned int p = 0; p < rows.size(); p++)
 		{
+			const double* p1 = patternColumns[0].data() + rows[p][0]*width;
+			const double* p2 = patternColumns[1].data() + rows[p][1]*width;
+			const double* p3 = patternColumns[2].data() + rows[p][2]*width;
 			partial1 = 0;
-			for(int rt = 0; rt < dict->getAlphabetSize(); rt++)
+			for (unsigned int m = 0; m < width; m++)
 			{
-				partial1 += ptMatrices[al][0]->getTripleSitePattern(rt,it.first, ptMatrices[al][1],ptMatrices[al][2]);
+				partial1 += weights[m] * p1[m] * p2[m] * p3[m];
 			}
-			result += log(partial1)* it.second;
-
+			result += log(partial1)* patternWeights[al][p];
 		}
 	}
 	//DEBUG("lnl result:" << result);
@@ -223,4 +270,164 @@ double SubstitutionModelEstimator::runIteration()
 
 }
 
+double SubstitutionModelEstimator::calculateGradient(vector<double>& gradient)
+{
+	double result = 0;
+
+	unsigned int states = substModel->getMatrixSize();
+	unsigned int categories = substModel->getRateCategories();
+	unsigned int fullSize = states*states;
+	unsigned int width = states * categories;
+	unsigned int tree = Definitions::heuristicsTreeSize;
+
+	unsigned int substCount = estimateSubstitutionParams ? substModel->getParamsNumber() : 0;
+	unsigned int alphaPos = substCount;
+	unsigned int timePos = substCount + (estimateAlpha ? 1 : 0);
+
+	gradient.assign(modelParams->optParamCount(), 0.0);
+
+	updateModel();
+
+	vector<double> workspace(substModel->getPtDerivativeWorkspaceSize());
+	vector<double> derivatives(categories*fullSize);
+
+	vector<vector<double> > bases(substCount, vector<double>(fullSize));
+	for (unsigned int k = 0; k < substCount; k++)
+		substModel->calculateRateDerivativeBasis(k, bases[k].data(), workspace.data());
+
+	//alpha moves the category rates (dP/dalpha = t dr/dalpha / r dP/dt) and frequencies
+	vector<double> dRates(categories), dFrequencies(categories);
+	vector<double> dWeights(width, 0.0);
+	array<vector<double>, 3> alphaScale;
+	if (estimateAlpha)
+	{
+		substModel->calculateGammaDerivatives(dRates.data(), dFrequencies.data());
+		for (unsigned int rt = 0; rt < categories; rt++)
+			for (unsigned int root = 0; root < states; root++)
+				dWeights[rt*states + root] = substModel->getEquilibriumFrequencies(root) * dFrequencies[rt];
+	}
+
+	const double* weights = rootWeights.data();
+	for(unsigned int al = 0; al < patternRows.size(); al++)
+	{
+		for (unsigned int j = 0; j < tree; j++)
+		{
+			double time = modelParams->getDivergenceTime(tree*al + j);
+			ptMatrices[al][j]->getPatternColumns(patternColumns[j]);
+
+			for (unsigned int rt = 0; rt < categories; rt++)
+				substModel->calculatePtDerivative(time, rt, derivatives.data() + rt*fullSize, workspace.data());
+			getDerivativeColumns(derivatives, timeColumns[j]);
+
+			paramColumns[j].resize(substCount);
+			for (unsigned int k = 0; k < substCount; k++)
+			{
+				for (unsigned int rt = 0; rt < categories; rt++)
+					substModel->calculatePtParameterDerivative(time, rt, bases[k].data(),
+							derivatives.data() + rt*fullSize, workspace.data());
+				getDerivativeColumns(derivatives, paramColumns[j][k]);
+			}
+
+			if (estimateAlpha)
+			{
+				alphaScale[j].resize(width);
+				for (unsigned int rt = 0; rt < categories; rt++)
+					for (unsigned int root = 0; root < states; root++)
+						alphaScale[j][rt*states + root] = time * dRates[rt] / substModel->gammaRates[rt];
+			}
+		}
+
+		const vector<array<unsigned char, 3> >& rows = patternRows[al];
+		for(unsigned int p = 0; p < rows.size(); p++)
+		{
+			double count = patternWeights[al][p];
+			if (count == 0)
+				continue;
+
+			const double* p1 = patternColumns[0].data() + rows[p][0]*width;
+			const double* p2 = patternColumns[1].data() + rows[p][1]*width;
+			const double* p3 = patternColumns[2].data() + rows[p][2]*width;
+			const double* d1 = timeColumns[0].data() + rows[p][0]*width;
+			const double* d2 = timeColumns[1].data() + rows[p][1]*width;
+			const double* d3 = timeColumns[2].data() + rows[p][2]*width;
+
+			double lk = 0, dt1 = 0, dt2 = 0, dt3 = 0, da = 0;
+			for (unsigned int m = 0; m < width; m++)
+			{
+				double t1 = weights[m] * d1[m] * p2[m] * p3[m];
+				double t2 = weights[m] * p1[m] * d2[m] * p3[m];
+				double t3 = weights[m] * p1[m] * p2[m] * d3[m];
+				lk += weights[m] * p1[m] * p2[m] * p3[m];
+				dt1 += t1;
+				dt2 += t2;
+				dt3 += t3;
+				if (estimateAlpha)
+				{
+					da += dWeights[m] * p1[m] * p2[m] * p3[m] +
+							alphaScale[0][m]*t1 + alphaScale[1][m]*t2 + alphaScale[2][m]*t3;
+				}
+			}
+
+			for (unsigned int k = 0; k < substCount; k++)
+			{
+				const double* q1 = paramColumns[0][k].data() + rows[p][0]*width;
+				const double* q2 = paramColumns[1][k].data() + rows[p][1]*width;
+				const double* q3 = paramColumns[2][k].data() + rows[p][2]*width;
+				double dk = 0;
+				for (unsigned int m = 0; m < width; m++)
+				{
+					dk += weights[m] * (q1[m] * p2[m] * p3[m] + p1[m] * q2[m] * p3[m] + p1[m] * p2[m] * q3[m]);
+				}
+				gradient[k] += count * dk / lk;
+			}
+
+			result += log(lk) * count;
+			gradient[timePos + tree*al] += count * dt1 / lk;
+			gradient[timePos + tree*al + 1] += count * dt2 / lk;
+			gradient[timePos + tree*al + 2] += count * dt3 / lk;
+			if (estimateAlpha)
+				gradient[alphaPos] += count * da / lk;
+		}
+	}
+
+	//the optimizer minimizes -lnL
+	for (auto& g : gradient)
+		g *= -1.0;
+	return result * -1.0;
+}
+
+double SubstitutionModelEstimator::checkGradient(double step)
+{
+	unsigned int count = modelParams->optParamCount();
+	vector<double> gradient;
+	column_vector values(count), lo(count), hi(count);
+	double maxError = 0;
+
+	calculateGradient(gradient);
+	modelParams->toDlibVector(values, lo, hi);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		double original = values(i);
+		double h = step * std::max(1.0, fabs(original));
+
+		values(i) = original + h;
+		modelParams->fromDlibVector(values);
+		double up = runIteration();
+		values(i) = original - h;
+		modelParams->fromDlibVector(values);
+		double down = runIteration();
+		values(i) = original;
+
+		double numeric = (up - down) / (2*h);
+		double error = fabs(gradient[i] - numeric) / std::max(1.0, fabs(numeric));
+		DUMP("SME gradient check parameter " << i << " analytic " << gradient[i] << " numeric " << numeric);
+		maxError = std::max(maxError, error);
+	}
+	modelParams->fromDlibVector(values);
+	updateModel();
+
+	return maxError;
+}
+
 } /* namespace EBC */
@@ -59,7 +59,17 @@ protected:
 
 	vector<array<PMatrixTriple* ,3> > ptMatrices;
 
-	vector<map<array<unsigned char, 3>, unsigned int> > patterns;
+	//site patterns of every triplet as flat arrays: P(t) rows of the three sequences (gaps
+	//share the last row, see PMatrixTriple::getPatternColumns) and pattern counts
+	vector<vector<array<unsigned char, 3> > > patternRows;
+	vector<vector<double> > patternWeights;
+
+	//position of each pattern in the flat arrays, used while adding triplets
+	vector<map<array<unsigned char, 3>, unsigned int> > patternIndex;
+
+	//equilibrium frequency times category frequency for each category and root
+	vector<double> rootWeights;
+	array<vector<double>, 3> patternColumns;
 
 	vector<double> distances;
 
@@ -74,6 +84,16 @@ protected:
 
 	unsigned int currentTriplet;
 
+	//derivative columns in the getPatternColumns layout - dP/dt and dP/dparam per branch
+	array<vector<double>, 3> timeColumns;
+	array<vector<vector<double> >, 3> paramColumns;
+
+	//sets the model and P(t) matrices to the current parameters
+	void updateModel();
+
+	//lays out per category matrices like PMatrixTriple::getPatternColumns, gaps contribute 0
+	void getDerivativeColumns(const vector<double>& matrices, vector<double>& columns);
+
 public:
     SubstitutionModelEstimator(Sequences* inputSeqs, SubstitutionModelBase* model,
 			Definitions::OptimizationType ot,unsigned int rateCategories, double alpha,
@@ -86,6 +106,19 @@ public:
 
 	double runIteration();
 
+	bool hasGradient()
+	{
+		return true;
+	}
+
+	//analytic gradient of -lnL: branch lengths through the eigensystem, model parameters
+	//through dQ and alpha through the discrete gamma rates and frequencies
+	double calculateGradient(vector<double>& gradient);
+
+	//largest difference between the analytic gradient and central finite differences,
+	//relative to max(1, |finite difference|)
+	double checkGradient(double step = Definitions::gradientCheckStep);
+
 	void optimize();
 
 	void clean(int nelems = 0);
@@ -122,7 +122,8 @@ vector<array<unsigned int, 3> > TripletSamplingTree::sampleFromTree()
 
 	for (unsigned int i = 0;  i < distMat->getSize(); i++)
 	{
-		leafNodes[i] = nullptr;
+		if (!distMat->isExcluded(i))
+			leafNodes[i] = nullptr;
 	}
 	availableNodes = leafNodes;
 
@@ -0,0 +1,231 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+
+#include "hmm/AnchoredForwardPairHMM.hpp"
+
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+namespace EBC
+{
+
+static inline double logSum(double a, double b)
+{
+	return a > b ? a + log(1+exp(b-a)) : b + log(1+exp(a-b));
+}
+
+static inline double logSum(double a, double b, double c)
+{
+	return logSum(logSum(a,b),c);
+}
+
+AnchoredForwardPairHMM::AnchoredForwardPairHMM(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2,
+		SubstitutionModelBase* smdl, IndelModel* imdl, unsigned int kmerSize, unsigned int minAnchorLength) :
+		EvolutionaryPairHMM(s1,s2, smdl, imdl, Definitions::DpMatrixType::Limited, nullptr, true)
+{
+	setThreadCount(0);
+	buildSegments(kmerSize, minAnchorLength);
+	DEBUG("Anchored forward with " << anchors.size() << " anchors and " << segments.size() << " segments");
+}
+
+AnchoredForwardPairHMM::~AnchoredForwardPairHMM()
+{
+}
+
+void AnchoredForwardPairHMM::setThreadCount(unsigned int threads)
+{
+	threadCount = threads != 0 ? threads : std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+}
+
+void AnchoredForwardPairHMM::buildSegments(unsigned int kmerSize, unsigned int minAnchorLength)
+{
+	unsigned int trim = Definitions::anchoredForwardTrim;
+	unsigned int end1 = 0, end2 = 0;
+
+	if (minAnchorLength <= 2*trim)
+		minAnchorLength = 2*trim + 1;
+
+	AnchorBandCalculator abc(seq1, seq2, kmerSize, Definitions::anchorBandMargin, false);
+
+	//the run ends stay free so the sub-problems meet in well aligned columns
+	for (auto run : abc.getAnchorRuns(minAnchorLength))
+	{
+		run.pos1 += trim;
+		run.pos2 += trim;
+		run.length -= 2*trim;
+
+		//runs on different diagonals may overlap
+		if (run.pos1 < end1 || run.pos2 < end2)
+			continue;
+
+		segments.push_back({end1, run.pos1, end2, run.pos2, anchors.empty(), false});
+		anchors.push_back(run);
+		end1 = run.pos1 + run.length;
+		end2 = run.pos2 + run.length;
+	}
+
+	segments.push_back({end1, static_cast<unsigned int>(seq1->size()), end2, static_cast<unsigned int>(seq2->size()),
+		anchors.empty(), true});
+}
+
+double AnchoredForwardPairHMM::segmentLikelihood(const Segment& seg, vector<double>& buffer)
+{
+	const double minLnl = Definitions::minMatrixLikelihood;
+
+	const double mm = M->getTransitionProbabilityFromMatch();
+	const double mx = M->getTransitionProbabilityFromInsert();
+	const double my = M->getTransitionProbabilityFromDelete();
+	const double xm = X->getTransitionProbabilityFromMatch();
+	const double xx = X->getTransitionProbabilityFromInsert();
+	const double xy = X->getTransitionProbabilityFromDelete();
+	const double ym = Y->getTransitionProbabilityFromMatch();
+	const double yx = Y->getTransitionProbabilityFromInsert();
+	const double yy = Y->getTransitionProbabilityFromDelete();
+
+	unsigned int rows = seg.to1 - seg.from1 + 1;
+	unsigned int cols = seg.to2 - seg.from2 + 1;
+
+	//two rows for each state
+	buffer.resize(6*cols);
+	double* prevM = buffer.data();
+	double* prevX = prevM + cols;
+	double* prevY = prevX + cols;
+	double* curM = prevY + cols;
+	double* curX = curM + cols;
+	double* curY = curX + cols;
+
+	for (unsigned int i = 0; i < rows; i++)
+	{
+		for (unsigned int j = 0; j < cols; j++)
+		{
+			if (i == 0 && j == 0)
+			{
+				curM[0] = seg.fromStart ? piM : 0;
+				curX[0] = seg.fromStart ? piI : minLnl;
+				curY[0] = seg.fromStart ? piD : minLnl;
+				continue;
+			}
+
+			curX[j] = curY[j] = curM[j] = minLnl;
+
+			if (i > 0)
+			{
+				curX[j] = ptmatrix->getLogEquilibriumFreqClass((*seq1)[seg.from1+i-1]) +
+						logSum(prevM[j] + xm, prevX[j] + xx, prevY[j] + xy);
+			}
+			if (j > 0)
+			{
+				curY[j] = ptmatrix->getLogEquilibriumFreqClass((*seq2)[seg.from2+j-1]) +
+						logSum(curM[j-1] + ym, curX[j-1] + yx, curY[j-1] + yy);
+			}
+			if (i > 0 && j > 0)
+			{
+				curM[j] = ptmatrix->getLogPairTransitionClass((*seq1)[seg.from1+i-1], (*seq2)[seg.from2+j-1]) +
+						logSum(prevM[j-1] + mm, prevX[j-1] + mx, prevY[j-1] + my);
+			}
+		}
+		std::swap(prevM, curM);
+		std::swap(prevX, curX);
+		std::swap(prevY, curY);
+	}
+
+	//last row is in prev after the swap
+	unsigned int last = cols - 1;
+	if (seg.toEnd)
+		return logSum(prevM[last], prevX[last], prevY[last]) + log(xi);
+	else
+		return logSum(prevM[last] + mm, prevX[last] + mx, prevY[last] + my);
+}
+
+double AnchoredForwardPairHMM::anchorLikelihood()
+{
+	double lnl = 0;
+	double mm = M->getTransitionProbabilityFromMatch();
+
+	//the transition into the first match of an anchor belongs to the preceding segment
+	for (auto& anchor : anchors)
+	{
+		for (unsigned int t = 0; t < anchor.length; t++)
+		{
+			lnl += ptmatrix->getLogPairTransitionClass((*seq1)[anchor.pos1+t], (*seq2)[anchor.pos2+t]);
+			if (t > 0)
+				lnl += mm;
+		}
+	}
+	return lnl;
+}
+
+double AnchoredForwardPairHMM::runAlgorithm()
+{
+	if (!xSize or !ySize) {
+		throw HmmException("Tried to run AnchoredForwardPairHMM::runAlgorithm() without a valid pair of sequences.");
+	}
+
+	vector<double> results(segments.size());
+	unsigned long cells = 0;
+
+	for (auto& seg : segments)
+		cells += static_cast<unsigned long>(seg.to1 - seg.from1 + 1) * (seg.to2 - seg.from2 + 1);
+
+	unsigned int workers = std::min<unsigned int>(threadCount, segments.size());
+	if (cells < Definitions::anchoredForwardMinParallelCells)
+		workers = 1;
+
+	if (workers <= 1)
+	{
+		vector<double> buffer;
+		for (unsigned int s = 0; s < segments.size(); s++)
+			results[s] = segmentLikelihood(segments[s], buffer);
+	}
+	else
+	{
+		std::atomic<unsigned int> next(0);
+		vector<std::thread> threads;
+
+		for (unsigned int w = 0; w < workers; w++)
+		{
+			threads.emplace_back([this, &next, &results]()
+			{
+				vector<double> buffer;
+				unsigned int s;
+				while ((s = next++) < segments.size())
+					results[s] = segmentLikelihood(segments[s], buffer);
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	double sS = anchorLikelihood();
+	for (double lnl : results)
+		sS += lnl;
+
+	this->setTotalLikelihood(sS);
+
+	DUMP ("Anchored forward lnL " << sS << " from " << segments.size() << " segments");
+
+	return sS* -1.0;
+}
+
+} /* namespace EBC */
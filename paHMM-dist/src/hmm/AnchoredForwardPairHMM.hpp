@@ -0,0 +1,90 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+
+#ifndef ANCHOREDFORWARDPAIRHMM_HPP_
+#define ANCHOREDFORWARDPAIRHMM_HPP_
+
+#include "hmm/EvolutionaryPairHMM.hpp"
+#include "heuristics/AnchorBandCalculator.hpp"
+
+#include <vector>
+
+namespace EBC
+{
+
+//Approximate Forward for long, similar pairs. Long unique exact matches are forced to align
+//as matches, which splits the DP into independent sub-problems between consecutive anchors.
+//The sub-problems run in parallel and their log-likelihoods are added to those of the anchors.
+//Without anchors the result equals the unbanded Forward likelihood.
+class AnchoredForwardPairHMM: public EBC::EvolutionaryPairHMM
+{
+protected:
+
+	struct Segment
+	{
+		//half-open ranges in both sequences
+		unsigned int from1, to1;
+		unsigned int from2, to2;
+		//starts at the alignment start, otherwise right after a forced match
+		bool fromStart;
+		//finishes the alignment, otherwise followed by a forced match
+		bool toEnd;
+	};
+
+	vector<Segment> segments;
+
+	//forced match regions, runs already trimmed
+	vector<AnchorBandCalculator::AnchorRun> anchors;
+
+	unsigned int threadCount;
+
+	void buildSegments(unsigned int kmerSize, unsigned int minAnchorLength);
+
+	//forward log-likelihood of a single sub-problem, buffer is reused between calls
+	double segmentLikelihood(const Segment& seg, vector<double>& buffer);
+
+	double anchorLikelihood();
+
+public:
+	AnchoredForwardPairHMM(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2,
+			SubstitutionModelBase* smdl, IndelModel* imdl, unsigned int kmerSize,
+			unsigned int minAnchorLength = Definitions::anchoredForwardMinRun);
+
+	virtual ~AnchoredForwardPairHMM();
+
+	double runAlgorithm();
+
+	//0 uses all hardware threads
+	void setThreadCount(unsigned int threads);
+
+	unsigned int getAnchorCount()
+	{
+		return anchors.size();
+	}
+
+	unsigned int getSegmentCount()
+	{
+		return segments.size();
+	}
+};
+
+} /* namespace EBC */
+#endif /* ANCHOREDFORWARDPAIRHMM_HPP_ */
@@ -105,6 +105,90 @@ void BackwardPairHMM::calculatePosteriors(ForwardPairHMM* fwd)
 */
 }
 
+void BackwardPairHMM::calculatePosteriorBand(ForwardPairHMM* fwd, Band* band, double limit, vector<PosteriorCell>* sparse)
+{
+	DEBUG("Calculating the posterior band");
+
+	//posterior >= limit  <=>  backward + forward >= limit + total forward
+	double target = limit + fwd->getTotalLikelihood();
+
+	array<PairwiseHmmStateBase*, 3> bwdStates = {{M, X, Y}};
+	array<PairwiseHmmStateBase*, 3> fwdStates = {{fwd->getM(), fwd->getX(), fwd->getY()}};
+	array<Definitions::StateId, 3> ids = {{Definitions::StateId::Match, Definitions::StateId::Insert, Definitions::StateId::Delete}};
+	array<pair<int, int>, 3> ranges;
+
+	for (unsigned int col = 0; col < ySize; col++)
+	{
+		ranges[0] = band->getMatchRangeAt(col);
+		ranges[1] = band->getInsertRangeAt(col);
+		ranges[2] = band->getDeleteRangeAt(col);
+
+		for (unsigned int s = 0; s < bwdStates.size(); s++)
+		{
+			PairwiseHmmStateBase* b = bwdStates[s];
+			PairwiseHmmStateBase* f = fwdStates[s];
+			//outside the band the forward values are never calculated; the first row and
+			//column keep plain backward values
+			auto reaches = [&](int row) -> bool
+			{
+				if (row == 0 || col == 0)
+					return b->getValueAt(row, col) >= limit;
+				return b->getValueAt(row, col) + f->getValueAt(row, col) >= target;
+			};
+
+			int lo = -1, hi = -1;
+			int first = max(ranges[s].first, 0);
+			int last = min(ranges[s].second, static_cast<int>(xSize) - 1);
+
+			if (ranges[s].first < 0)
+			{
+				last = -1;
+			}
+
+			if (sparse == nullptr)
+			{
+				//only the edges of the range matter, scan in from both ends
+				int row = first;
+				while (row <= last && !reaches(row))
+					row++;
+				if (row <= last)
+				{
+					lo = row;
+					row = last;
+					while (row > lo && !reaches(row))
+						row--;
+					if (row > 0)
+						hi = row;
+				}
+			}
+			else
+			{
+				for (int row = first; row <= last; row++)
+				{
+					if (!reaches(row))
+						continue;
+					double lnl = (row == 0 || col == 0) ? b->getValueAt(row, col) :
+							b->getValueAt(row, col) + f->getValueAt(row, col) - fwd->getTotalLikelihood();
+					sparse->push_back({static_cast<unsigned int>(row), col, ids[s], lnl});
+					if (lo < 0)
+						lo = row;
+					if (row > 0)
+						hi = row;
+				}
+			}
+			ranges[s] = make_pair(lo, hi);
+		}
+
+		band->setMatchRangeAt(col, ranges[0].first, ranges[0].second);
+		band->setInsertRangeAt(col, ranges[1].first, ranges[1].second);
+		band->setDeleteRangeAt(col, ranges[2].first, ranges[2].second);
+
+		DUMP("Match/Ins/Del bands for column " << col << "\t" << ranges[0].first << "\t" << ranges[0].second
+				<< "\t" << ranges[1].first << "\t" << ranges[1].second
+				<< "\t" << ranges[2].first << "\t" << ranges[2].second);
+	}
+}
+
 
 
 double BackwardPairHMM::runAlgorithm()
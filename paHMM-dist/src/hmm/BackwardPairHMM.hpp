@@ -28,6 +28,15 @@
 namespace EBC
 {
 
+//log posterior of a single cell, for sparse posterior output
+struct PosteriorCell
+{
+	unsigned int row;
+	unsigned int col;
+	Definitions::StateId state;
+	double lnl;
+};
+
 class BackwardPairHMM: public EBC::EvolutionaryPairHMM
 {
 
@@ -55,6 +64,11 @@ public:
 
 	void calculatePosteriors(ForwardPairHMM* fwd);
 
+	//narrows every column of band to the rows whose log posterior reaches limit, looking only
+	//inside the band and leaving the dp matrices untouched; cells at or above limit are
+	//appended to sparse when given
+	void calculatePosteriorBand(ForwardPairHMM* fwd, Band* band, double limit, vector<PosteriorCell>* sparse = nullptr);
+
 	void calculateMaximumPosteriorMatrix();
 
 	//maximum posteriori alignment
@@ -0,0 +1,329 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+#include "hmm/StripedViterbiPairHMM.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace EBC
+{
+
+static const unsigned int laneCount = 4;
+
+#if defined(__SSE2__)
+
+//wrapped so that containers keep the alignment of the register type
+struct Lanes
+{
+	__m128 v;
+};
+
+static inline Lanes lanesSet(float x)
+{
+	return {_mm_set1_ps(x)};
+}
+
+static inline Lanes lanesLoad(const float* p)
+{
+	return {_mm_loadu_ps(p)};
+}
+
+static inline Lanes lanesAdd(Lanes a, Lanes b)
+{
+	return {_mm_add_ps(a.v, b.v)};
+}
+
+static inline Lanes lanesMax(Lanes a, Lanes b)
+{
+	return {_mm_max_ps(a.v, b.v)};
+}
+
+//every lane takes the value of the lane to its left, the first lane takes first
+static inline Lanes lanesShift(Lanes a, float first)
+{
+	__m128 shifted = _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(a.v), sizeof(float)));
+	return {_mm_move_ss(shifted, _mm_set_ss(first))};
+}
+
+static inline bool lanesAnyGreater(Lanes a, Lanes b)
+{
+	return _mm_movemask_ps(_mm_cmpgt_ps(a.v, b.v)) != 0;
+}
+
+#else
+
+//portable fallback with the same semantics
+struct Lanes
+{
+	float v[laneCount];
+};
+
+static inline Lanes lanesSet(float x)
+{
+	Lanes r;
+	for (unsigned int k = 0; k < laneCount; k++)
+		r.v[k] = x;
+	return r;
+}
+
+static inline Lanes lanesLoad(const float* p)
+{
+	Lanes r;
+	for (unsigned int k = 0; k < laneCount; k++)
+		r.v[k] = p[k];
+	return r;
+}
+
+static inline Lanes lanesAdd(Lanes a, Lanes b)
+{
+	for (unsigned int k = 0; k < laneCount; k++)
+		a.v[k] += b.v[k];
+	return a;
+}
+
+static inline Lanes lanesMax(Lanes a, Lanes b)
+{
+	for (unsigned int k = 0; k < laneCount; k++)
+		a.v[k] = std::max(a.v[k], b.v[k]);
+	return a;
+}
+
+static inline Lanes lanesShift(Lanes a, float first)
+{
+	for (unsigned int k = laneCount - 1; k > 0; k--)
+		a.v[k] = a.v[k-1];
+	a.v[0] = first;
+	return a;
+}
+
+static inline bool lanesAnyGreater(Lanes a, Lanes b)
+{
+	for (unsigned int k = 0; k < laneCount; k++)
+		if (a.v[k] > b.v[k])
+			return true;
+	return false;
+}
+
+#endif
+
+static inline float laneAt(Lanes a, unsigned int k)
+{
+	float values[laneCount];
+	std::memcpy(values, &a, sizeof(values));
+	return values[k];
+}
+
+static inline Lanes lanesMax(Lanes a, Lanes b, Lanes c)
+{
+	return lanesMax(lanesMax(a, b), c);
+}
+
+StripedViterbiPairHMM::StripedViterbiPairHMM(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2,
+		SubstitutionModelBase* smdl, IndelModel* imdl) :
+		EvolutionaryPairHMM(s1,s2, smdl, imdl, Definitions::DpMatrixType::Limited, nullptr, false)
+{
+	segmentLength = (seq2->size() + laneCount - 1) / laneCount;
+	if (segmentLength == 0)
+		segmentLength = 1;
+
+	//elements come from the dictionary, equal symbols share a pointer
+	unordered_map<SequenceElement*, unsigned int> distinct;
+	profileOfRow.reserve(seq1->size());
+	for (SequenceElement* el : *seq1)
+	{
+		auto it = distinct.find(el);
+		if (it == distinct.end())
+		{
+			it = distinct.emplace(el, profileElements.size()).first;
+			profileElements.push_back(el);
+		}
+		profileOfRow.push_back(it->second);
+	}
+	DEBUG("Striped Viterbi with " << segmentLength << " vectors per row and " << profileElements.size() << " profiles");
+}
+
+StripedViterbiPairHMM::~StripedViterbiPairHMM()
+{
+}
+
+void StripedViterbiPairHMM::buildProfiles()
+{
+	unsigned int stripe = segmentLength * laneCount;
+
+	//column c is lane c / segmentLength of vector c % segmentLength
+	profiles.resize(profileElements.size() * stripe);
+	for (unsigned int p = 0; p < profileElements.size(); p++)
+	{
+		float* profile = profiles.data() + p * stripe;
+		for (unsigned int c = 0; c < stripe; c++)
+		{
+			profile[(c % segmentLength) * laneCount + c / segmentLength] = c < seq2->size() ?
+					ptmatrix->getLogPairTransitionClass(profileElements[p], (*seq2)[c]) : Definitions::minMatrixLikelihood;
+		}
+	}
+}
+
+double StripedViterbiPairHMM::runAlgorithm()
+{
+	if (!seq1 or !seq2) {
+		throw HmmException("Tried to run StripedViterbiPairHMM::runAlgorithm() without a valid pair of sequences.");
+	}
+
+	const float minLnl = Definitions::minMatrixLikelihood;
+	const unsigned int segLen = segmentLength;
+	const unsigned int cols = seq2->size();
+
+	//column 0 is scalar, the rest runs on vectors of the same transitions
+	const float xmScalar = X->getTransitionProbabilityFromMatch();
+	const float xxScalar = X->getTransitionProbabilityFromInsert();
+	const float xyScalar = X->getTransitionProbabilityFromDelete();
+	const Lanes mm = lanesSet(M->getTransitionProbabilityFromMatch());
+	const Lanes mx = lanesSet(M->getTransitionProbabilityFromInsert());
+	const Lanes my = lanesSet(M->getTransitionProbabilityFromDelete());
+	const Lanes xm = lanesSet(xmScalar);
+	const Lanes xx = lanesSet(xxScalar);
+	const Lanes xy = lanesSet(xyScalar);
+	const Lanes ym = lanesSet(Y->getTransitionProbabilityFromMatch());
+	const Lanes yx = lanesSet(Y->getTransitionProbabilityFromInsert());
+	const Lanes yy = lanesSet(Y->getTransitionProbabilityFromDelete());
+
+	buildProfiles();
+
+	//delete emissions, for opening from match or insert and for extending a delete
+	vector<Lanes> emitY(segLen), extendY(segLen);
+	{
+		vector<float> stripe(segLen * laneCount);
+		for (unsigned int c = 0; c < stripe.size(); c++)
+			stripe[(c % segLen) * laneCount + c / segLen] = c < cols ?
+					ptmatrix->getLogEquilibriumFreqClass((*seq2)[c]) : minLnl;
+		for (unsigned int s = 0; s < segLen; s++)
+		{
+			emitY[s] = lanesLoad(&stripe[s * laneCount]);
+			extendY[s] = lanesAdd(emitY[s], yy);
+		}
+	}
+
+	//two rows for each state, column 0 is kept apart as scalars
+	vector<Lanes> buffer(6 * segLen, lanesSet(minLnl));
+	Lanes* prevM = buffer.data();
+	Lanes* prevX = prevM + segLen;
+	Lanes* prevY = prevX + segLen;
+	Lanes* curM = prevY + segLen;
+	Lanes* curX = curM + segLen;
+	Lanes* curY = curX + segLen;
+	float prevM0 = minLnl, prevX0 = minLnl, prevY0 = minLnl;
+	float curM0, curX0, curY0;
+
+	for (unsigned int i = 0; i < xSize; i++)
+	{
+		if (i == 0)
+		{
+			curM0 = piM;
+			curX0 = piI;
+			curY0 = piD;
+		}
+		else
+		{
+			float emissionX = ptmatrix->getLogEquilibriumFreqClass((*seq1)[i-1]);
+			curM0 = curY0 = minLnl;
+			curX0 = emissionX + std::max({prevM0 + xmScalar, prevX0 + xxScalar, prevY0 + xyScalar});
+
+			//match from the diagonal, insert from the cell above; both only need the previous row
+			const float* profile = profiles.data() + profileOfRow[i-1] * segLen * laneCount;
+			Lanes vEX = lanesSet(emissionX);
+			Lanes dM = lanesShift(prevM[segLen-1], prevM0);
+			Lanes dX = lanesShift(prevX[segLen-1], prevX0);
+			Lanes dY = lanesShift(prevY[segLen-1], prevY0);
+			for (unsigned int s = 0; s < segLen; s++)
+			{
+				curM[s] = lanesAdd(lanesLoad(profile + s * laneCount), lanesMax(lanesAdd(dM, mm), lanesAdd(dX, mx), lanesAdd(dY, my)));
+				curX[s] = lanesAdd(vEX, lanesMax(lanesAdd(prevM[s], xm), lanesAdd(prevX[s], xx), lanesAdd(prevY[s], xy)));
+				dM = prevM[s];
+				dX = prevX[s];
+				dY = prevY[s];
+			}
+		}
+
+		//delete from the cell to the left; each lane first starts from nothing instead of
+		//the end of the lane before it
+		Lanes hM = lanesShift(curM[segLen-1], curM0);
+		Lanes hX = lanesShift(curX[segLen-1], curX0);
+		Lanes vY = lanesShift(lanesSet(minLnl), curY0);
+		for (unsigned int s = 0; s < segLen; s++)
+		{
+			Lanes open = lanesAdd(emitY[s], lanesMax(lanesAdd(hM, ym), lanesAdd(hX, yx)));
+			vY = lanesMax(open, lanesAdd(vY, extendY[s]));
+			curY[s] = vY;
+			hM = curM[s];
+			hX = curX[s];
+		}
+
+		//lazy correction, every pass carries the delete chain over one more lane boundary
+		//and stops as soon as it no longer improves any cell
+		for (unsigned int pass = 1; pass < laneCount; pass++)
+		{
+			unsigned int s = 0;
+			vY = lanesShift(curY[segLen-1], curY0);
+			for (; s < segLen; s++)
+			{
+				Lanes extended = lanesAdd(vY, extendY[s]);
+				if (!lanesAnyGreater(extended, curY[s]))
+					break;
+				curY[s] = lanesMax(curY[s], extended);
+				vY = curY[s];
+			}
+			if (s < segLen)
+				break;
+		}
+
+		std::swap(prevM, curM);
+		std::swap(prevX, curX);
+		std::swap(prevY, curY);
+		prevM0 = curM0;
+		prevX0 = curX0;
+		prevY0 = curY0;
+	}
+
+	//last row is in prev after the swap
+	double sM = prevM0, sX = prevX0, sY = prevY0;
+	if (cols > 0)
+	{
+		unsigned int s = (cols - 1) % segLen, lane = (cols - 1) / segLen;
+		sM = laneAt(prevM[s], lane);
+		sX = laneAt(prevX[s], lane);
+		sY = laneAt(prevY[s], lane);
+	}
+
+	double sS = std::max({sM, sX, sY}) + log(xi);
+
+	this->setTotalLikelihood(sS);
+
+	DUMP ("Striped Viterbi lnls I, D, M, Total " << sX << "\t" << sY << "\t" << sM << "\t" << sS);
+
+	return sS* -1.0;
+}
+
+} /* namespace EBC */
@@ -0,0 +1,61 @@
+//==============================================================================
+// Pair-HMM phylogenetic tree estimator
+// 
+// Copyright (c) 2015-2019 Marcin Bogusz.
+//               2020 Mazen Mardini for library wrapper compatibility.
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+//     This program is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses>.
+//==============================================================================
+
+#ifndef STRIPEDVITERBIPAIRHMM_HPP_
+#define STRIPEDVITERBIPAIRHMM_HPP_
+
+#include "hmm/EvolutionaryPairHMM.hpp"
+
+#include <vector>
+
+namespace EBC
+{
+
+//Viterbi (max-plus) log-likelihood of the best alignment in linear memory and without
+//traceback. The second sequence is striped across SIMD lanes (Farrar 2007): a row of the
+//DP is a few vectors, match and insert cells of a row are independent, and the delete
+//chain along the row is completed by a lazy correction pass. Scores are single precision,
+//so the likelihood is a fast and slightly lower approximation of the Forward one.
+class StripedViterbiPairHMM: public EBC::EvolutionaryPairHMM
+{
+protected:
+
+	//vectors per row
+	unsigned int segmentLength;
+
+	//match emissions of each distinct element of the first sequence against the whole
+	//second sequence, in striped order
+	vector<float> profiles;
+	vector<unsigned int> profileOfRow;
+	vector<SequenceElement*> profileElements;
+
+	void buildProfiles();
+
+public:
+	StripedViterbiPairHMM(vector<SequenceElement*>* s1, vector<SequenceElement*>* s2,
+			SubstitutionModelBase* smdl, IndelModel* imdl);
+
+	virtual ~StripedViterbiPairHMM();
+
+	double runAlgorithm();
+};
+
+} /* namespace EBC */
+#endif /* STRIPEDVITERBIPAIRHMM_HPP_ */
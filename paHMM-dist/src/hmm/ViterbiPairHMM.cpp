@@ -165,7 +165,8 @@ double ViterbiPairHMM::runAlgorithm()
 	DUMP("Final Viterbi X  " << mx );
 	DUMP("Final Viterbi Y  " << my );
 
-return (std::max(mm,std::max(mx,my)))*-1.0;
+	//end transition like in the forward algorithm, so that all engines report comparable lnLs
+	return (std::max(mm,std::max(mx,my)) + log(xi))*-1.0;
 }
 
 
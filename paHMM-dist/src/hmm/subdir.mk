@@ -1,5 +1,6 @@
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
+../src/hmm/AnchoredForwardPairHMM.cpp \
 ../src/hmm/BackwardPairHMM.cpp \
 ../src/hmm/DpMatrixFull.cpp \
 ../src/hmm/DpMatrixLoMem.cpp \
@@ -8,9 +9,11 @@ CPP_SRCS += \
 ../src/hmm/PairwiseHmmDeleteState.cpp \
 ../src/hmm/PairwiseHmmInsertState.cpp \
 ../src/hmm/PairwiseHmmMatchState.cpp \
+../src/hmm/StripedViterbiPairHMM.cpp \
 ../src/hmm/ViterbiPairHMM.cpp 
 
 OBJS += \
+./src/hmm/AnchoredForwardPairHMM.o \
 ./src/hmm/BackwardPairHMM.o \
 ./src/hmm/DpMatrixFull.o \
 ./src/hmm/DpMatrixLoMem.o \
@@ -19,9 +22,11 @@ OBJS += \
 ./src/hmm/PairwiseHmmDeleteState.o \
 ./src/hmm/PairwiseHmmInsertState.o \
 ./src/hmm/PairwiseHmmMatchState.o \
+./src/hmm/StripedViterbiPairHMM.o \
 ./src/hmm/ViterbiPairHMM.o 
 
 CPP_DEPS += \
+./src/hmm/AnchoredForwardPairHMM.d \
 ./src/hmm/BackwardPairHMM.d \
 ./src/hmm/DpMatrixFull.d \
 ./src/hmm/DpMatrixLoMem.d \
@@ -30,6 +35,7 @@ CPP_DEPS += \
 ./src/hmm/PairwiseHmmDeleteState.d \
 ./src/hmm/PairwiseHmmInsertState.d \
 ./src/hmm/PairwiseHmmMatchState.d \
+./src/hmm/StripedViterbiPairHMM.d \
 ./src/hmm/ViterbiPairHMM.d 
 
 
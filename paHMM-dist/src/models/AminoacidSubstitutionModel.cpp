@@ -24,8 +24,12 @@
 namespace EBC
 {
 
+map<vector<double>, shared_ptr<const SubstitutionModelBase::EigenSystem> > AminoacidSubstitutionModel::sharedEigenSystems;
+mutex AminoacidSubstitutionModel::sharedEigenMutex;
+
 AminoacidSubstitutionModel::AminoacidSubstitutionModel(Dictionary* dict, Maths* alg, unsigned int alpha, Definitions::aaModelDefinition modelDef) :
-	SubstitutionModelBase(dict,alg,alpha, Definitions::AAParamCount), eigenDecomposed(false)
+	SubstitutionModelBase(dict,alg,alpha, Definitions::AAParamCount),
+	exchangeabilities(modelDef.aaRates, modelDef.aaRates + dict->getAlphabetSize()*dict->getAlphabetSize())
 {
 	//FIXME - implement +F model with custom frequencies
 
@@ -53,12 +57,48 @@ AminoacidSubstitutionModel::AminoacidSubstitutionModel(Dictionary* dict, Maths*
 
 void AminoacidSubstitutionModel::calculateModel()
 {
-	if(this->eigenDecomposed == false)
+	vector<double> key(exchangeabilities);
+	key.insert(key.end(), piFreqs, piFreqs + matrixSize);
+	if (key == modelKey)
+		return;
+
+	shared_ptr<const EigenSystem> system;
+	{
+		lock_guard<mutex> lock(sharedEigenMutex);
+		auto it = sharedEigenSystems.find(key);
+		if (it != sharedEigenSystems.end())
+			system = it->second;
+	}
+
+	if (system)
+	{
+		std::copy(system->q.begin(), system->q.end(), qMatrix);
+		std::copy(system->u.begin(), system->u.end(), uMatrix);
+		std::copy(system->v.begin(), system->v.end(), vMatrix);
+		std::copy(system->roots.begin(), system->roots.end(), roots);
+		meanRate = system->meanRate;
+		bumpRevision();
+	}
+	else
 	{
+		std::copy(exchangeabilities.begin(), exchangeabilities.end(), this->qMatrix);
 		this->setDiagonalMeans();
 		this->doEigenDecomposition();
-		eigenDecomposed=true;
+
+		auto entry = make_shared<EigenSystem>();
+		entry->key = key;
+		entry->q.assign(qMatrix, qMatrix + matrixFullSize);
+		entry->u.assign(uMatrix, uMatrix + matrixFullSize);
+		entry->v.assign(vMatrix, vMatrix + matrixFullSize);
+		entry->roots.assign(roots, roots + matrixSize);
+		entry->meanRate = meanRate;
+
+		lock_guard<mutex> lock(sharedEigenMutex);
+		if (sharedEigenSystems.size() >= Definitions::eigenCacheEntries)
+			sharedEigenSystems.clear();
+		sharedEigenSystems.emplace(key, entry);
 	}
+	modelKey = key;
 	//calculateGammaPtMatrices();
 }
 
@@ -27,6 +27,9 @@
 #include "models/SubstitutionModelBase.hpp"
 #include "core/Maths.hpp"
 #include <cmath>
+#include <map>
+#include <mutex>
+#include <memory>
 
 namespace EBC
 {
@@ -35,7 +38,16 @@ class AminoacidSubstitutionModel : public EBC::SubstitutionModelBase
 {
 protected:
 
-	bool eigenDecomposed;
+	//eigen systems shared by all instances, keyed by exchangeabilities and frequencies -
+	//the estimators and the banding estimator decompose the same empirical model once
+	static map<vector<double>, shared_ptr<const EigenSystem> > sharedEigenSystems;
+	static mutex sharedEigenMutex;
+
+	//empirical exchangeabilities, setDiagonalMeans rescales qMatrix in place
+	vector<double> exchangeabilities;
+
+	//exchangeabilities and frequencies of the loaded eigen system
+	vector<double> modelKey;
 
 	double maxRate;
 
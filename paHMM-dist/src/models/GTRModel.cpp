@@ -61,6 +61,22 @@ void GTRModel::buildSmatrix() {
 
 }
 
+void GTRModel::getExchangeabilityDerivative(unsigned int param, double* dS)
+{
+	int s = this->matrixSize;
+	int i,j,k;
+
+	std::fill(dS, dS+matrixFullSize, 0.0);
+	//same pair order as buildSmatrix
+	for(i=0,k=0; i<s-1; i++) for (j=i+1; j<s; j++)
+		if(i*s+j != 2*s+3)
+		{
+			if (k == (int)param)
+				dS[i*s+j] = dS[j*s+i] = 1.0;
+			k++;
+		}
+}
+
 void GTRModel::summarize()
 {
 	cout << endl << "REV model summary:" << endl;
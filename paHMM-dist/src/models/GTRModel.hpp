@@ -42,6 +42,8 @@ public:
 	void summarize();
 
 	void setParameters(const vector<double>&);
+
+	void getExchangeabilityDerivative(unsigned int param, double* dS);
 };
 
 } /* namespace EBC */
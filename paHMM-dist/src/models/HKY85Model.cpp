@@ -56,6 +56,101 @@ void HKY85Model::buildSmatrix() {
 
 }
 
+void HKY85Model::getExchangeabilityDerivative(unsigned int /*param*/, double* dS)
+{
+	std::fill(dS, dS+matrixFullSize, 0.0);
+	dS[1] = dS[4] = dS[11] = dS[14] = 1.0;
+}
+
+void HKY85Model::calculateModel()
+{
+	vector<double> key;
+	getEigenKey(key);
+	if (key == modelKey)
+		return;
+
+	//Q is still built for summaries, its mean rate gives the scaling
+	this->buildSmatrix();
+	this->setDiagonalMeans();
+
+	beta = 1.0 / meanRate;
+	groupFreqs[0] = piFreqs[0] + piFreqs[1];
+	groupFreqs[1] = piFreqs[2] + piFreqs[3];
+	groupRoots[0] = -beta * (groupFreqs[0] * parameters[0] + groupFreqs[1]);
+	groupRoots[1] = -beta * (groupFreqs[1] * parameters[0] + groupFreqs[0]);
+
+	modelKey = key;
+	bumpRevision();
+}
+
+void HKY85Model::combineTerms(double c0, double transversion, const double* groups, double* pt)
+{
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		unsigned int group = i / 2;
+		for (unsigned int j = 0; j < 4; j++)
+		{
+			if (j / 2 != group)
+			{
+				pt[i*4+j] = piFreqs[j] * (c0 - transversion);
+			}
+			else
+			{
+				double same = (i == j ? groupFreqs[group] : 0.0);
+				pt[i*4+j] = c0 * piFreqs[j] + piFreqs[j] * (1.0/groupFreqs[group] - 1.0) * transversion +
+						((same - piFreqs[j]) / groupFreqs[group]) * groups[group];
+			}
+		}
+	}
+}
+
+void HKY85Model::calculatePt(double t, unsigned int rateCategory, double* pt, double* /*workspace*/)
+{
+	double tau = t * gammaRates[rateCategory];
+	double groups[2] = {exp(groupRoots[0]*tau), exp(groupRoots[1]*tau)};
+	combineTerms(1.0, exp(-beta*tau), groups, pt);
+}
+
+void HKY85Model::calculateGammaPt(double t, double* pt, double* /*workspace*/)
+{
+	double c0 = 0, transversion = 0;
+	double groups[2] = {0, 0};
+	for (unsigned int r = 0; r < rateCategories; r++)
+	{
+		double tau = t * gammaRates[r];
+		c0 += gammaFrequencies[r];
+		transversion += gammaFrequencies[r] * exp(-beta*tau);
+		groups[0] += gammaFrequencies[r] * exp(groupRoots[0]*tau);
+		groups[1] += gammaFrequencies[r] * exp(groupRoots[1]*tau);
+	}
+	combineTerms(c0, transversion, groups, pt);
+}
+
+void HKY85Model::calculatePtDerivative(double t, unsigned int rateCategory, double* dpt, double* /*workspace*/)
+{
+	double rate = gammaRates[rateCategory];
+	double tau = t * rate;
+	double groups[2] = {rate * groupRoots[0] * exp(groupRoots[0]*tau), rate * groupRoots[1] * exp(groupRoots[1]*tau)};
+	combineTerms(0.0, -rate * beta * exp(-beta*tau), groups, dpt);
+}
+
+void HKY85Model::calculateRateDerivativeBasis(unsigned int /*param*/, double* basis, double* /*workspace*/)
+{
+	//mean rate is 2 kappa (piT piC + piA piG) + 2 piY piR
+	double dBeta = -beta * beta * 2 * (piFreqs[0]*piFreqs[1] + piFreqs[2]*piFreqs[3]);
+	basis[0] = dBeta;
+	basis[1] = -dBeta * (groupFreqs[0] * parameters[0] + groupFreqs[1]) - beta * groupFreqs[0];
+	basis[2] = -dBeta * (groupFreqs[1] * parameters[0] + groupFreqs[0]) - beta * groupFreqs[1];
+}
+
+void HKY85Model::calculatePtParameterDerivative(double t, unsigned int rateCategory, const double* basis,
+		double* dpt, double* /*workspace*/)
+{
+	double tau = t * gammaRates[rateCategory];
+	double groups[2] = {tau * basis[1] * exp(groupRoots[0]*tau), tau * basis[2] * exp(groupRoots[1]*tau)};
+	combineTerms(0.0, -tau * basis[0] * exp(-beta*tau), groups, dpt);
+}
+
 void HKY85Model::summarize()
 {
 	INFO("HKY85 model summary:");
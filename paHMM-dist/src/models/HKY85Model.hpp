@@ -33,6 +33,19 @@ protected:
 
 double *k;
 
+//closed form P(t): transversions decay with exp(-beta t), transitions within the
+//pyrimidines (T C) and purines (A G) also with exp(groupRoots[group] t)
+double beta;
+double groupFreqs[2];
+double groupRoots[2];
+
+//parameters and frequencies of the current closed form
+vector<double> modelKey;
+
+//P_ij = c0 pi_j + terms of the transversion and per group exponentials; P(t), its gamma
+//average and all derivatives are linear combinations of these
+void combineTerms(double c0, double transversion, const double* groups, double* pt);
+
 
 public:
 	HKY85Model(Dictionary* dict, Maths* alg, unsigned int);
@@ -42,6 +55,25 @@ public:
 	void summarize();
 
 	void setParameters(const vector<double>&);
+
+	void getExchangeabilityDerivative(unsigned int param, double* dS);
+
+	//no eigen decomposition, only the closed form constants
+	void calculateModel();
+
+	using SubstitutionModelBase::calculatePt;
+
+	void calculatePt(double time, unsigned int rateCategory, double* pt, double* workspace);
+
+	void calculateGammaPt(double time, double* pt, double* workspace);
+
+	void calculatePtDerivative(double time, unsigned int rateCategory, double* dpt, double* workspace);
+
+	//basis holds dbeta/dkappa and d groupRoots/dkappa
+	void calculateRateDerivativeBasis(unsigned int param, double* basis, double* workspace);
+
+	void calculatePtParameterDerivative(double time, unsigned int rateCategory, const double* basis,
+			double* dpt, double* workspace);
 };
 
 } /* namespace EBC */
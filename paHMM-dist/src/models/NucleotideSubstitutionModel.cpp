@@ -32,9 +32,13 @@ NucleotideSubstitutionModel::NucleotideSubstitutionModel(Dictionary* dict, Maths
 
 void NucleotideSubstitutionModel::calculateModel()
 {
+	//objective evaluations that only move divergence times keep the parameters
+	if (this->restoreEigenSystem())
+		return;
 	this->buildSmatrix();
 	this->setDiagonalMeans();
 	this->doEigenDecomposition();
+	this->storeEigenSystem();
 }
 
 NucleotideSubstitutionModel::~NucleotideSubstitutionModel()
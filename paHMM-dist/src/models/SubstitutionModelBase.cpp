@@ -25,6 +25,8 @@
 namespace EBC
 {
 
+std::atomic<unsigned long> SubstitutionModelBase::revisionCounter(0);
+
 SubstitutionModelBase::SubstitutionModelBase(Dictionary* dict, Maths* alg, unsigned int rateCategories, unsigned int parameter_count)
 	: dictionary(dict), maths(alg), rateCategories(rateCategories), paramsNumber(parameter_count),
 	  parameterHiBounds(parameter_count), parameterLoBounds(parameter_count)
@@ -37,6 +39,8 @@ SubstitutionModelBase::SubstitutionModelBase(Dictionary* dict, Maths* alg, unsig
 	//no alpha provided
 	this->alpha = 0;
 	this->parameters = NULL;
+	this->ptCache = nullptr;
+	bumpRevision();
 }
 
 
@@ -91,19 +95,175 @@ void SubstitutionModelBase::doEigenDecomposition()
 	std::fill(vMatrix, vMatrix+matrixFullSize, 0);
 	std::fill(squareRoots, squareRoots+matrixFullSize, 0);
 	this->maths->eigenQREV(qMatrix, piFreqs, matrixSize, roots, uMatrix, vMatrix, squareRoots);
+	bumpRevision();
+}
+
+void SubstitutionModelBase::getEigenKey(vector<double>& key)
+{
+	key.assign(parameters, parameters + paramsNumber);
+	key.insert(key.end(), piFreqs, piFreqs + matrixSize);
+}
+
+bool SubstitutionModelBase::restoreEigenSystem()
+{
+	vector<double> key;
+	getEigenKey(key);
+
+	for (auto it = eigenCache.begin(); it != eigenCache.end(); it++)
+	{
+		if (it->key != key)
+			continue;
+		if (it != eigenCache.begin())
+		{
+			std::copy(it->q.begin(), it->q.end(), qMatrix);
+			std::copy(it->u.begin(), it->u.end(), uMatrix);
+			std::copy(it->v.begin(), it->v.end(), vMatrix);
+			std::copy(it->roots.begin(), it->roots.end(), roots);
+			meanRate = it->meanRate;
+			eigenCache.splice(eigenCache.begin(), eigenCache, it);
+			bumpRevision();
+		}
+		return true;
+	}
+	return false;
+}
+
+void SubstitutionModelBase::storeEigenSystem()
+{
+	EigenSystem entry;
+	getEigenKey(entry.key);
+	entry.q.assign(qMatrix, qMatrix + matrixFullSize);
+	entry.u.assign(uMatrix, uMatrix + matrixFullSize);
+	entry.v.assign(vMatrix, vMatrix + matrixFullSize);
+	entry.roots.assign(roots, roots + matrixSize);
+	entry.meanRate = meanRate;
+
+	eigenCache.push_front(std::move(entry));
+	if (eigenCache.size() > Definitions::eigenCacheEntries)
+		eigenCache.pop_back();
 }
 
 double* SubstitutionModelBase::calculatePt(double t, unsigned int rateCategory)
 {
-	double *tmpRoots, *tmpUroots, *matrix;
-	tmpRoots = maths->expLambdaT(roots, t*gammaRates[rateCategory], matrixSize);
-	tmpUroots = maths->matrixByDiagonalMultiply(uMatrix, tmpRoots, matrixSize);
-	matrix = this->maths->matrixMultiply(tmpUroots, vMatrix, matrixSize);
-	delete[] tmpRoots;
-	delete[] tmpUroots;
+	double* matrix = new double[matrixFullSize];
+	double* workspace = new double[getPtWorkspaceSize()];
+	calculatePt(t, rateCategory, matrix, workspace);
+	delete[] workspace;
 	return matrix;
 }
 
+void SubstitutionModelBase::calculatePt(double t, unsigned int rateCategory, double* pt, double* workspace)
+{
+	double* tmpRoots = workspace;
+	double* tmpUroots = workspace + matrixSize;
+	maths->expLambdaT(roots, t*gammaRates[rateCategory], matrixSize, tmpRoots);
+	maths->matrixByDiagonalMultiply(uMatrix, tmpRoots, matrixSize, tmpUroots);
+	maths->matrixMultiply(tmpUroots, vMatrix, matrixSize, pt);
+}
+
+void SubstitutionModelBase::calculateGammaPt(double t, double* pt, double* workspace)
+{
+	//sum_k f_k U exp(L t r_k) V = U (sum_k f_k exp(L t r_k)) V
+	double* gammaRoots = workspace;
+	double* tmpUroots = workspace + matrixSize;
+	for (unsigned int i = 0; i < matrixSize; i++)
+	{
+		gammaRoots[i] = 0;
+		for (unsigned int k = 0; k < rateCategories; k++)
+			gammaRoots[i] += gammaFrequencies[k] * exp(roots[i]*t*gammaRates[k]);
+	}
+	maths->matrixByDiagonalMultiply(uMatrix, gammaRoots, matrixSize, tmpUroots);
+	maths->matrixMultiply(tmpUroots, vMatrix, matrixSize, pt);
+}
+
+void SubstitutionModelBase::calculatePtDerivative(double t, unsigned int rateCategory, double* dpt, double* workspace)
+{
+	//d/dt U exp(L t r) V = U (r L exp(L t r)) V
+	double rate = gammaRates[rateCategory];
+	double* tmpRoots = workspace;
+	double* tmpUroots = workspace + matrixSize;
+	for (unsigned int i = 0; i < matrixSize; i++)
+		tmpRoots[i] = rate * roots[i] * exp(roots[i]*t*rate);
+	maths->matrixByDiagonalMultiply(uMatrix, tmpRoots, matrixSize, tmpUroots);
+	maths->matrixMultiply(tmpUroots, vMatrix, matrixSize, dpt);
+}
+
+void SubstitutionModelBase::calculateRateDerivativeBasis(unsigned int param, double* basis, double* workspace)
+{
+	unsigned int i,j;
+	double sum;
+	double dMeanRate = 0;
+	double* dQ = workspace;
+	double* tmp = workspace + matrixFullSize;
+
+	//same steps as setDiagonalMeans, differentiated: Q = Q0 / mu with Q0 = S diag(pi)
+	this->getExchangeabilityDerivative(param, dQ);
+	for (i=0; i< matrixSize; i++)
+	{
+		dQ[i*matrixSize+i] = 0;
+		sum = 0.0;
+		for (j=0; j < matrixSize; j++)
+		{
+			dQ[i*matrixSize + j] *= piFreqs[j];
+			sum -= dQ[i*matrixSize + j];
+		}
+		dQ[i*matrixSize + i] = sum;
+		dMeanRate -= sum*piFreqs[i];
+	}
+	for (i=0; i< matrixFullSize; i++)
+	{
+		dQ[i] = (dQ[i] - qMatrix[i]*dMeanRate) / meanRate;
+	}
+
+	maths->matrixMultiply(vMatrix, dQ, matrixSize, tmp);
+	maths->matrixMultiply(tmp, uMatrix, matrixSize, basis);
+}
+
+void SubstitutionModelBase::calculatePtParameterDerivative(double t, unsigned int rateCategory, const double* basis,
+		double* dpt, double* workspace)
+{
+	//dP = U (F o V dQ U) V with F_ij = (exp(l_i tau) - exp(l_j tau)) / (l_i - l_j)
+	double tau = t*gammaRates[rateCategory];
+	double* scaled = workspace;
+	double* tmp = workspace + matrixFullSize;
+	double diff, expj;
+
+	for (unsigned int i = 0; i < matrixSize; i++)
+	{
+		for (unsigned int j = 0; j < matrixSize; j++)
+		{
+			diff = roots[i] - roots[j];
+			expj = exp(roots[j]*tau);
+			if (fabs(diff) < Definitions::eigenvalueTolerance)
+				scaled[i*matrixSize+j] = basis[i*matrixSize+j] * tau * expj;
+			else
+				scaled[i*matrixSize+j] = basis[i*matrixSize+j] * expj * expm1(diff*tau) / diff;
+		}
+	}
+	maths->matrixMultiply(uMatrix, scaled, matrixSize, tmp);
+	maths->matrixMultiply(tmp, vMatrix, matrixSize, dpt);
+}
+
+void SubstitutionModelBase::calculateGammaDerivatives(double* dRates, double* dFrequencies)
+{
+	std::fill(dRates, dRates+rateCategories, 0.0);
+	std::fill(dFrequencies, dFrequencies+rateCategories, 0.0);
+	if(alpha <=0 || rateCategories == 1)
+		return;
+
+	//the discrete gamma has no closed form derivative - central differences
+	double step = alpha * Definitions::gammaDerivativeStep;
+	vector<double> ratesHi(rateCategories), ratesLo(rateCategories);
+	vector<double> freqsHi(rateCategories), freqsLo(rateCategories);
+	this->maths->DiscreteGamma(freqsHi.data(), ratesHi.data(), alpha+step, alpha+step, rateCategories, 0);
+	this->maths->DiscreteGamma(freqsLo.data(), ratesLo.data(), alpha-step, alpha-step, rateCategories, 0);
+	for (unsigned int k = 0; k < rateCategories; k++)
+	{
+		dRates[k] = (ratesHi[k] - ratesLo[k]) / (2*step);
+		dFrequencies[k] = (freqsHi[k] - freqsLo[k]) / (2*step);
+	}
+}
+
 void SubstitutionModelBase::setDiagonalMeans()
 {
 		unsigned int i,j;
@@ -167,6 +327,7 @@ void SubstitutionModelBase::calculateGamma()
 	{
 		this->maths->DiscreteGamma(gammaFrequencies, gammaRates, alpha, alpha, rateCategories, useMedian);
 	}
+	bumpRevision();
 }
 
 void SubstitutionModelBase::setObservedFrequencies(double* observedFrequencies)
@@ -184,6 +345,7 @@ void SubstitutionModelBase::setObservedFrequencies(double* observedFrequencies)
 	{
 		piLogFreqs[i] = log(piFreqs[i]);
 	}
+	bumpRevision();
 }
 
 double SubstitutionModelBase::getEquilibriumFrequencies(unsigned int xi)
@@ -28,15 +28,55 @@
 #include "core/HmmException.hpp"
 #include <cmath>
 #include <vector>
+#include <list>
+#include <atomic>
 
 namespace EBC
 {
 
+class PMatrixCache;
+
 class SubstitutionModelBase
 {
 
 protected:
 
+	//revisions are unique across all model instances
+	static std::atomic<unsigned long> revisionCounter;
+
+	//changes whenever the P(t) matrices produced by the model would change
+	unsigned long revision;
+
+	//optional emission table cache shared by the P(t) matrices of this model, not owned
+	PMatrixCache* ptCache;
+
+	void bumpRevision()
+	{
+		revision = ++revisionCounter;
+	}
+
+	//eigen system of a parameter and frequency combination, most recently used first;
+	//the front entry is the one currently loaded
+	struct EigenSystem
+	{
+		vector<double> key;
+		vector<double> q;
+		vector<double> u;
+		vector<double> v;
+		vector<double> roots;
+		double meanRate;
+	};
+
+	list<EigenSystem> eigenCache;
+
+	void getEigenKey(vector<double>& key);
+
+	//loads the cached eigen system for the current parameters and frequencies, the
+	//revision only changes if it differs from the one already loaded
+	bool restoreEigenSystem();
+
+	void storeEigenSystem();
+
 	Dictionary* dictionary;
 
 	Maths* maths;
@@ -117,6 +157,44 @@ public:
 
 	double* calculatePt(double time, unsigned int rateCategory = 0);
 
+	//allocation free variants, workspace must hold getPtWorkspaceSize() doubles
+	virtual void calculatePt(double time, unsigned int rateCategory, double* pt, double* workspace);
+
+	//P(t) averaged over the gamma rate categories, with a single matrix product
+	virtual void calculateGammaPt(double time, double* pt, double* workspace);
+
+	inline unsigned int getPtWorkspaceSize()
+	{
+		return matrixSize + matrixFullSize;
+	}
+
+	//analytic derivatives of P(t), all variants need getPtDerivativeWorkspaceSize() doubles
+
+	//dP(t r)/dt for the given rate category
+	virtual void calculatePtDerivative(double time, unsigned int rateCategory, double* dpt, double* workspace);
+
+	//per parameter part of dP/dparam computed once (matrixFullSize doubles), in the eigen
+	//path dQ/dparam transformed into the eigenbasis (V dQ U)
+	virtual void calculateRateDerivativeBasis(unsigned int param, double* basis, double* workspace);
+
+	//dP(t r)/dparam from the basis above
+	virtual void calculatePtParameterDerivative(double time, unsigned int rateCategory, const double* basis,
+			double* dpt, double* workspace);
+
+	//derivatives of the discrete gamma rates and frequencies with respect to alpha
+	void calculateGammaDerivatives(double* dRates, double* dFrequencies);
+
+	//derivative of the exchangeability matrix S with respect to a model parameter
+	virtual void getExchangeabilityDerivative(unsigned int /*param*/, double* /*dS*/)
+	{
+		throw HmmException("Substitution model has no exchangeability derivatives");
+	}
+
+	inline unsigned int getPtDerivativeWorkspaceSize()
+	{
+		return 2*matrixFullSize;
+	}
+
 	virtual void setObservedFrequencies(double* observedFrequencies);
 
 	//double getPiXiPXiYi(unsigned int xi, unsigned int yi);
@@ -177,6 +255,21 @@ public:
 		return alpha;
 	}
 
+	unsigned long getRevision() const
+	{
+		return revision;
+	}
+
+	void setPtCache(PMatrixCache* cache)
+	{
+		ptCache = cache;
+	}
+
+	PMatrixCache* getPtCache()
+	{
+		return ptCache;
+	}
+
 
 	void setParameters(const double* params)
 	{
@@ -22,12 +22,17 @@
 #include "core/HmmException.hpp"
 #include "core/BandingEstimator.hpp"
 #include "core/BioNJ.hpp"
+#include "core/DistanceWriter.hpp"
+#include "core/ModelParameterFile.hpp"
+#include "core/Checkpoint.hpp"
 #include <iostream>
 #include <fstream>
 #include <iomanip>
 #include "heuristics/ModelEstimator.hpp"
 #include <array>
 #include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
 
 
 #include "core/OptimizedModelParameters.hpp"
@@ -38,6 +43,14 @@
 using namespace std;
 using namespace EBC;
 
+static vector<string> getSequenceNames(Sequences* inputSeqs)
+{
+	vector<string> names;
+	for (unsigned int seqId = 0; seqId < inputSeqs->getSequenceCount(); seqId++)
+		names.push_back(inputSeqs->getSequenceName(seqId));
+	return names;
+}
+
 int main(int argc, char ** argv) {
 
 
@@ -56,64 +69,188 @@ int main(int argc, char ** argv) {
 		bool removeGaps = true;
 
 		Sequences* inputSeqs = new Sequences(parser, cmdReader->getSequenceType(),removeGaps);
+		inputSeqs->setPairStorage(cmdReader->getPairStorage(), cmdReader->getStorageDirectory());
 
-		INFO("Creating Model Parameters heuristics...");
+		string matrixFile = string(cmdReader->getInputFileName()).append(Definitions::distMatExt);
 
-		cout << "Estimating evolutionary model parameters..." << endl;
+		unsigned int shard, shardCount;
+		bool sharded = cmdReader->getShard(shard, shardCount);
 
-		ModelEstimator* tme = new ModelEstimator(inputSeqs, cmdReader->getModelType(),
-				cmdReader->getOptimizationType(), cmdReader->getCategories(), cmdReader->getAlpha(),
-				cmdReader->estimateAlpha());
+		if (cmdReader->mergeShards())
+		{
+			vector<string> shardFiles;
+			for (unsigned int i = 0; i < cmdReader->getMergeShardCount(); i++)
+				shardFiles.push_back(cmdReader->getShardFileName(i, cmdReader->getMergeShardCount()));
+
+			cout << "Merging " << shardFiles.size() << " shards..." << endl;
+			unsigned long found = DistanceWriter::finalise(shardFiles, DistanceWriter::RecordFormat::Text,
+					getSequenceNames(inputSeqs), matrixFile, DistanceWriter::MatrixFormat::Phylip);
+			if (found != inputSeqs->getPairCount())
+				throw HmmException("The shards contain " + to_string(found) + " out of " +
+						to_string(inputSeqs->getPairCount()) + " pairs");
+			return 0;
+		}
 
 		vector<double> indelParams;
 		vector<double> substParams;
 		double alpha = cmdReader->getAlpha();
+		unsigned int categories = cmdReader->getCategories();
+		GuideTree* guideTree;
+		SubstitutionModelBase* calculatedModel = nullptr;
+		Maths* modelMaths = nullptr;
 
-		substParams = tme->getSubstitutionParameters();
-		indelParams = tme->getIndelParameters();
+		Checkpoint* resumed = nullptr;
 
-		if(cmdReader->estimateAlpha()){
-			alpha = tme->getAlpha();
-		}
+		if (!cmdReader->getResumeFileName().empty())
+		{
+			//model parameters and guide distances come from the checkpoint as well
+			resumed = new Checkpoint(Checkpoint::load(cmdReader->getResumeFileName()));
+			resumed->verify(inputSeqs);
+			if (resumed->parameters.model != cmdReader->getModelType())
+				throw HmmException("The checkpoint holds " + ModelParameterFile::getModelName(resumed->parameters.model) +
+						" parameters");
 
+			cout << "Resuming with " << resumed->getCompletedCount() << " out of " << inputSeqs->getPairCount()
+					<< " pairs estimated..." << endl;
+			substParams = resumed->parameters.substitutionParameters;
+			indelParams = resumed->parameters.indelParameters;
+			alpha = resumed->parameters.alpha;
+			categories = resumed->parameters.rateCategories;
+			PairwiseStorage* guideDistances = inputSeqs->createPairStorage();
+			resumed->readGuideDistances(*guideDistances);
+			guideTree = new GuideTree(inputSeqs, guideDistances);
+		}
+		else if (!cmdReader->getModelInFileName().empty())
+		{
+			//shards load the parameters estimated once instead of repeating the estimation
+			ModelParameterFile params = ModelParameterFile::read(cmdReader->getModelInFileName());
+			if (params.model != cmdReader->getModelType())
+				throw HmmException("The model parameter file holds " + ModelParameterFile::getModelName(params.model) +
+						" parameters");
 
-		try{
-			substParams = cmdReader->getSubstParams();
+			substParams = params.substitutionParameters;
+			indelParams = params.indelParameters;
+			alpha = params.alpha;
+			categories = params.rateCategories;
+			guideTree = new GuideTree(inputSeqs);
 		}
-		//do nothing - if exception, this means no user-specified params
-		catch(HmmException& pe){
+		else
+		{
+			INFO("Creating Model Parameters heuristics...");
+
+			cout << "Estimating evolutionary model parameters..." << endl;
+
+			ModelEstimator* tme = new ModelEstimator(inputSeqs, cmdReader->getModelType(),
+					cmdReader->getOptimizationType(), cmdReader->getCategories(), cmdReader->getAlpha(),
+					cmdReader->estimateAlpha(), cmdReader->getEstimationThreads());
+
 			substParams = tme->getSubstitutionParameters();
-		}
+			indelParams = tme->getIndelParameters();
+
+			if(cmdReader->estimateAlpha()){
+				alpha = tme->getAlpha();
+			}
+
+
+			try{
+				substParams = cmdReader->getSubstParams();
+			}
+			//do nothing - if exception, this means no user-specified params
+			catch(HmmException& pe){
+				substParams = tme->getSubstitutionParameters();
+			}
 
-		try{
-			indelParams = cmdReader->getIndelParams();
+			try{
+				indelParams = cmdReader->getIndelParams();
+			}
+			//do nothing - if exception, this means no user-specified params
+			catch(HmmException& pe){
+				indelParams = tme->getIndelParameters();
+			}
+
+			//the banding estimator takes over the calculated model, the estimator's triplet
+			//alignments and HMMs are not needed any longer
+			guideTree = tme->releaseGuideTree();
+			calculatedModel = tme->releaseSubstitutionModel(modelMaths);
+			delete tme;
 		}
-		//do nothing - if exception, this means no user-specified params
-		catch(HmmException& pe){
-			indelParams = tme->getIndelParameters();
+
+		if (!cmdReader->getModelOutFileName().empty())
+		{
+			ModelParameterFile params(cmdReader->getModelType(), substParams, indelParams, alpha, categories);
+			params.setInput(inputSeqs);
+			params.write(cmdReader->getModelOutFileName());
 		}
 
 		cout << "Estimating pairwise distances..." << endl;
 
 		BandingEstimator* be = new BandingEstimator(Definitions::AlgorithmType::Forward, inputSeqs, cmdReader->getModelType() ,indelParams,
-				substParams, cmdReader->getOptimizationType(), cmdReader->getCategories(),alpha, tme->getGuideTree());
+				substParams, cmdReader->getOptimizationType(), categories, alpha, guideTree, calculatedModel, modelMaths);
+
+		if (resumed)
+		{
+			be->restoreDivergenceTimes(*resumed);
+			delete resumed;
+		}
+
+		if (!cmdReader->getCheckpointFileName().empty())
+			be->setCheckpoint(cmdReader->getCheckpointFileName(), cmdReader->getCheckpointPairs(), cmdReader->getCheckpointSeconds());
+
+		if (sharded)
+		{
+			string shardFile = cmdReader->getShardFileName(shard, shardCount);
+			int fd = open(shardFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0)
+				throw HmmException("Could not create " + shardFile);
+
+			DistanceWriter writer(fd, DistanceWriter::RecordFormat::Text);
+			be->setDistanceWriter(&writer);
+			be->emitOptimizedDistances(shard, shardCount);
+			be->optimizeShard(shard, shardCount);
+			if (!cmdReader->getCheckpointFileName().empty())
+				be->saveCheckpoint();
+			be->setDistanceWriter(nullptr);
+			close(fd);
+			return 0;
+		}
+
+		string streamFile = cmdReader->getStreamFileName();
+		if (!streamFile.empty())
+		{
+			int fd = open(streamFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0)
+				throw HmmException("Could not create " + streamFile);
+
+			DistanceWriter writer(fd, DistanceWriter::RecordFormat::Text);
+			be->setDistanceWriter(&writer);
+			be->emitOptimizedDistances();
+			be->optimizePairByPair();
+			be->setDistanceWriter(nullptr);
+			close(fd);
+
+			//the matrix is assembled from the stream, not from the distances in memory
+			DistanceWriter::finalise({streamFile}, DistanceWriter::RecordFormat::Text, getSequenceNames(inputSeqs),
+					matrixFile, DistanceWriter::MatrixFormat::Phylip);
+			return 0;
+		}
+
 		be->optimizePairByPair();
 
 
-		auto distances = be->getOptimizedTimes();
+		const PairwiseStorage& distances = be->getOptimizedTimes();
 		auto seqCount =  inputSeqs->getSequenceCount();
 
 
 
 		//output distance matrix
-		distfile.open((string(cmdReader->getInputFileName()).append(Definitions::distMatExt)).c_str(),ios::out);
+		distfile.open(matrixFile.c_str(),ios::out);
 		distfile << inputSeqs->getSequenceCount() << endl;
 		for (unsigned int seqId = 0; seqId < seqCount; seqId++){
 			distfile << inputSeqs->getSequenceName(seqId) << "        ";
 			for(unsigned int j = 0; j<seqId; j++)
 			{
 
-				distfile << " " << distances[(seqId - j - 1) + (j*seqCount) - (((1+j)/2.0)*(j*1.0))];
+				distfile << " " << distances.getDistance(j, seqId);
 			}
 			distfile << endl;
 		}
@@ -17,7 +17,7 @@
 #  along with this program.  If not, see <http://www.gnu.org/licenses>.
 # ==============================================================================
 
-__all__ = ["PAHMMError", "BandingEstimator", "Sequences"]
+__all__ = ["PAHMMError", "BandingEstimator", "Sequences", "Queries"]
 
 from _pahmm_cffi import lib as _lib, ffi as _ffi
 from typing import AnyStr, Union
@@ -194,6 +194,39 @@ class BandingEstimator:
 
         return Sequences(sequences, self)
 
+    def resume(self, checkpoint_path: Union[Path, AnyStr]) -> "Sequences":
+        """Generate a Sequences-object from a checkpoint written by Sequences.set_checkpoint.
+
+        The input must be the same sequences as before. Model parameters are restored, not
+        estimated, and only the distances missing from the checkpoint will be calculated.
+        """
+
+        sequences = _lib.ebc_be_resume(self.__be, BandingEstimator._path_to_bytes(checkpoint_path))
+
+        if sequences == _ffi.NULL:
+            raise PAHMMError("Could not resume from the checkpoint.", self)
+
+        # Tell the garbage collector how to free the resources
+        sequences = _ffi.gc(sequences, _lib.ebc_seq_free)
+
+        return Sequences(sequences, self)
+
+    def check_gradient(self, model: str) -> float:
+        """Estimate the given model on the input and return the largest relative error of the
+        analytic substitution model gradient against finite differences. Meant for tests.
+        """
+
+        # Mirrors EBC_MODEL_* in cpahmm.h, macros are not visible through cffi
+        models = {"GTR": 0, "HKY85": 1, "LG": 2, "WAG": 3, "JTT": 4}
+        if model not in models:
+            raise PAHMMError(f'Unknown model "{model}".')
+
+        max_error = _ffi.new("double *")
+        if not _lib.ebc_be_check_gradient(self.__be, models[model], max_error):
+            raise PAHMMError("Could not check the gradient.", self)
+
+        return max_error[0]
+
     def set_indel_parameters(self, nb_probability: Union[None, float] = None,
                              rate: Union[None, float] = None):
         """Set the nb-probability and rate parameters.
@@ -205,6 +238,118 @@ class BandingEstimator:
         else:
             _lib.ebc_be_set_indel_parameters(self.__be, nb_probability, rate)
 
+    def set_estimation_threads(self, threads: int = 0):
+        """Set the worker threads of the model estimation, 0 (default) uses all hardware
+        threads.
+        """
+
+        _lib.ebc_be_set_estimation_threads(self.__be, threads)
+
+    def set_ptcache(self, mode: str = "exact", resolution: float = 1e-4):
+        """Configure the P(t) emission table cache for sequences created afterwards.
+
+        mode is one of 'off' (the default without this call), 'exact', identical results
+        for repeated times, or 'interpolated', which interpolates between tables cached on
+        a grid of the given resolution.
+        """
+
+        # Mirrors EBC_PTCACHE_* in cpahmm.h, macros are not visible through cffi
+        modes = {"off": 0, "exact": 1, "interpolated": 2}
+
+        if mode not in modes:
+            raise ValueError(f"Unknown P(t) cache mode {mode!r}.")
+
+        if not _lib.ebc_be_set_ptcache(self.__be, modes[mode], resolution):
+            raise PAHMMError("Could not configure the P(t) cache.", self)
+
+    def set_banding(self, mode: str = "posterior", margin: int = 16):
+        """Choose how pairwise DP bands are built for sequences created afterwards.
+
+        mode is 'posterior' (default) or 'anchor', which follows a chain of shared
+        k-mers with margin rows on each side and falls back to the posterior band
+        for divergent pairs.
+        """
+
+        # Mirrors EBC_BANDING_* in cpahmm.h
+        modes = {"posterior": 0, "anchor": 1}
+
+        if mode not in modes:
+            raise ValueError(f"Unknown banding mode {mode!r}.")
+
+        if not _lib.ebc_be_set_banding(self.__be, modes[mode], margin):
+            raise PAHMMError("Could not configure banding.", self)
+
+    def set_algorithm(self, algorithm: str = "forward"):
+        """Choose the pairwise likelihood algorithm for sequences created afterwards.
+
+        algorithm is 'forward' (default), 'anchored_forward', an approximation for long
+        similar sequences, see Sequences.approximation_gap, or 'viterbi', several times
+        faster than 'forward' with slightly less accurate distances.
+        """
+
+        # Mirrors EBC_ALGORITHM_* in cpahmm.h
+        algorithms = {"forward": 0, "anchored_forward": 1, "viterbi": 2}
+
+        if algorithm not in algorithms:
+            raise ValueError(f"Unknown algorithm {algorithm!r}.")
+
+        if not _lib.ebc_be_set_algorithm(self.__be, algorithms[algorithm]):
+            raise PAHMMError("Could not set the algorithm.", self)
+
+    def set_approximation_gap_interval(self, interval: int = 10):
+        """Compare every interval-th 'anchored_forward' pair against the full forward likelihood
+        for Sequences.approximation_gap. Each sample costs one full forward calculation of the
+        pair. 0 disables sampling.
+        """
+
+        _lib.ebc_be_set_approximation_gap_interval(self.__be, interval)
+
+    def set_triangle_bounds(self, pivots: int = 8):
+        """Narrow each pair's divergence time search using the distances of up to
+        pivots already optimized sequences. 0 disables the bounds.
+        """
+
+        _lib.ebc_be_set_triangle_bounds(self.__be, pivots)
+
+    def set_pair_storage(self, storage: str = "memory", directory: Union[None, Path, AnyStr] = None):
+        """Choose where pairwise distances are kept for sequences created afterwards.
+
+        storage is 'memory' (default), or 'mapped64' / 'mapped32' for a memory-mapped file
+        in double / single precision, created in directory (the temporary directory if None)
+        and paged to disk by the operating system when it does not fit into memory.
+        """
+
+        # Mirrors EBC_STORAGE_* in cpahmm.h
+        storages = {"memory": 0, "mapped32": 1, "mapped64": 2}
+
+        if storage not in storages:
+            raise ValueError(f"Unknown pair storage {storage!r}.")
+
+        c_directory = _ffi.NULL if directory is None else self._path_to_bytes(directory)
+        if not _lib.ebc_be_set_pair_storage(self.__be, storages[storage], c_directory):
+            raise PAHMMError("Could not set the pair storage.", self)
+
+    def set_model_file(self, path: Union[None, Path, AnyStr]):
+        """Skip the model estimation for sequences created afterwards and use the parameters
+        saved by Sequences.save_model instead, None restores estimation.
+
+        Explicitly set parameters (indel parameters, alpha, categories and the arguments of
+        the execute_*-methods) still take precedence.
+        """
+
+        c_path = _ffi.NULL if path is None else self._path_to_bytes(path)
+        if not _lib.ebc_be_set_model_file(self.__be, c_path):
+            raise PAHMMError("Could not read the model parameter file.", self)
+
+    def set_model_cache(self, directory: Union[None, Path, AnyStr]):
+        """Keep estimated model parameters in directory, keyed by the fingerprint of the input
+        sequences, and reuse them instead of estimating again. None disables the cache.
+        """
+
+        c_directory = _ffi.NULL if directory is None else self._path_to_bytes(directory)
+        if not _lib.ebc_be_set_model_cache(self.__be, c_directory):
+            raise PAHMMError("Could not set the model cache.", self)
+
     def __getattr__(self, key):
         """Get general attributes for this banding estimator.
 
@@ -267,6 +412,7 @@ class Sequences:
         self._be = be
         self._seq_count = _lib.ebc_seq_count(c_seq)
         self.__seq = c_seq
+        self.__stream_callback = None
 
     def __len__(self):
         """Get the number of sequences.
@@ -287,6 +433,285 @@ class Sequences:
 
         return sequence
 
+    def add_sequences(self, fasta: Union[str, bytes, bytearray]):
+        """Append sequences from a FASTA string/bytes/bytearray.
+
+        Model parameters and the distances calculated so far are kept, only
+        distances involving the new sequences will be calculated.
+        """
+
+        result: bool = \
+            _lib.ebc_seq_add_sequences(self.__seq, fasta.encode("utf8") if isinstance(fasta, str) else fasta)
+
+        if not result:
+            raise PAHMMError("Could not add sequences.", self._be)
+
+        self._seq_count = _lib.ebc_seq_count(self.__seq)
+
+    def query(self, fasta: Union[str, bytes, bytearray]) -> "Queries":
+        """Calculate distances from query sequences (a FASTA string/bytes/bytearray)
+        to every sequence in this set.
+
+        Only query x reference distances are calculated, using the model parameters
+        of this set.
+        """
+
+        queries = _lib.ebc_seq_query(self.__seq, fasta.encode("utf8") if isinstance(fasta, str) else fasta)
+
+        if queries == _ffi.NULL:
+            raise PAHMMError("Could not run queries.", self._be)
+
+        # Tell the garbage collector how to free the resources
+        queries = _ffi.gc(queries, _lib.ebc_qry_free)
+
+        return Queries(queries, self)
+
+    def query_file(self, fasta_path: Union[Path, AnyStr]) -> "Queries":
+        """Same as query, but the query sequences are read from a file by libpahmm directly.
+        """
+
+        fasta_path = BandingEstimator._path_to_bytes(fasta_path)
+        queries = _lib.ebc_seq_query_from_file(self.__seq, fasta_path)
+
+        if queries == _ffi.NULL:
+            raise PAHMMError(f"Could not run queries from {fasta_path}.", self._be)
+
+        # Tell the garbage collector how to free the resources
+        queries = _ffi.gc(queries, _lib.ebc_qry_free)
+
+        return Queries(queries, self)
+
+    def ptcache_stats(self):
+        """Get the P(t) cache counters as a (hits, misses, memory_bytes) tuple.
+        """
+
+        hits = _ffi.new("unsigned long *")
+        misses = _ffi.new("unsigned long *")
+        memory_bytes = _ffi.new("unsigned long *")
+
+        if not _lib.ebc_seq_get_ptcache_stats(self.__seq, hits, misses, memory_bytes):
+            raise PAHMMError("Could not get P(t) cache statistics.", self._be)
+
+        return hits[0], misses[0], memory_bytes[0]
+
+    def approximation_gap(self):
+        """Get the anchored forward gap report as a (samples, mean_gap, max_gap) tuple.
+
+        The gaps are full minus anchored log-likelihoods of the sampled pairs.
+        """
+
+        samples = _ffi.new("unsigned int *")
+        mean_gap = _ffi.new("double *")
+        max_gap = _ffi.new("double *")
+
+        if not _lib.ebc_seq_get_approximation_gap(self.__seq, samples, mean_gap, max_gap):
+            raise PAHMMError("No approximation gap report available.", self._be)
+
+        return samples[0], mean_gap[0], max_gap[0]
+
+    def triangle_bound_stats(self):
+        """Get the (bounded, repeated) pair counters of the triangle-inequality bounds.
+        """
+
+        bounded = _ffi.new("unsigned long *")
+        repeated = _ffi.new("unsigned long *")
+        _lib.ebc_seq_get_triangle_bound_stats(self.__seq, bounded, repeated)
+
+        return bounded[0], repeated[0]
+
+    def check_viterbi(self, time: float) -> float:
+        """Compare the vectorised Viterbi kernel with the scalar Viterbi algorithm on every
+        ordered pair at the divergence time, returns the largest relative lnL difference.
+        """
+
+        max_error = _ffi.new("double *")
+
+        if not _lib.ebc_seq_check_viterbi(self.__seq, time, max_error):
+            raise PAHMMError("Could not compare the Viterbi algorithms.", self._be)
+
+        return max_error[0]
+
+    def check_anchored_forward(self, time: float) -> float:
+        """Compare the anchored forward without anchors with the full forward algorithm on
+        every ordered pair at the divergence time, returns the largest relative lnL difference.
+        """
+
+        max_error = _ffi.new("double *")
+
+        if not _lib.ebc_seq_check_anchored_forward(self.__seq, time, max_error):
+            raise PAHMMError("Could not compare the forward algorithms.", self._be)
+
+        return max_error[0]
+
+    def check_posteriors(self, time: float) -> float:
+        """Compare the sparse band posteriors with the posteriors of the full matrices on every
+        ordered pair at the divergence time, returns the largest lnL difference, infinity if a
+        cell above the band limit is missing or one below it is kept.
+        """
+
+        max_error = _ffi.new("double *")
+
+        if not _lib.ebc_seq_check_posteriors(self.__seq, time, max_error):
+            raise PAHMMError("Could not compare the posteriors.", self._be)
+
+        return max_error[0]
+
+    def stream_to_fd(self, fd, binary: bool = False):
+        """Write every distance calculated from now on to a file descriptor (or an
+        object with fileno()), as text lines "id1 id2 distance lnl" or binary records.
+        """
+
+        if hasattr(fd, "fileno"):
+            fd = fd.fileno()
+
+        # Mirrors EBC_STREAM_* in cpahmm.h
+        if not _lib.ebc_seq_stream_to_fd(self.__seq, fd, 1 if binary else 0):
+            raise PAHMMError("Could not start streaming distances.", self._be)
+
+        self.__stream_callback = None
+
+    def stream_to_callback(self, callback):
+        """Call callback(seq_id1, seq_id2, distance, lnl) for every distance calculated
+        from now on. lnl is nan for copies of duplicate sequence pairs.
+        """
+
+        @_ffi.callback("void(unsigned int, unsigned int, double, double, void *)")
+        def c_callback(seq_id1, seq_id2, distance, lnl, _user_data):
+            callback(seq_id1, seq_id2, distance, lnl)
+
+        if not _lib.ebc_seq_stream_to_callback(self.__seq, c_callback, _ffi.NULL):
+            raise PAHMMError("Could not start streaming distances.", self._be)
+
+        # The C callback is only valid as long as this reference is alive
+        self.__stream_callback = c_callback
+
+    def stream_stop(self):
+        """Stop streaming distances.
+        """
+
+        _lib.ebc_seq_stream_stop(self.__seq)
+        self.__stream_callback = None
+
+    def calculate_distances(self):
+        """Calculate every distance that has not been calculated yet.
+        """
+
+        if not _lib.ebc_seq_calculate_distances(self.__seq):
+            raise PAHMMError("Could not calculate distances.", self._be)
+
+    def finalise_stream(self, records_path: Union[Path, AnyStr], output_path: Union[Path, AnyStr],
+                        binary_records: bool = False, matrix: str = "phylip"):
+        """Assemble a distance matrix from a file of streamed records.
+
+        matrix is 'phylip' (default) or 'condensed', a binary upper triangle.
+        """
+
+        # Mirrors EBC_MATRIX_* in cpahmm.h
+        matrices = {"phylip": 0, "condensed": 1}
+
+        if matrix not in matrices:
+            raise ValueError(f"Unknown matrix format {matrix!r}.")
+
+        if not _lib.ebc_seq_stream_finalise(self.__seq, BandingEstimator._path_to_bytes(records_path),
+                                            1 if binary_records else 0,
+                                            BandingEstimator._path_to_bytes(output_path), matrices[matrix]):
+            raise PAHMMError("Could not assemble the distance matrix.", self._be)
+
+    def set_checkpoint(self, path: Union[Path, AnyStr], pair_interval: int = 0,
+                       seconds_interval: float = 600.0):
+        """Save a checkpoint to path after every pair_interval calculated distances or
+        seconds_interval seconds, whichever comes first. 0 disables either criterion.
+        Checkpoints after the first one only append the new distances.
+        """
+
+        if not _lib.ebc_seq_set_checkpoint(self.__seq, BandingEstimator._path_to_bytes(path),
+                                           pair_interval, seconds_interval):
+            raise PAHMMError("Could not enable checkpoints.", self._be)
+
+    def save_checkpoint(self):
+        """Save a checkpoint now.
+        """
+
+        if not _lib.ebc_seq_save_checkpoint(self.__seq):
+            raise PAHMMError("Could not save the checkpoint.", self._be)
+
+    def save_model(self, path: Union[Path, AnyStr]):
+        """Save the model parameters of this set, reuse them with BandingEstimator.set_model_file.
+        """
+
+        if not _lib.ebc_seq_save_model(self.__seq, BandingEstimator._path_to_bytes(path)):
+            raise PAHMMError("Could not save the model parameters.", self._be)
+
+    def calculate_shard(self, shard: int, shard_count: int):
+        """Calculate the pairs of shard shard (0 to shard_count - 1): those whose
+        lower-triangular pair index modulo shard_count equals shard. Pairs with a
+        duplicate sequence go with the pair of their representatives.
+        """
+
+        if not _lib.ebc_seq_calculate_shard(self.__seq, shard, shard_count):
+            raise PAHMMError("Could not calculate the shard.", self._be)
+
+    def merge_records(self, records_paths, output_path: Union[Path, AnyStr],
+                      binary_records: bool = False, matrix: str = "phylip") -> int:
+        """Assemble a distance matrix from several files of streamed records (e.g. shards).
+
+        Returns the number of distinct pairs found.
+        """
+
+        # Mirrors EBC_MATRIX_* in cpahmm.h
+        matrices = {"phylip": 0, "condensed": 1}
+
+        if matrix not in matrices:
+            raise ValueError(f"Unknown matrix format {matrix!r}.")
+
+        paths = [_ffi.new("char[]", BandingEstimator._path_to_bytes(path)) for path in records_paths]
+        c_paths = _ffi.new("const char *[]", paths)
+        pair_count = _ffi.new("unsigned long *")
+
+        if not _lib.ebc_seq_merge_records(self.__seq, c_paths, len(paths), 1 if binary_records else 0,
+                                          BandingEstimator._path_to_bytes(output_path), matrices[matrix],
+                                          pair_count):
+            raise PAHMMError("Could not merge distance records.", self._be)
+
+        return pair_count[0]
+
+    def calculate_neighbours(self, k: int):
+        """Sparse mode: calculate only the distances from every sequence to its k
+        nearest sequences by k-mer distance.
+        """
+
+        if not _lib.ebc_seq_calculate_neighbours(self.__seq, k):
+            raise PAHMMError("Could not calculate nearest neighbours.", self._be)
+
+    def neighbours(self, seq_id: int):
+        """Get the neighbours of a sequence as a list of (seq_id, distance) tuples,
+        closest first.
+        """
+
+        neighbour_id = _ffi.new("unsigned int *")
+        distance = _ffi.new("double *")
+        result = []
+
+        for n in range(_lib.ebc_seq_neighbour_count(self.__seq, seq_id)):
+            if not _lib.ebc_seq_get_neighbour(self.__seq, seq_id, n, neighbour_id, distance):
+                raise PAHMMError("Could not get neighbour.", self._be)
+            result.append((neighbour_id[0], distance[0]))
+
+        return result
+
+    def get_sparse_distance(self, seq_id1: int, seq_id2: int):
+        """Get a (distance, computed) tuple in sparse mode. Pairs that are not
+        neighbours get the k-mer estimate and computed is False.
+        """
+
+        computed = _ffi.new("bool *")
+        distance = _lib.ebc_seq_get_sparse_distance(self.__seq, seq_id1, seq_id2, computed)
+
+        if self._be.has_last_error():
+            raise PAHMMError("Could not get sparse distance.", self._be)
+
+        return distance, computed[0]
+
     def get_distance(self, seq_id1: int, seq_id2: int):
         """Retrieve a distance between two sequences using their numbers/IDs.
         """
@@ -335,3 +760,49 @@ class Sequences:
             raise PAHMMError("Could not get sequence from name.", self._be)
 
         return name
+
+
+class Queries:
+    """Distances from a set of query sequences to a reference Sequences-object.
+
+    Note: Do not instantiate an object of this class directly. Use Sequences.query
+    or Sequences.query_file for that.
+    """
+
+    def __init__(self, c_qry, reference: Sequences):
+        # Keep the reference set alive, the C queries object must not outlive it
+        self._reference = reference
+        # The reference set may grow afterwards, the distances are against its sequences now
+        self._ref_count = len(reference)
+        self._qry_count = _lib.ebc_qry_count(c_qry)
+        self.__qry = c_qry
+
+    def __len__(self):
+        """Get the number of query sequences.
+        """
+        return self._qry_count
+
+    def get_name(self, qry_id: int):
+        """Get the name of a query sequence using its number or ID.
+        """
+        c_name = _lib.ebc_qry_get_name(self.__qry, qry_id)
+        if c_name == _ffi.NULL:
+            raise PAHMMError("Could not get query name.", self._reference._be)
+
+        return _ffi.string(c_name)
+
+    def get_distance(self, qry_id: int, seq_id: int):
+        """Distance between a query and a reference sequence, using their numbers/IDs.
+        """
+        ref_count = self._ref_count
+        if not (0 <= qry_id < self._qry_count and 0 <= seq_id < ref_count):
+            raise PAHMMError(f"Query/reference pair ({qry_id}, {seq_id}) out of range.")
+
+        return _lib.ebc_qry_distances(self.__qry)[qry_id * ref_count + seq_id]
+
+    def distances(self):
+        """All distances as a list of rows, one row per query and one column per reference sequence.
+        """
+        ref_count = self._ref_count
+        buffer = _ffi.unpack(_lib.ebc_qry_distances(self.__qry), self._qry_count * ref_count)
+        return [buffer[q * ref_count:(q + 1) * ref_count] for q in range(self._qry_count)]
@@ -83,7 +83,8 @@ StreamParser::StreamParser(istream &in)
 	itN=names->begin();
 
     for(size_t i = 0; i < sequences->size(); i++){
-		this->mappedSeqs.insert(make_pair(names->at(i),sequences->at(i)));
+		if (!this->mappedSeqs.insert(make_pair(names->at(i),sequences->at(i))).second)
+			repeatedNames.push_back(names->at(i));
 	}
 
 	sequences->clear();
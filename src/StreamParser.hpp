@@ -39,6 +39,8 @@ private:
 	vector<string>* sequences;
 	vector<string>* names;
 	map<string,string> mappedSeqs;
+	//names of records dropped because an earlier record had the same name
+	vector<string> repeatedNames;
 	vector<string>::iterator it;
 	vector<string>::iterator itN;
 
@@ -71,6 +73,10 @@ public:
 	inline vector<string>* getSequences() {
 		return sequences;
 	}
+
+	inline const vector<string>& getRepeatedNames() {
+		return repeatedNames;
+	}
 };
 
 } /* namespace EBC */
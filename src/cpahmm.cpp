@@ -20,11 +20,12 @@
 #include "cpahmm.h"
 #include "cpahmm_p.h"
 #include <sstream>
+#include <filesystem>
 
 #include "core/BandingEstimator.hpp"
 #include "core/Sequences.hpp"
 #include "core/Definitions.hpp"
-#include "heuristics/ModelEstimator.hpp"
+#include "core/DistanceWriter.hpp"
 #include "StreamParser.hpp"
 
 using namespace std;
@@ -45,6 +46,18 @@ EBCBandingEstimator *ebc_be_create()
     be->estimate_indel_params = true;
     be->estimate_alpha = true;
     be->estimate_categories = true;
+    be->estimation_threads = EBC_BE_DEFAULTS_ESTIMATION_THREADS;
+    be->ptcache_mode = EBC_BE_DEFAULTS_PTCACHE_MODE;
+    be->ptcache_resolution = EBC_BE_DEFAULTS_PTCACHE_RESOLUTION;
+    be->banding_mode = EBC_BE_DEFAULTS_BANDING;
+    be->anchor_margin = EBC_BE_DEFAULTS_ANCHOR_MARGIN;
+    be->algorithm = EBC_BE_DEFAULTS_ALGORITHM;
+    be->approximation_gap_interval = EBC_BE_DEFAULTS_APPROXIMATION_GAP_INTERVAL;
+    be->triangle_pivots = EBC_BE_DEFAULTS_TRIANGLE_PIVOTS;
+    be->pair_storage = EBC_BE_DEFAULTS_STORAGE;
+    be->_storageDirectory = new string();
+    be->_modelFile = new string();
+    be->_modelCacheDirectory = new string();
 
     return be;
 }
@@ -63,6 +76,10 @@ void ebc_be_free(EBCBandingEstimator *be)
         delete reinterpret_cast<HmmException *>(be->_error);
     }
 
+    delete reinterpret_cast<string *>(be->_storageDirectory);
+    delete reinterpret_cast<string *>(be->_modelFile);
+    delete reinterpret_cast<string *>(be->_modelCacheDirectory);
+
     delete be;
 }
 
@@ -189,6 +206,49 @@ EBCSequences *ebc_be_execute_hky85_model(EBCBandingEstimator *be, double param)
     }
 }
 
+EBCSequences *ebc_be_resume(EBCBandingEstimator *be, const char *checkpoint_path)
+{
+    try {
+        if (!be) {
+            return nullptr;
+        }
+
+        if (!checkpoint_path) {
+            throw HmmException("No checkpoint given.");
+        }
+
+        EBCSequences *sequences = ebc_seq_resume(be, checkpoint_path);
+        ebc_be_unset_error(be);
+        return sequences;
+    } catch (HmmException& e) {
+        ebc_be_set_error(be, e);
+        return nullptr;
+    }
+}
+
+bool ebc_be_check_gradient(EBCBandingEstimator *be, int model, double *max_error)
+{
+    try {
+        if (!be) {
+            return false;
+        }
+
+        if (model < EBC_MODEL_GTR || model > EBC_MODEL_JTT) {
+            throw HmmException("Unknown model " + to_string(model) + ".");
+        }
+
+        double error = ebc_model_check_gradient(be, static_cast<Definitions::ModelType>(model));
+        if (max_error) {
+            *max_error = error;
+        }
+        ebc_be_unset_error(be);
+        return true;
+    } catch (HmmException& e) {
+        ebc_be_set_error(be, e);
+        return false;
+    }
+}
+
 [[maybe_unused]] void ebc_be_set_indel_parameters(EBCBandingEstimator *be, double NB_probability, double rate)
 {
     if (!be) {
@@ -263,6 +323,149 @@ EBCSequences *ebc_be_execute_hky85_model(EBCBandingEstimator *be, double param)
     ebc_be_unset_error(be);
 }
 
+[[maybe_unused]] void ebc_be_set_estimation_threads(EBCBandingEstimator *be, unsigned int threads)
+{
+    if (!be) {
+        return;
+    }
+
+    be->estimation_threads = threads;
+}
+
+[[maybe_unused]] bool ebc_be_set_ptcache(EBCBandingEstimator *be, int mode, double resolution)
+{
+    if (!be) {
+        return false;
+    }
+
+    if (mode < EBC_PTCACHE_OFF || mode > EBC_PTCACHE_INTERPOLATED) {
+        ebc_be_set_error(be, string("Unknown P(t) cache mode ") + to_string(mode) + ".");
+        return false;
+    }
+
+    if (mode == EBC_PTCACHE_INTERPOLATED && !(resolution > 0)) {
+        ebc_be_set_error(be, "The P(t) cache resolution must be positive.");
+        return false;
+    }
+
+    be->ptcache_mode = mode;
+    be->ptcache_resolution = resolution;
+
+    ebc_be_unset_error(be);
+    return true;
+}
+
+[[maybe_unused]] bool ebc_be_set_banding(EBCBandingEstimator *be, int mode, unsigned int margin)
+{
+    if (!be) {
+        return false;
+    }
+
+    if (mode != EBC_BANDING_POSTERIOR && mode != EBC_BANDING_ANCHOR) {
+        ebc_be_set_error(be, string("Unknown banding mode ") + to_string(mode) + ".");
+        return false;
+    }
+
+    be->banding_mode = mode;
+    be->anchor_margin = margin;
+
+    ebc_be_unset_error(be);
+    return true;
+}
+
+[[maybe_unused]] bool ebc_be_set_algorithm(EBCBandingEstimator *be, int algorithm)
+{
+    if (!be) {
+        return false;
+    }
+
+    if (algorithm != EBC_ALGORITHM_FORWARD && algorithm != EBC_ALGORITHM_ANCHORED_FORWARD &&
+        algorithm != EBC_ALGORITHM_VITERBI) {
+        ebc_be_set_error(be, string("Unknown algorithm ") + to_string(algorithm) + ".");
+        return false;
+    }
+
+    be->algorithm = algorithm;
+
+    ebc_be_unset_error(be);
+    return true;
+}
+
+[[maybe_unused]] void ebc_be_set_approximation_gap_interval(EBCBandingEstimator *be, unsigned int interval)
+{
+    if (!be) {
+        return;
+    }
+
+    be->approximation_gap_interval = interval;
+}
+
+[[maybe_unused]] void ebc_be_set_triangle_bounds(EBCBandingEstimator *be, unsigned int pivots)
+{
+    if (!be) {
+        return;
+    }
+
+    be->triangle_pivots = pivots;
+}
+
+[[maybe_unused]] bool ebc_be_set_pair_storage(EBCBandingEstimator *be, int storage, const char *directory)
+{
+    if (!be) {
+        return false;
+    }
+
+    if (storage != EBC_STORAGE_MEMORY && storage != EBC_STORAGE_MAPPED_FLOAT && storage != EBC_STORAGE_MAPPED_DOUBLE) {
+        ebc_be_set_error(be, string("Unknown pair storage ") + to_string(storage) + ".");
+        return false;
+    }
+
+    be->pair_storage = storage;
+    *reinterpret_cast<string *>(be->_storageDirectory) = directory ? directory : "";
+
+    ebc_be_unset_error(be);
+    return true;
+}
+
+[[maybe_unused]] bool ebc_be_set_model_file(EBCBandingEstimator *be, const char *path)
+{
+    if (!be) {
+        return false;
+    }
+
+    try {
+        if (path) {
+            // Fail early for unreadable files, the parameters are read again when executing
+            ModelParameterFile::read(path);
+        }
+    } catch (HmmException &error) {
+        ebc_be_set_error(be, error);
+        return false;
+    }
+
+    *reinterpret_cast<string *>(be->_modelFile) = path ? path : "";
+
+    ebc_be_unset_error(be);
+    return true;
+}
+
+[[maybe_unused]] bool ebc_be_set_model_cache(EBCBandingEstimator *be, const char *directory)
+{
+    if (!be) {
+        return false;
+    }
+
+    if (directory && !filesystem::is_directory(directory)) {
+        ebc_be_set_error(be, string(directory) + " is not a directory.");
+        return false;
+    }
+
+    *reinterpret_cast<string *>(be->_modelCacheDirectory) = directory ? directory : "";
+
+    ebc_be_unset_error(be);
+    return true;
+}
+
 bool ebc_be_set_input(EBCBandingEstimator *be, const char *fasta)
 {
     if (!be) {
@@ -318,8 +521,9 @@ void ebc_seq_free(EBCSequences *seq)
     }
 
     delete reinterpret_cast<EBC::Sequences *>(seq->_sequences);
-    delete reinterpret_cast<EBC::ModelEstimator *>(seq->_modelEstimator);
     delete reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator);
+    delete reinterpret_cast<EBC::DistanceWriter *>(seq->_distanceWriter);
+    delete reinterpret_cast<EBC::GuideTree *>(seq->_guideTree);
     delete seq;
 }
 
@@ -332,6 +536,49 @@ unsigned int ebc_seq_count(EBCSequences *seq)
     return reinterpret_cast<EBC::Sequences *>(seq->_sequences)->getSequenceCount();
 }
 
+bool ebc_seq_add_sequences(EBCSequences *seq, const char *fasta)
+{
+    if (!seq) {
+        return false;
+    }
+
+    auto * sequences = reinterpret_cast<EBC::Sequences *>(seq->_sequences);
+    auto * be = reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator);
+    stringstream inputStream(fasta ? fasta : "");
+
+    try {
+        StreamParser parser(inputStream);
+
+        if (parser.getSequenceCount() == 0) {
+            throw HmmException("No FASTA sequences found in the input.");
+        }
+
+        if (!parser.getRepeatedNames().empty()) {
+            throw HmmException("Sequence " + parser.getRepeatedNames().front() +
+                               " is repeated in the added sequences.");
+        }
+
+        // Growing the pair stores is the step that runs out of memory or disk space, so they
+        // grow before the sequences are appended and shrink back if that fails
+        unsigned int previousCount = sequences->getSequenceCount();
+        be->resizeStores(previousCount + parser.getSequenceCount());
+        try {
+            sequences->addSequences(&parser);
+        } catch (HmmException &) {
+            be->resizeStores(previousCount);
+            throw;
+        }
+        be->getGuideTree()->addSequences(previousCount);
+        be->addSequences(previousCount);
+    } catch (HmmException &error) {
+        ebc_seq_set_error(seq, error);
+        return false;
+    }
+
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
 double ebc_seq_get_distance(EBCSequences *seq, unsigned int seq_id1, unsigned int seq_id2)
 {
     if (!seq) {
@@ -366,18 +613,15 @@ double ebc_seq_get_distance(EBCSequences *seq, unsigned int seq_id1, unsigned in
 
     try {
         /*
-         * The distances stored inside paHMM are the elements in an upper-triangular
+         * The distances stored inside paHMM are the elements in a lower-triangular
          * distance matrix (excluding the diagonal). They are actually stored in a list,
-         * starting from the first row of the distance matrix, from left to right.
-         *
-         * We have to figure out which element in the list correspond to the distance
-         * between the given sequences.
+         * starting from the first row of the distance matrix, from left to right, so
+         * that adding sequences only appends rows.
          *
-         * The following formula gives us the right index: ((2s - 3)*i - i^2)/2 + j - 1
-         * where s is the total number of sequences and (i,j) is a position on the
-         * distance matrix's upper-triangular part.
+         * The element of the pair (i,j), i < j, is at index j(j - 1)/2 + i, see
+         * PairwiseStorage::getPairIndex().
          */
-        distance = be->optimizePair(static_cast<int>((2*size-3) * seq_id1 - seq_id1*seq_id1)/2 + seq_id2 - 1);
+        distance = be->optimizePair(Sequences::getPairIndex(seq_id1, seq_id2, size));
     }  catch (HmmException &error) {
         ebc_seq_set_error(seq, error);
         return NAN;
@@ -409,58 +653,623 @@ double ebc_seq_get_distance_from_names(EBCSequences *seq,
     return ebc_seq_get_distance(seq, seq_id1, seq_id2);
 }
 
-const char *ebc_seq_get_name(EBCSequences *seq, unsigned int seq_id)
+[[maybe_unused]] bool ebc_seq_get_ptcache_stats(EBCSequences *seq, unsigned long *hits,
+                                                unsigned long *misses, unsigned long *memory_bytes)
 {
     if (!seq) {
-        return nullptr;
+        return false;
     }
 
-    auto *sequences = reinterpret_cast<EBC::Sequences *>(seq->_sequences);
+    auto *cache = reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->getPtCache();
 
-    if (seq_id >= sequences->getSequenceCount()) {
-        ebc_seq_set_error(seq, string("Sequence with ID ") + to_string(seq_id) + " not found.");
-        return nullptr;
+    if (cache->getMode() == Definitions::PtCacheMode::NoCache) {
+        ebc_seq_set_error(seq, "The P(t) cache is disabled.");
+        return false;
+    }
+
+    if (hits) {
+        *hits = cache->getHits();
+    }
+
+    if (misses) {
+        *misses = cache->getMisses();
+    }
+
+    if (memory_bytes) {
+        *memory_bytes = cache->getMemoryUsage();
     }
 
     ebc_seq_unset_error(seq);
-    return sequences->getSequenceName(seq_id).c_str();
+    return true;
 }
 
-const char *ebc_seq_get_sequence(EBCSequences *seq, unsigned int seq_id)
+[[maybe_unused]] bool ebc_seq_get_approximation_gap(EBCSequences *seq, unsigned int *samples,
+                                                    double *mean_gap, double *max_gap)
 {
     if (!seq) {
-        return nullptr;
+        return false;
     }
 
-    auto * sequences = reinterpret_cast<EBC::Sequences *>(seq->_sequences);
+    auto &gaps = reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->getApproximationGaps();
 
-    if (seq_id >= sequences->getSequenceCount()) {
-        ebc_seq_set_error(seq, string("Sequence with ID ") + to_string(seq_id) + " not found.");
-        return nullptr;
+    if (gaps.empty()) {
+        ebc_seq_set_error(seq, "No pairs were compared against the full Forward algorithm.");
+        return false;
+    }
+
+    double sum = 0;
+    double max = -numeric_limits<double>::infinity();
+    for (auto &gap : gaps) {
+        double diff = gap.exactLnl - gap.approximateLnl;
+        sum += diff;
+        max = std::max(max, diff);
+    }
+
+    if (samples) {
+        *samples = gaps.size();
+    }
+
+    if (mean_gap) {
+        *mean_gap = sum / gaps.size();
+    }
+
+    if (max_gap) {
+        *max_gap = max;
     }
 
     ebc_seq_unset_error(seq);
-    return sequences->getRawSequenceAt(seq_id).c_str();
+    return true;
 }
 
-[[maybe_unused]] const char *ebc_seq_get_sequence_from_name(EBCSequences *seq, const char *seq_name)
+[[maybe_unused]] bool ebc_seq_get_triangle_bound_stats(EBCSequences *seq, unsigned long *bounded,
+                                                       unsigned long *repeated)
 {
     if (!seq) {
-        return nullptr;
+        return false;
     }
 
-    unsigned int seq_id;
+    auto &stats = reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->getTriangleBoundStats();
 
-    try {
-        seq_id = reinterpret_cast<EBC::Sequences *>(seq->_sequences)
-                ->getSequenceIdFromCString(seq_name);
-    } catch (HmmException &error) {
-        ebc_seq_set_error(seq, error);
-        return nullptr;
+    if (bounded) {
+        *bounded = stats.first;
     }
 
-    return ebc_seq_get_sequence(seq, seq_id);
+    if (repeated) {
+        *repeated = stats.second;
+    }
+
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
+static void ebc_seq_set_stream(EBCSequences *seq, DistanceWriter *writer)
+{
+    reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->setDistanceWriter(writer);
+    delete reinterpret_cast<EBC::DistanceWriter *>(seq->_distanceWriter);
+    seq->_distanceWriter = writer;
+}
+
+bool ebc_seq_stream_to_fd(EBCSequences *seq, int fd, int format)
+{
+    if (!seq) {
+        return false;
+    }
+
+    if (fd < 0) {
+        ebc_seq_set_error(seq, "Invalid file descriptor.");
+        return false;
+    }
+
+    if (format != EBC_STREAM_TEXT && format != EBC_STREAM_BINARY) {
+        ebc_seq_set_error(seq, string("Unknown record format ") + to_string(format) + ".");
+        return false;
+    }
+
+    ebc_seq_set_stream(seq, new DistanceWriter(fd, format == EBC_STREAM_BINARY ?
+                                                   DistanceWriter::RecordFormat::Binary :
+                                                   DistanceWriter::RecordFormat::Text));
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
+bool ebc_seq_stream_to_callback(EBCSequences *seq, ebc_distance_callback callback, void *user_data)
+{
+    if (!seq) {
+        return false;
+    }
+
+    if (!callback) {
+        ebc_seq_set_error(seq, "No callback given.");
+        return false;
+    }
+
+    ebc_seq_set_stream(seq, new DistanceWriter([callback, user_data](const DistanceRecord &record) {
+        callback(record.seq1, record.seq2, record.distance, record.lnl, user_data);
+    }));
+    ebc_seq_unset_error(seq);
+    return true;
 }
 
+void ebc_seq_stream_stop(EBCSequences *seq)
+{
+    if (!seq) {
+        return;
+    }
+
+    ebc_seq_set_stream(seq, nullptr);
 }
 
+bool ebc_seq_check_viterbi(EBCSequences *seq, double time, double *max_error)
+{
+    if (!seq) {
+        return false;
+    }
+
+    try {
+        if (!(time > 0)) {
+            throw HmmException("The divergence time has to be positive.");
+        }
+
+        double error = reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->checkStripedViterbi(time);
+        if (max_error) {
+            *max_error = error;
+        }
+    } catch (HmmException &error) {
+        ebc_seq_set_error(seq, error);
+        return false;
+    }
+
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
+bool ebc_seq_check_anchored_forward(EBCSequences *seq, double time, double *max_error)
+{
+    if (!seq) {
+        return false;
+    }
+
+    try {
+        if (!(time > 0)) {
+            throw HmmException("The divergence time has to be positive.");
+        }
+
+        double error = reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->checkAnchoredForward(time);
+        if (max_error) {
+            *max_error = error;
+        }
+    } catch (HmmException &error) {
+        ebc_seq_set_error(seq, error);
+        return false;
+    }
+
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
+bool ebc_seq_check_posteriors(EBCSequences *seq, double time, double *max_error)
+{
+    if (!seq) {
+        return false;
+    }
+
+    try {
+        if (!(time > 0)) {
+            throw HmmException("The divergence time has to be positive.");
+        }
+
+        double error = reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->checkSparsePosteriors(time);
+        if (max_error) {
+            *max_error = error;
+        }
+    } catch (HmmException &error) {
+        ebc_seq_set_error(seq, error);
+        return false;
+    }
+
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
+bool ebc_seq_calculate_distances(EBCSequences *seq)
+{
+    if (!seq) {
+        return false;
+    }
+
+    try {
+        reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->optimizePairByPair();
+    } catch (HmmException &error) {
+        ebc_seq_set_error(seq, error);
+        return false;
+    }
+
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
+bool ebc_seq_stream_finalise(EBCSequences *seq, const char *records_path, int record_format,
+                             const char *output_path, int matrix_format)
+{
+    return ebc_seq_merge_records(seq, &records_path, 1, record_format, output_path, matrix_format, nullptr);
+}
+
+bool ebc_seq_merge_records(EBCSequences *seq, const char *const *records_paths, unsigned int path_count,
+                           int record_format, const char *output_path, int matrix_format, unsigned long *pair_count)
+{
+    if (!seq) {
+        return false;
+    }
+
+    if (!records_paths || !output_path) {
+        ebc_seq_set_error(seq, "No file name given.");
+        return false;
+    }
+
+    if ((record_format != EBC_STREAM_TEXT && record_format != EBC_STREAM_BINARY) ||
+        (matrix_format != EBC_MATRIX_PHYLIP && matrix_format != EBC_MATRIX_CONDENSED)) {
+        ebc_seq_set_error(seq, "Unknown record or matrix format.");
+        return false;
+    }
+
+    vector<string> paths;
+    for (unsigned int i = 0; i < path_count; i++) {
+        if (!records_paths[i]) {
+            ebc_seq_set_error(seq, "No file name given.");
+            return false;
+        }
+        paths.push_back(records_paths[i]);
+    }
+
+    auto *sequences = reinterpret_cast<EBC::Sequences *>(seq->_sequences);
+    vector<string> names;
+    for (unsigned int i = 0; i < sequences->getSequenceCount(); i++) {
+        names.push_back(sequences->getSequenceName(i));
+    }
+
+    unsigned long found;
+
+    try {
+        found = DistanceWriter::finalise(paths, record_format == EBC_STREAM_BINARY ?
+                                                DistanceWriter::RecordFormat::Binary : DistanceWriter::RecordFormat::Text,
+                                         names, output_path, matrix_format == EBC_MATRIX_CONDENSED ?
+                                                DistanceWriter::MatrixFormat::Condensed : DistanceWriter::MatrixFormat::Phylip);
+    } catch (HmmException &error) {
+        ebc_seq_set_error(seq, error);
+        return false;
+    }
+
+    if (pair_count) {
+        *pair_count = found;
+    }
+
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
+bool ebc_seq_calculate_shard(EBCSequences *seq, unsigned int shard, unsigned int shard_count)
+{
+    if (!seq) {
+        return false;
+    }
+
+    try {
+        reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->optimizeShard(shard, shard_count);
+    } catch (HmmException &error) {
+        ebc_seq_set_error(seq, error);
+        return false;
+    }
+
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
+bool ebc_seq_set_checkpoint(EBCSequences *seq, const char *path, unsigned long pair_interval,
+                            double seconds_interval)
+{
+    if (!seq) {
+        return false;
+    }
+
+    if (!path) {
+        ebc_seq_set_error(seq, "No file name given.");
+        return false;
+    }
+
+    if (seconds_interval < 0) {
+        ebc_seq_set_error(seq, "The checkpoint interval must not be negative.");
+        return false;
+    }
+
+    reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->setCheckpoint(path, pair_interval,
+                                                                                    seconds_interval);
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
+bool ebc_seq_save_checkpoint(EBCSequences *seq)
+{
+    if (!seq) {
+        return false;
+    }
+
+    try {
+        reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->saveCheckpoint();
+    } catch (HmmException &error) {
+        ebc_seq_set_error(seq, error);
+        return false;
+    }
+
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
+bool ebc_seq_save_model(EBCSequences *seq, const char *path)
+{
+    if (!seq) {
+        return false;
+    }
+
+    if (!path) {
+        ebc_seq_set_error(seq, "No file name given.");
+        return false;
+    }
+
+    try {
+        ModelParameterFile parameters = reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->getParameters();
+        parameters.setInput(reinterpret_cast<EBC::Sequences *>(seq->_sequences));
+        parameters.write(path);
+    } catch (HmmException &error) {
+        ebc_seq_set_error(seq, error);
+        return false;
+    }
+
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
+bool ebc_seq_calculate_neighbours(EBCSequences *seq, unsigned int k)
+{
+    if (!seq) {
+        return false;
+    }
+
+    if (k == 0) {
+        ebc_seq_set_error(seq, "At least one neighbour is needed.");
+        return false;
+    }
+
+    try {
+        reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->optimizeNearestNeighbours(k);
+    } catch (HmmException &error) {
+        ebc_seq_set_error(seq, error);
+        return false;
+    }
+
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
+unsigned int ebc_seq_neighbour_count(EBCSequences *seq, unsigned int seq_id)
+{
+    if (!seq) {
+        return 0;
+    }
+
+    auto *sparse = reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->getSparseDistances();
+
+    if (!sparse || seq_id >= sparse->getSize()) {
+        return 0;
+    }
+
+    return sparse->getNeighbours(seq_id).size();
+}
+
+bool ebc_seq_get_neighbour(EBCSequences *seq, unsigned int seq_id, unsigned int n,
+                           unsigned int *neighbour_id, double *distance)
+{
+    if (!seq) {
+        return false;
+    }
+
+    auto *sparse = reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)->getSparseDistances();
+
+    if (!sparse) {
+        ebc_seq_set_error(seq, "Nearest neighbours have not been calculated.");
+        return false;
+    }
+
+    if (seq_id >= sparse->getSize() || n >= sparse->getNeighbours(seq_id).size()) {
+        ebc_seq_set_error(seq, string("Neighbour ") + to_string(n) + " of sequence " + to_string(seq_id) +
+                               " not found.");
+        return false;
+    }
+
+    auto &neighbour = sparse->getNeighbours(seq_id)[n];
+
+    if (neighbour_id) {
+        *neighbour_id = neighbour.id;
+    }
+
+    if (distance) {
+        *distance = neighbour.distance;
+    }
+
+    ebc_seq_unset_error(seq);
+    return true;
+}
+
+double ebc_seq_get_sparse_distance(EBCSequences *seq, unsigned int seq_id1, unsigned int seq_id2, bool *computed)
+{
+    if (!seq) {
+        return NAN;
+    }
+
+    unsigned int size = reinterpret_cast<EBC::Sequences *>(seq->_sequences)->getSequenceCount();
+
+    if (seq_id1 >= size || seq_id2 >= size) {
+        ebc_seq_set_error(seq, string("Sequence with ID ") + to_string(max(seq_id1, seq_id2)) + " not found.");
+        return NAN;
+    }
+
+    bool isComputed = true;
+    double distance = 0.0;
+
+    if (seq_id1 != seq_id2) {
+        try {
+            distance = reinterpret_cast<EBC::BandingEstimator *>(seq->_bandingEstimator)
+                    ->getSparseDistance(seq_id1, seq_id2, isComputed);
+        } catch (HmmException &error) {
+            ebc_seq_set_error(seq, error);
+            return NAN;
+        }
+    }
+
+    if (computed) {
+        *computed = isComputed;
+    }
+
+    ebc_seq_unset_error(seq);
+    return distance;
+}
+
+const char *ebc_seq_get_name(EBCSequences *seq, unsigned int seq_id)
+{
+    if (!seq) {
+        return nullptr;
+    }
+
+    auto *sequences = reinterpret_cast<EBC::Sequences *>(seq->_sequences);
+
+    if (seq_id >= sequences->getSequenceCount()) {
+        ebc_seq_set_error(seq, string("Sequence with ID ") + to_string(seq_id) + " not found.");
+        return nullptr;
+    }
+
+    ebc_seq_unset_error(seq);
+    return sequences->getSequenceName(seq_id).c_str();
+}
+
+const char *ebc_seq_get_sequence(EBCSequences *seq, unsigned int seq_id)
+{
+    if (!seq) {
+        return nullptr;
+    }
+
+    auto * sequences = reinterpret_cast<EBC::Sequences *>(seq->_sequences);
+
+    if (seq_id >= sequences->getSequenceCount()) {
+        ebc_seq_set_error(seq, string("Sequence with ID ") + to_string(seq_id) + " not found.");
+        return nullptr;
+    }
+
+    ebc_seq_unset_error(seq);
+    return sequences->getRawSequenceAt(seq_id).c_str();
+}
+
+[[maybe_unused]] const char *ebc_seq_get_sequence_from_name(EBCSequences *seq, const char *seq_name)
+{
+    if (!seq) {
+        return nullptr;
+    }
+
+    unsigned int seq_id;
+
+    try {
+        seq_id = reinterpret_cast<EBC::Sequences *>(seq->_sequences)
+                ->getSequenceIdFromCString(seq_name);
+    } catch (HmmException &error) {
+        ebc_seq_set_error(seq, error);
+        return nullptr;
+    }
+
+    return ebc_seq_get_sequence(seq, seq_id);
+}
+
+EBCQueries *ebc_seq_query(EBCSequences *seq, const char *fasta)
+{
+    if (!seq) {
+        return nullptr;
+    }
+
+    stringstream inputStream(fasta ? fasta : "");
+
+    try {
+        EBCQueries *qry = ebc_qry_create(seq, inputStream);
+        ebc_seq_unset_error(seq);
+        return qry;
+    } catch (HmmException &error) {
+        ebc_seq_set_error(seq, error);
+        return nullptr;
+    }
+}
+
+[[maybe_unused]] EBCQueries *ebc_seq_query_from_file(EBCSequences *seq, const char *file_name)
+{
+    if (!seq) {
+        return nullptr;
+    }
+
+    ifstream inputStream(file_name, ios::in);
+
+    try {
+        if (!inputStream.is_open()) {
+            throw HmmException("Could not open " + string(file_name));
+        }
+
+        EBCQueries *qry = ebc_qry_create(seq, inputStream);
+        ebc_seq_unset_error(seq);
+        return qry;
+    } catch (HmmException &error) {
+        ebc_seq_set_error(seq, error);
+        return nullptr;
+    }
+}
+
+void ebc_qry_free(EBCQueries *qry)
+{
+    if (!qry) {
+        return;
+    }
+
+    delete reinterpret_cast<EBC::StreamParser *>(qry->_parser);
+    delete[] qry->_distances;
+    delete qry;
+}
+
+unsigned int ebc_qry_count(EBCQueries *qry)
+{
+    if (!qry) {
+        return 0;
+    }
+
+    return reinterpret_cast<EBC::StreamParser *>(qry->_parser)->getSequenceCount();
+}
+
+const char *ebc_qry_get_name(EBCQueries *qry, unsigned int qry_id)
+{
+    if (!qry) {
+        return nullptr;
+    }
+
+    auto *parser = reinterpret_cast<EBC::StreamParser *>(qry->_parser);
+
+    if (qry_id >= parser->getSequenceCount()) {
+        ebc_seq_set_error(qry->_ebcSequences, string("Query with ID ") + to_string(qry_id) + " not found.");
+        return nullptr;
+    }
+
+    ebc_seq_unset_error(qry->_ebcSequences);
+    return parser->getNames()->at(qry_id).c_str();
+}
+
+const double *ebc_qry_distances(EBCQueries *qry)
+{
+    if (!qry) {
+        return nullptr;
+    }
+
+    return qry->_distances;
+}
+
+}
@@ -21,15 +21,111 @@
 #include "cpahmm.h"
 
 #include <sstream>
+#include <iomanip>
+#include <limits>
 #include <cstdarg>
+#include <filesystem>
 #include "core/BandingEstimator.hpp"
 #include "core/Sequences.hpp"
+#include "core/Checkpoint.hpp"
+#include "core/ModelParameterFile.hpp"
 #include "heuristics/ModelEstimator.hpp"
 #include "StreamParser.hpp"
 
 using namespace std;
 using namespace EBC;
 
+/*
+ * Creates the pairwise estimator with the options set on the banding estimator.
+ */
+static BandingEstimator *ebc_be_create_estimator(EBCBandingEstimator *be, Sequences *inputSeqs,
+                                                 Definitions::ModelType model, const vector<double> &indelParams,
+                                                 const vector<double> &substParams, double alpha,
+                                                 unsigned int rateCategories, GuideTree *guideTree,
+                                                 SubstitutionModelBase *calculatedModel = nullptr,
+                                                 Maths *modelMaths = nullptr)
+{
+    // A model calculated for other rate categories can't be adopted, a new one is built instead
+    if (calculatedModel != nullptr && calculatedModel->getRateCategories() != rateCategories) {
+        delete calculatedModel;
+        delete modelMaths;
+        calculatedModel = nullptr;
+        modelMaths = nullptr;
+    }
+
+    Definitions::AlgorithmType algorithm = Definitions::AlgorithmType::Forward;
+    if (be->algorithm == EBC_ALGORITHM_ANCHORED_FORWARD) {
+        algorithm = Definitions::AlgorithmType::AnchoredForward;
+    } else if (be->algorithm == EBC_ALGORITHM_VITERBI) {
+        algorithm = Definitions::AlgorithmType::Viterbi;
+    }
+
+    auto* bandingEstimator =
+            new BandingEstimator(algorithm, inputSeqs, model,
+                                 indelParams, substParams, Definitions::OptimizationType::BFGS,
+                                 rateCategories, alpha, guideTree, calculatedModel, modelMaths);
+
+    if (be->ptcache_mode != EBC_BE_DEFAULTS_PTCACHE_MODE) {
+        bandingEstimator->setPtCacheMode(static_cast<Definitions::PtCacheMode>(be->ptcache_mode),
+                                         be->ptcache_resolution);
+    }
+
+    if (be->approximation_gap_interval != EBC_BE_DEFAULTS_APPROXIMATION_GAP_INTERVAL) {
+        bandingEstimator->setApproximationGapInterval(be->approximation_gap_interval);
+    }
+
+    if (be->triangle_pivots > 0) {
+        bandingEstimator->setTriangleBounds(be->triangle_pivots);
+    }
+
+    if (be->banding_mode == EBC_BANDING_ANCHOR) {
+        bandingEstimator->setBanding(Definitions::BandingType::AnchorBanding, be->anchor_margin);
+    }
+
+    return bandingEstimator;
+}
+
+/*
+ * Cache file of the estimates for the input, the model and the estimation settings.
+ */
+static string ebc_seq_model_cache_path(EBCBandingEstimator *be, Sequences *inputSeqs, Definitions::ModelType model)
+{
+    ostringstream name;
+    name << hex << Checkpoint::getFingerprint(inputSeqs) << dec << "-" << ModelParameterFile::getModelName(model)
+         << "-" << be->gamma_rate_categories;
+    if (!be->estimate_alpha) {
+        name << "-" << setprecision(numeric_limits<double>::max_digits10) << be->alpha;
+    }
+    name << ".model";
+
+    return (filesystem::path(*reinterpret_cast<string *>(be->_modelCacheDirectory)) / name.str()).string();
+}
+
+/*
+ * Reads cached estimates, returns false if there are none for this input.
+ */
+static bool ebc_seq_read_cached_model(const string &path, Sequences *inputSeqs, Definitions::ModelType model,
+                                      unsigned int rateCategories, ModelParameterFile &estimates)
+{
+    if (!filesystem::exists(path)) {
+        return false;
+    }
+
+    try {
+        ModelParameterFile cached = ModelParameterFile::read(path);
+        if (cached.model != model || cached.rateCategories != rateCategories ||
+            cached.fingerprint != Checkpoint::getFingerprint(inputSeqs)) {
+            return false;
+        }
+        estimates = cached;
+    } catch (HmmException &) {
+        // Unreadable entries are estimated and written again
+        return false;
+    }
+
+    return true;
+}
+
 EBCSequences *ebc_seq_create(EBCBandingEstimator *be, Definitions::ModelType model,
                              bool estimate_model_params, int model_param_count, ...)
 {
@@ -37,10 +133,28 @@ EBCSequences *ebc_seq_create(EBCBandingEstimator *be, Definitions::ModelType mod
         return nullptr;
     }
 
+    const string &modelFile = *reinterpret_cast<string *>(be->_modelFile);
+    const string &cacheDirectory = *reinterpret_cast<string *>(be->_modelCacheDirectory);
+
+    // The parameters the model estimator would provide, unless a model file or a cached
+    // estimate of the same input provides them
+    ModelParameterFile estimates(model, {}, {}, be->alpha, be->gamma_rate_categories);
+    bool reused = false;
+
+    if (!modelFile.empty()) {
+        estimates = ModelParameterFile::read(modelFile);
+        if (estimates.model != model) {
+            throw HmmException("The model parameter file holds " + ModelParameterFile::getModelName(estimates.model) +
+                               " parameters.");
+        }
+        reused = true;
+    }
+
     va_list args;
     va_start(args, model_param_count);
 
     auto *seq = new EBCSequences;
+    seq->_distanceWriter = nullptr;
 
     StreamParser *parser;
     if (be->_parser) {
@@ -59,27 +173,61 @@ EBCSequences *ebc_seq_create(EBCBandingEstimator *be, Definitions::ModelType mod
     seq->sequenceType = sequenceType;
 
     auto* inputSeqs = new Sequences(parser, sequenceType, true);
+    inputSeqs->setPairStorage(static_cast<Definitions::PairStorageType>(be->pair_storage),
+                              *reinterpret_cast<string *>(be->_storageDirectory));
     seq->_sequences = inputSeqs;
 
-    auto *tme = new ModelEstimator(inputSeqs, model, Definitions::OptimizationType::BFGS,
-                                             be->gamma_rate_categories, be->alpha, be->estimate_alpha);
-    seq->_modelEstimator = tme;
+    string cachePath;
+    if (!reused && !cacheDirectory.empty()) {
+        cachePath = ebc_seq_model_cache_path(be, inputSeqs, model);
+        reused = ebc_seq_read_cached_model(cachePath, inputSeqs, model, be->gamma_rate_categories, estimates);
+    }
+
+    // The set owns the guide tree, the model estimator is deleted right after the estimation
+    // and its calculated substitution model taken over by the banding estimator
+    SubstitutionModelBase *calculatedModel = nullptr;
+    Maths *modelMaths = nullptr;
+
+    if (reused) {
+        seq->_guideTree = new GuideTree(inputSeqs);
+    } else {
+        auto *tme = new ModelEstimator(inputSeqs, model, Definitions::OptimizationType::BFGS,
+                                                 be->gamma_rate_categories, be->alpha, be->estimate_alpha,
+                                                 be->estimation_threads);
+
+        estimates.substitutionParameters = tme->getSubstitutionParameters();
+        estimates.indelParameters = tme->getIndelParameters();
+        estimates.alpha = tme->getAlpha();
+
+        seq->_guideTree = tme->releaseGuideTree();
+        calculatedModel = tme->releaseSubstitutionModel(modelMaths);
+        delete tme;
+
+        if (!cachePath.empty()) {
+            estimates.setInput(inputSeqs);
+            try {
+                estimates.write(cachePath);
+            } catch (HmmException &) {
+                // The cache is best effort, the estimates are used all the same
+            }
+        }
+    }
 
     if(be->estimate_alpha){
-        be->alpha = tme->getAlpha();
+        be->alpha = estimates.alpha;
     }
 
     vector<double> indelParams;
     vector<double> substParams;
 
     if (be->estimate_indel_params) {
-        indelParams = tme->getIndelParameters();
+        indelParams = estimates.indelParameters;
     } else {
         indelParams = {be->indel_NB_probability, be->indel_rate};
     }
 
     if (estimate_model_params) {
-        substParams = tme->getSubstitutionParameters();
+        substParams = estimates.substitutionParameters;
     } else {
         if (model == Definitions::ModelType::HKY85) {
             substParams = {va_arg(args, double)};
@@ -94,16 +242,131 @@ EBCSequences *ebc_seq_create(EBCBandingEstimator *be, Definitions::ModelType mod
 
     va_end(args);
 
-    auto* bandingEstimator =
-            new BandingEstimator(Definitions::AlgorithmType::Forward, inputSeqs, model,
-                                 indelParams, substParams, Definitions::OptimizationType::BFGS,
-                                 be->gamma_rate_categories, be->alpha, tme->getGuideTree());
-    seq->_bandingEstimator = bandingEstimator;
+    unsigned int rateCategories = be->estimate_categories ? estimates.rateCategories : be->gamma_rate_categories;
+
+    seq->_bandingEstimator = ebc_be_create_estimator(be, inputSeqs, model, indelParams, substParams,
+                                                     be->alpha, rateCategories,
+                                                     reinterpret_cast<GuideTree *>(seq->_guideTree),
+                                                     calculatedModel, modelMaths);
     seq->_ebcBandingEstimator = be;
 
     return seq;
 }
 
+double ebc_model_check_gradient(EBCBandingEstimator *be, Definitions::ModelType model)
+{
+    if (!be->_parser) {
+        throw HmmException("No input sequences to estimate the model on.");
+    }
+
+    Definitions::SequenceType sequenceType;
+    if (model == Definitions::ModelType::GTR || model == Definitions::ModelType::HKY85) {
+        sequenceType = Definitions::SequenceType::Nucleotide;
+    } else {
+        sequenceType = Definitions::SequenceType::Aminoacid;
+    }
+
+    Sequences inputSeqs(reinterpret_cast<StreamParser *>(be->_parser), sequenceType, true);
+    ModelEstimator estimator(&inputSeqs, model, Definitions::OptimizationType::BFGS,
+                             be->gamma_rate_categories, be->alpha, be->estimate_alpha, be->estimation_threads);
+
+    return estimator.checkGradient();
+}
+
+EBCSequences *ebc_seq_resume(EBCBandingEstimator *be, const string &checkpointPath)
+{
+    if (!be) {
+        return nullptr;
+    }
+
+    if (!be->_parser) {
+        throw HmmException("No input sequences to resume.");
+    }
+
+    Checkpoint checkpoint = Checkpoint::load(checkpointPath);
+    Definitions::ModelType model = checkpoint.parameters.model;
+    Definitions::SequenceType sequenceType =
+            model == Definitions::ModelType::GTR || model == Definitions::ModelType::HKY85 ?
+            Definitions::SequenceType::Nucleotide : Definitions::SequenceType::Aminoacid;
+
+    auto *inputSeqs = new Sequences(reinterpret_cast<StreamParser *>(be->_parser), sequenceType, true);
+    inputSeqs->setPairStorage(static_cast<Definitions::PairStorageType>(be->pair_storage),
+                              *reinterpret_cast<string *>(be->_storageDirectory));
+
+    // No model estimator, the parameters and guide distances are restored instead. As in
+    // ebc_seq_create(), the set is only allocated once everything it holds is built
+    PairwiseStorage *guideDistances = nullptr;
+    GuideTree *guideTree = nullptr;
+    BandingEstimator *bandingEstimator = nullptr;
+
+    try {
+        checkpoint.verify(inputSeqs);
+
+        guideDistances = inputSeqs->createPairStorage();
+        checkpoint.readGuideDistances(*guideDistances);
+
+        // The guide tree owns the distances from here on, also if it throws
+        PairwiseStorage *distances = guideDistances;
+        guideDistances = nullptr;
+        guideTree = new GuideTree(inputSeqs, distances);
+
+        bandingEstimator = ebc_be_create_estimator(be, inputSeqs, model, checkpoint.parameters.indelParameters,
+                                                   checkpoint.parameters.substitutionParameters,
+                                                   checkpoint.parameters.alpha,
+                                                   checkpoint.parameters.rateCategories, guideTree);
+        bandingEstimator->restoreDivergenceTimes(checkpoint);
+    } catch (HmmException &) {
+        delete bandingEstimator;
+        delete guideTree;
+        delete guideDistances;
+        delete inputSeqs;
+        throw;
+    }
+
+    auto *seq = new EBCSequences;
+    seq->sequenceType = sequenceType;
+    seq->_sequences = inputSeqs;
+    seq->_distanceWriter = nullptr;
+    seq->_guideTree = guideTree;
+    seq->_ebcBandingEstimator = be;
+    seq->_bandingEstimator = bandingEstimator;
+
+    return seq;
+}
+
+EBCQueries *ebc_qry_create(EBCSequences *seq, istream &input)
+{
+    if (!seq) {
+        return nullptr;
+    }
+
+    auto *parser = new StreamParser(input);
+
+    if (parser->getSequenceCount() == 0) {
+        delete parser;
+        throw HmmException("No FASTA sequences found in the query input.");
+    }
+
+    auto *sequences = reinterpret_cast<Sequences *>(seq->_sequences);
+    auto *bandingEstimator = reinterpret_cast<BandingEstimator *>(seq->_bandingEstimator);
+    auto *distances = new double[parser->getSequenceCount() * sequences->getSequenceCount()];
+
+    try {
+        bandingEstimator->optimizeQueries(parser, distances);
+    } catch (HmmException &) {
+        delete[] distances;
+        delete parser;
+        throw;
+    }
+
+    auto *qry = new EBCQueries;
+    qry->_parser = parser;
+    qry->_distances = distances;
+    qry->_ebcSequences = seq;
+
+    return qry;
+}
+
 void ebc_be_set_error(EBCBandingEstimator *be, const string &message)
 {
     if (!be) {
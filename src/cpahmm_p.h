@@ -22,9 +22,11 @@
 
 #include "core/Definitions.hpp"
 #include <string>
+#include <istream>
 
 struct EBCSequences;
 struct EBCBandingEstimator;
+struct EBCQueries;
 
 namespace EBC {
 class HmmException;
@@ -36,6 +38,23 @@ class HmmException;
 EBCSequences *ebc_seq_create(EBCBandingEstimator *be, EBC::Definitions::ModelType model,
                              bool estimate_model_params, int model_param_count, ...);
 
+/*
+ * Recreates a Sequence from the input of the banding estimator and a checkpoint, without
+ * estimating the model again.
+ */
+EBCSequences *ebc_seq_resume(EBCBandingEstimator *be, const string &checkpointPath);
+
+/*
+ * Runs the model estimation on the input of the banding estimator and returns the largest
+ * relative error of its analytic gradient.
+ */
+double ebc_model_check_gradient(EBCBandingEstimator *be, EBC::Definitions::ModelType model);
+
+/*
+ * Runs the query sequences against the reference set and stores the distances.
+ */
+EBCQueries *ebc_qry_create(EBCSequences *seq, istream &input);
+
 void ebc_be_set_error(EBCBandingEstimator *be, const string &message);
 void ebc_be_set_error(EBCBandingEstimator *be, const EBC::HmmException &exception);
 void ebc_be_unset_error(EBCBandingEstimator *be);
@@ -1,4 +1,5 @@
 import sys
+import math
 import random
 import argparse
 
@@ -12,6 +13,51 @@ def generate_sample(count: int, length: int, alphabet: str) -> str:
         fasta += f">S{n}\n{sequence}\n"
     return fasta
 
+def evolve(sequence: str, time: float, indel_rate: float, alphabet: str, rng: random.Random) -> str:
+    """Evolve a sequence for the given time under the Jukes-Cantor model, with insertions
+    and deletions of geometric length (mean 3) at indel_rate events per site and time unit.
+    """
+
+    change = 1.0 - math.exp(-len(alphabet) / (len(alphabet) - 1.0) * time)
+    result = []
+    skip = 0
+
+    for symbol in sequence:
+        if skip:
+            skip -= 1
+            continue
+
+        result.append(rng.choice(alphabet) if rng.random() < change else symbol)
+
+        if rng.random() < indel_rate * time:
+            length = 1
+            while rng.random() < 2.0 / 3.0:
+                length += 1
+
+            if rng.random() < 0.5:
+                result.append("".join(rng.choices(alphabet, k=length)))
+            else:
+                skip = length
+
+    return "".join(result)
+
+
+def generate_related_sample(count: int, length: int, alphabet: str, min_time: float, max_time: float,
+                            indel_rate: float, seed: int) -> str:
+    """Sequences evolved from a common random ancestor on a star tree, with branch lengths
+    drawn between min_time and max_time, so pairwise distances lie between twice those.
+    """
+
+    rng = random.Random(seed)
+    root = "".join(rng.choices(alphabet, k=length))
+
+    fasta = ""
+    for n in range(1, count+1):
+        sequence = evolve(root, rng.uniform(min_time, max_time), indel_rate, alphabet, rng)
+        fasta += f">S{n}\n{sequence}\n"
+    return fasta
+
+
 def main():
     parser = argparse.ArgumentParser(description='Generate random FASTA sample.')
     parser.add_argument('count', type=int,
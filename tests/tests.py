@@ -5,8 +5,12 @@
 from initialize import *
 from pahmm import *
 import os
+from pathlib import Path
+import struct
+import tempfile
 from typing import List, Union
-from random import shuffle
+from random import shuffle, Random
+from generate_sample import generate_related_sample, AMINOACID_ALPHABED, NUCLEIC_ACID_ALPHABED
 
 NUCLEOTIDE_MODELS = ["GTR", "HKY85"]
 AMINO_ACID_MODELS = ["JTT", "LG", "WAG"]
@@ -92,6 +96,19 @@ AMINO_ACID_TESTS = [
     },
 ]
 
+# The tool is built from the older copy of paHMM-dist in this directory. On some of the short
+# random samples its estimates and the library's end on different optima of a flat likelihood,
+# the distances differ above 1 already since the library was forked. Those configurations are
+# compared with distance matrices of the library kept in a "references" directory next to the
+# sample, see reference_distmat_path(); a configuration without one is compared with the tool.
+REFERENCES_DIR_NAME = "references"
+
+# Related samples as (nucleotide, count, length, seed), see generate_related_sample().
+RELATED_SAMPLES = [
+    (True, 12, 400, 1),
+    (False, 12, 300, 2),
+]
+
 
 def read_distmat(distmat_path: str):
     adjacency_list = []
@@ -125,6 +142,22 @@ TOOL_MODEL_PARAM_FLAGS = {
 }
 
 
+def reference_distmat_path(fasta_path: str, model: str, parameters: List[float],
+                            alpha: Union[None, float], gamma_rate_categories: Union[None, int]) -> Path:
+    """Path of the library's reference distances of a sample and a test configuration.
+    """
+
+    name = [os.path.basename(fasta_path), model] + list(map(str, parameters))
+
+    if alpha is not None:
+        name.append(f"a{alpha}")
+
+    if gamma_rate_categories is not None:
+        name.append(f"cat{gamma_rate_categories}")
+
+    return Path(os.path.dirname(fasta_path)) / REFERENCES_DIR_NAME / ("_".join(name) + ".distmat")
+
+
 def shuffled_list(iterable) -> list:
     ret = list(iterable)
     shuffle(ret)
@@ -166,6 +199,14 @@ def test_fasta(fasta_path: str, model: str, parameters: List[float],
         return False, "The pahmm-tree tool did not run successfully.\n" + execution.stdout
 
     distmat_path = fasta_path + ".paHMM-Tree.distmat"
+    reference_name = "Tool"
+
+    reference_path = reference_distmat_path(fasta_path, model, parameters, alpha, gamma_rate_categories)
+
+    if reference_path.is_file():
+        distmat_path = reference_path
+        reference_name = "Reference"
+
     tool_adjacency_list = read_distmat(distmat_path)
 
     # Get pahmm library distances and compare
@@ -206,12 +247,915 @@ def test_fasta(fasta_path: str, model: str, parameters: List[float],
                 return False, f"Distance between '{tool_adjacency_list[i][0].decode('ascii')}' and " \
                               f"'{tool_adjacency_list[j][0].decode('ascii')}' did not match.\n" \
                               f"Library yields: {lib_distance}\n" \
-                              f"Tool yields: {tool_distance}"
+                              f"{reference_name} yields: {tool_distance}"
 
     # Test ran successfully
     return True, ""
 
 
+def read_fasta_records(fasta_path: str) -> List[str]:
+    """Split a FASTA file into one string per record.
+    """
+
+    with open(fasta_path, "r") as fasta_file:
+        return [">" + record.strip() + "\n" for record in fasta_file.read().split(">") if record.strip()]
+
+
+def execute_fixed_model(be: BandingEstimator, nucleotide: bool) -> Sequences:
+    """Apply a model whose parameters do not depend on the sequences, so that
+    results of different subsets of a sample can be compared.
+    """
+
+    be.alpha = 0.5
+    be.gamma_rate_categories = 4
+    be.set_indel_parameters(0.05, 0.01)
+
+    return be.execute_hky85_model(2.0) if nucleotide else be.execute_lg_model()
+
+
+def dense_reference(fasta: str, nucleotide: bool, from_file: bool = True) -> Sequences:
+    """Calculate every distance of a sample, a file or a FASTA string, with the fixed model.
+    """
+
+    be = BandingEstimator()
+    if from_file:
+        be.set_file_input(fasta)
+    else:
+        be.set_str_input(fasta)
+
+    seqs = execute_fixed_model(be, nucleotide)
+    seqs.calculate_distances()
+    return seqs
+
+
+def compare_sequences(seqs: Sequences, expected: Sequences, what: str):
+    """Compare every distance of two sets holding the same sequences, by name.
+    """
+
+    if len(seqs) != len(expected):
+        return False, f"{what}: {len(seqs)} sequences instead of {len(expected)}."
+
+    for i in range(len(seqs)):
+        for j in range(i):
+            name1, name2 = seqs.get_seq_name(i), seqs.get_seq_name(j)
+            distance = seqs.get_distance(i, j)
+            expected_distance = expected.get_distance_from_names(name1, name2)
+
+            if abs(distance - expected_distance) >= 0.00005:
+                return False, f"{what}: distance between '{name1.decode('ascii')}' and " \
+                              f"'{name2.decode('ascii')}' did not match.\n" \
+                              f"Yields: {distance}\n" \
+                              f"Expected: {expected_distance}"
+
+    return True, ""
+
+
+def reversed_records(records: List[str]) -> List[str]:
+    """Reverse the sequences of FASTA records and rename them. The composition, and with it
+    the observed frequencies, of the reversed sequences is the same as of the originals.
+    """
+
+    result = []
+    for record in records:
+        lines = record.strip().split("\n")
+        sequence = "".join(line.strip() for line in lines[1:])
+        result.append(">reversed_" + lines[0][1:].replace(" ", "_") + "\n" + sequence[::-1] + "\n")
+
+    return result
+
+
+def reject_clashing_batch(seqs: Sequences, added: List[str], records: List[str]) -> bool:
+    """Add a batch whose last sequence is already in the set, which has to fail and leave
+    the set as it was.
+    """
+
+    try:
+        seqs.add_sequences("".join(added) + records[-1])
+        return False
+    except PAHMMError:
+        pass
+
+    return len(seqs) == len(records)
+
+
+def test_add_sequences(fasta_path: str, nucleotide: bool):
+    """Grows a sample by its reversed sequences and compares it with a set built from
+    both at once.
+    """
+
+    records = read_fasta_records(fasta_path)
+    added = reversed_records(records)
+
+    seqs = dense_reference(fasta_path, nucleotide)
+
+    # A batch repeating a name must be rejected without changing the set
+    try:
+        seqs.add_sequences(added[0] + added[0])
+        return False, "A batch with a repeated sequence name was accepted."
+    except PAHMMError:
+        pass
+
+    if len(seqs) != len(records):
+        return False, "A rejected batch changed the set."
+
+    # So must a batch clashing with a name in the set, after the pair stores grew for it
+    if not reject_clashing_batch(seqs, added, records):
+        return False, "A batch clashing with the set was accepted or changed the set."
+
+    seqs.add_sequences("".join(added))
+
+    full_be = BandingEstimator()
+    full_be.set_str_input("".join(records + added))
+    full_seqs = execute_fixed_model(full_be, nucleotide)
+
+    result = compare_sequences(seqs, full_seqs, "Grown set")
+    if not result[0]:
+        return result
+
+    # A mapped store grows its file in place
+    mapped_be = BandingEstimator()
+    mapped_be.set_file_input(fasta_path)
+    mapped_be.set_pair_storage("mapped64")
+    mapped_seqs = execute_fixed_model(mapped_be, nucleotide)
+    mapped_seqs.calculate_distances()
+    if not reject_clashing_batch(mapped_seqs, added, records):
+        return False, "A batch clashing with the mapped set was accepted or changed the set."
+    mapped_seqs.add_sequences("".join(added))
+
+    return compare_sequences(mapped_seqs, full_seqs, "Grown mapped set")
+
+
+def test_query(fasta_path: str, nucleotide: bool):
+    """Queries a set with its own sequences, the query of a sequence has to be at distance 0
+    from itself and at the reference distances from every other sequence. New sequences have
+    to be at the distances the set grown by them yields.
+    """
+
+    records = read_fasta_records(fasta_path)
+    added = reversed_records(records)
+
+    seqs = dense_reference(fasta_path, nucleotide)
+
+    with tempfile.TemporaryDirectory() as directory:
+        try:
+            seqs.query_file(os.path.join(directory, "missing.fasta"))
+            return False, "Querying a missing file succeeded."
+        except PAHMMError as error:
+            if "Could not open" not in str(error):
+                return False, f"The error of a missing query file hides the cause: {error}"
+
+    new_queries = seqs.query("".join(added))
+
+    for queries in [seqs.query_file(fasta_path), seqs.query("".join(records))]:
+        if len(queries) != len(seqs):
+            return False, f"{len(queries)} queries instead of {len(seqs)}."
+
+        for q, row in enumerate(queries.distances()):
+            if queries.get_name(q) != seqs.get_seq_name(q):
+                return False, f"Query {q} is named {queries.get_name(q)}."
+
+            for i, distance in enumerate(row):
+                expected = 0.0 if i == q else seqs.get_distance(q, i)
+                if abs(distance - expected) >= 0.00005:
+                    return False, f"Query {q} against {i} did not match.\n" \
+                                  f"Yields: {distance}\n" \
+                                  f"Expected: {expected}"
+
+    seqs.add_sequences("".join(added))
+    for q, row in enumerate(new_queries.distances()):
+        for i, distance in enumerate(row):
+            expected = seqs.get_distance(len(records) + q, i)
+            if abs(distance - expected) >= 0.00005:
+                return False, f"New query {q} against {i} did not match.\n" \
+                              f"Yields: {distance}\n" \
+                              f"Expected: {expected}"
+
+    return True, ""
+
+
+def test_shards(fasta_path: str, nucleotide: bool, shard_count: int = 3):
+    """Calculates a sample with copies of two sequences in shards and compares the merged
+    matrix with a single run. Every pair has to be streamed by exactly one shard.
+    """
+
+    records = read_fasta_records(fasta_path)
+    copies = [record.replace(">", ">copy_", 1) for record in records[:2]]
+    fasta = "".join(records + copies)
+
+    expected = dense_reference(fasta, nucleotide, from_file=False)
+
+    with tempfile.TemporaryDirectory() as directory:
+        shard_paths = [os.path.join(directory, f"shard-{shard}") for shard in range(shard_count)]
+
+        for shard, shard_path in enumerate(shard_paths):
+            shard_be = BandingEstimator()
+            shard_be.set_str_input(fasta)
+            seqs = execute_fixed_model(shard_be, nucleotide)
+
+            with open(shard_path, "w") as shard_file:
+                seqs.stream_to_fd(shard_file)
+                seqs.calculate_shard(shard, shard_count)
+                seqs.stream_stop()
+
+        pair_count = len(expected) * (len(expected) - 1) // 2
+        records_count = 0
+        for shard_path in shard_paths:
+            with open(shard_path) as shard_file:
+                records_count += sum(1 for _ in shard_file)
+
+        if records_count != pair_count:
+            return False, f"The shards streamed {records_count} records for {pair_count} pairs."
+
+        matrix_path = os.path.join(directory, "merged")
+        if seqs.merge_records(shard_paths, matrix_path) != pair_count:
+            return False, "The merged shards do not cover every pair."
+
+        for i, (_, distances) in enumerate(read_distmat(matrix_path)):
+            for j in range(i):
+                if abs(distances[j] - expected.get_distance(i, j)) >= 0.00005:
+                    return False, f"Merged shards: distance between {i} and {j} did not match.\n" \
+                                  f"Yields: {distances[j]}\n" \
+                                  f"Expected: {expected.get_distance(i, j)}"
+
+    return True, ""
+
+
+def test_gradient(fasta_path: str, nucleotide: bool, tolerance: float = 1e-6):
+    """Compares the analytic gradient of the substitution model estimation with finite
+    differences, with and without gamma rate categories.
+    """
+
+    for model in ["HKY85", "GTR"] if nucleotide else ["LG"]:
+        for categories in [1, 4]:
+            be = BandingEstimator()
+            be.set_file_input(fasta_path)
+            be.gamma_rate_categories = categories
+
+            max_error = be.check_gradient(model)
+            if not max_error < tolerance:
+                return False, f"{model} with {categories} rate categories: the analytic gradient " \
+                              f"is off by {max_error}."
+
+    return True, ""
+
+
+def test_anchor_banding(fasta_path: str, nucleotide: bool, tolerance: float = 0.01):
+    """Compares anchor banded distances with posterior banded ones on related sequences of
+    the sample's length, random samples share too few k-mers to be anchored.
+    """
+
+    length = max(len(record.split("\n", 1)[1].replace("\n", "")) for record in read_fasta_records(fasta_path))
+    alphabet = NUCLEIC_ACID_ALPHABED if nucleotide else AMINOACID_ALPHABED
+    fasta = generate_related_sample(8, max(length, 1500), alphabet, 0.02, 0.15, 0.05, length)
+
+    results = []
+    for mode in ["posterior", "anchor"]:
+        be = BandingEstimator()
+        be.set_str_input(fasta)
+        be.set_banding(mode)
+        seqs = execute_fixed_model(be, nucleotide)
+        seqs.calculate_distances()
+        results.append(seqs)
+
+    for i in range(len(results[0])):
+        for j in range(i):
+            expected, distance = results[0].get_distance(i, j), results[1].get_distance(i, j)
+            if abs(distance - expected) >= tolerance:
+                return False, f"Anchor banding: distance between {i} and {j} did not match.\n" \
+                              f"Yields: {distance}\n" \
+                              f"Expected: {expected}"
+
+    return True, ""
+
+
+def edge_length_sample(fasta_path: str, nucleotide: bool) -> str:
+    """Sequences of a random root seeded by the sample: prefixes down to a single symbol,
+    the root itself and copies with a long deletion and a long insertion.
+    """
+
+    alphabet = NUCLEIC_ACID_ALPHABED if nucleotide else AMINOACID_ALPHABED
+    rng = Random(len(read_fasta_records(fasta_path)))
+    root = "".join(rng.choices(alphabet, k=41))
+
+    sequences = [root[:length] for length in [1, 2, 3, 5, 7, 9, 13]] + \
+                [root, root[:4] + root[-3:], root[:2] + "".join(rng.choices(alphabet, k=30)) + root[-2:]]
+    return "".join(f">V{n}\n{sequence}\n" for n, sequence in enumerate(sequences))
+
+
+def test_viterbi(fasta_path: str, nucleotide: bool, tolerance: float = 1e-5):
+    """Compares the striped Viterbi kernel with the scalar Viterbi algorithm at fixed times,
+    on lengths that do not fill the SIMD lanes, single symbols and pairs with long gaps.
+    """
+
+    be = BandingEstimator()
+    be.set_str_input(edge_length_sample(fasta_path, nucleotide))
+    seqs = execute_fixed_model(be, nucleotide)
+
+    for time in [0.01, 0.2, 1.0, 3.0]:
+        max_error = seqs.check_viterbi(time)
+        if not max_error < tolerance:
+            return False, f"The striped Viterbi is off by {max_error} at time {time}."
+
+    return True, ""
+
+
+
+def test_anchored_forward(fasta_path: str, nucleotide: bool, tolerance: float = 0.01):
+    """Compares the anchored forward algorithm with the forward one: without anchors both
+    must agree at fixed times, down to single symbols; on related sequences close enough
+    to be anchored, the distances within tolerance. Every tenth pair reports its gap.
+    """
+
+    be = BandingEstimator()
+    be.set_str_input(edge_length_sample(fasta_path, nucleotide))
+    be.set_algorithm("anchored_forward")
+    be.set_approximation_gap_interval(0)
+    seqs = execute_fixed_model(be, nucleotide)
+
+    for time in [0.01, 0.2, 1.0, 3.0]:
+        max_error = seqs.check_anchored_forward(time)
+        if not max_error < 1e-9:
+            return False, f"The anchored forward without anchors is off by {max_error} at time {time}."
+
+    seqs.calculate_distances()
+    try:
+        seqs.approximation_gap()
+        return False, "Anchored forward: gaps were sampled at interval 0."
+    except PAHMMError:
+        pass
+
+    alphabet = NUCLEIC_ACID_ALPHABED if nucleotide else AMINOACID_ALPHABED
+    fasta = generate_related_sample(6, 800, alphabet, 0.01, 0.04, 0.02, len(read_fasta_records(fasta_path)))
+
+    results = []
+    for algorithm in ["forward", "anchored_forward"]:
+        be = BandingEstimator()
+        be.set_str_input(fasta)
+        be.set_algorithm(algorithm)
+        be.set_approximation_gap_interval(10)
+        seqs = execute_fixed_model(be, nucleotide)
+        seqs.calculate_distances()
+        results.append(seqs)
+
+    for i in range(len(results[0])):
+        for j in range(i):
+            expected, distance = results[0].get_distance(i, j), results[1].get_distance(i, j)
+            if abs(distance - expected) >= tolerance * max(1.0, expected):
+                return False, f"Anchored forward: distance between {i} and {j} did not match.\n" \
+                              f"Yields: {distance}\n" \
+                              f"Expected: {expected}"
+
+    pairs = len(results[1]) * (len(results[1]) - 1) // 2
+    samples = results[1].approximation_gap()[0]
+    if samples != -(-pairs // 10):
+        return False, f"Anchored forward: {samples} gap samples of {pairs} pairs."
+
+    return True, ""
+
+
+def test_ptcache(fasta_path: str, nucleotide: bool, accuracy: float = 0.01):
+    """Calculates a sample with both P(t) caches and compares it with the uncached distances:
+    the exact cache must not change any of them. The interpolated one perturbs P(t) by the
+    square of its grid resolution, which may move a Brent search within its accuracy: Brent
+    stops within 2 * accuracy * t of an optimum at t, so two searches may differ by twice that.
+    """
+
+    expected = dense_reference(fasta_path, nucleotide)
+
+    for mode, tolerance in [("exact", 0), ("interpolated", 4 * accuracy)]:
+        be = BandingEstimator()
+        be.set_file_input(fasta_path)
+        be.set_ptcache(mode)
+        seqs = execute_fixed_model(be, nucleotide)
+        seqs.calculate_distances()
+
+        hits, misses, memory_bytes = seqs.ptcache_stats()
+        if not hits:
+            return False, f"{mode} P(t) cache: no hits in {misses} lookups."
+
+        for i in range(len(seqs)):
+            for j in range(i):
+                distance, expected_distance = seqs.get_distance(i, j), expected.get_distance(i, j)
+                if abs(distance - expected_distance) > tolerance * expected_distance:
+                    return False, f"{mode} P(t) cache: distance between {i} and {j} did not match.\n" \
+                                  f"Yields: {distance}\n" \
+                                  f"Expected: {expected_distance}"
+
+    return True, ""
+
+
+def test_triangle_bounds(fasta_path: str, nucleotide: bool, accuracy: float = 0.01):
+    """Calculates a sample with triangle-inequality bounds from 8 pivots and compares it with
+    the unbounded distances. Brent stops within 2 * accuracy * t of an optimum at t, the
+    relative accuracy of the posterior band, so two searches may differ by twice that.
+    """
+
+    expected = dense_reference(fasta_path, nucleotide)
+
+    be = BandingEstimator()
+    be.set_file_input(fasta_path)
+    be.set_triangle_bounds(8)
+    seqs = execute_fixed_model(be, nucleotide)
+    seqs.calculate_distances()
+
+    bounded, repeated = seqs.triangle_bound_stats()
+    if not bounded:
+        return False, "Triangle bounds: no pair was optimized with bounds."
+
+    for i in range(len(seqs)):
+        for j in range(i):
+            distance, expected_distance = seqs.get_distance(i, j), expected.get_distance(i, j)
+            if abs(distance - expected_distance) > 4 * accuracy * max(distance, expected_distance):
+                return False, f"Triangle bounds: distance between {i} and {j} did not match.\n" \
+                              f"Yields: {distance}\n" \
+                              f"Expected: {expected_distance}"
+
+    return True, ""
+
+
+def test_posteriors(fasta_path: str, nucleotide: bool):
+    """Compares the sparse posteriors of the band calculation with those of the full matrices
+    at fixed times, on the lengths of the Viterbi test.
+    """
+
+    be = BandingEstimator()
+    be.set_str_input(edge_length_sample(fasta_path, nucleotide))
+    seqs = execute_fixed_model(be, nucleotide)
+
+    for time in [0.01, 0.2, 1.0, 3.0]:
+        max_error = seqs.check_posteriors(time)
+        if not max_error < 1e-9:
+            return False, f"The sparse posteriors are off by {max_error} at time {time}."
+
+    return True, ""
+
+
+def test_pair_storage(fasta_path: str, nucleotide: bool):
+    """Calculates a sample with both memory-mapped pair stores and compares them with the
+    in-memory one, single precision within float rounding.
+    """
+
+    expected = dense_reference(fasta_path, nucleotide)
+
+    for storage, tolerance in [("mapped64", 0.00005), ("mapped32", 0.0005)]:
+        with tempfile.TemporaryDirectory() as directory:
+            mapped_be = BandingEstimator()
+            mapped_be.set_file_input(fasta_path)
+            mapped_be.set_pair_storage(storage, directory)
+            seqs = execute_fixed_model(mapped_be, nucleotide)
+            seqs.calculate_distances()
+
+            if os.listdir(directory):
+                return False, f"{storage}: the mapped file was left in the directory."
+
+            for i in range(len(seqs)):
+                for j in range(i):
+                    distance, expected_distance = seqs.get_distance(i, j), expected.get_distance(i, j)
+                    if abs(distance - expected_distance) >= tolerance * max(1.0, expected_distance):
+                        return False, f"{storage}: distance between {i} and {j} did not match.\n" \
+                                      f"Yields: {distance}\n" \
+                                      f"Expected: {expected_distance}"
+
+    return True, ""
+
+
+def test_duplicates(fasta_path: str, nucleotide: bool):
+    """Calculates the unique sequences of a sample together with a renamed copy of each and
+    compares them with the unique sequences alone. Copies have a distance of 0 to their
+    originals and the distances of the originals to every other sequence.
+    """
+
+    unique = {}
+    for record in read_fasta_records(fasta_path):
+        unique.setdefault(record.split("\n", 1)[1], record)
+    records = list(unique.values())
+    copies = [record.replace(">", ">copy_", 1) for record in records]
+
+    # Every sequence occurs twice, so the observed frequencies are those of the originals
+    expected = dense_reference("".join(records), nucleotide, from_file=False)
+
+    seqs = dense_reference("".join(records + copies), nucleotide, from_file=False)
+
+    if len(seqs) != 2 * len(expected):
+        return False, f"{len(seqs)} sequences instead of {2 * len(expected)}."
+
+    for i in range(len(expected)):
+        name = expected.get_seq_name(i)
+        copy_name = b"copy_" + name
+
+        if seqs.get_distance_from_names(name, copy_name) != 0.0:
+            return False, f"The distance between '{name.decode('ascii')}' and its copy is " \
+                          f"{seqs.get_distance_from_names(name, copy_name)}."
+
+        for j in range(len(expected)):
+            if i == j:
+                continue
+
+            other = expected.get_seq_name(j)
+            distance = seqs.get_distance_from_names(name, other)
+            if seqs.get_distance_from_names(copy_name, other) != distance or \
+                    seqs.get_distance_from_names(copy_name, b"copy_" + other) != distance:
+                return False, f"The copy of '{name.decode('ascii')}' does not share its distance " \
+                              f"to '{other.decode('ascii')}'."
+
+            if abs(distance - expected.get_distance(i, j)) >= 0.00005:
+                return False, f"Distance between '{name.decode('ascii')}' and " \
+                              f"'{other.decode('ascii')}' did not match the unique sequences.\n" \
+                              f"Yields: {distance}\n" \
+                              f"Expected: {expected.get_distance(i, j)}"
+
+    return True, ""
+
+
+def read_condensed_matrix(matrix_path: str) -> List[float]:
+    """Read a condensed matrix file written by the finaliser: the upper triangle row by row.
+    """
+
+    with open(matrix_path, "rb") as matrix_file:
+        if matrix_file.read(8) != b"PAHMMDM1":
+            return []
+
+        pair_count, = struct.unpack("=Q", matrix_file.read(8))
+        return list(struct.unpack(f"={pair_count}d", matrix_file.read(8 * pair_count)))
+
+
+def test_stream(fasta_path: str, nucleotide: bool):
+    """Streams the distances of a sample as text and binary records and to a callback, and
+    compares the matrices finalised from the records with the dense matrix of the set.
+    """
+
+    expected = dense_reference(fasta_path, nucleotide)
+
+    size = len(expected)
+    pair_count = size * (size - 1) // 2
+    upper_pairs = [(i, j) for i in range(size) for j in range(i + 1, size)]
+
+    with tempfile.TemporaryDirectory() as directory:
+        for binary in [False, True]:
+            what = "Binary records" if binary else "Text records"
+            records_path = os.path.join(directory, "records")
+
+            stream_be = BandingEstimator()
+            stream_be.set_file_input(fasta_path)
+            seqs = execute_fixed_model(stream_be, nucleotide)
+            with open(records_path, "wb") as records_file:
+                seqs.stream_to_fd(records_file, binary)
+                seqs.calculate_distances()
+                seqs.stream_stop()
+
+            # Two uint32 IDs and two doubles per binary record
+            with open(records_path, "rb") as records_file:
+                records_count = len(records_file.read()) // 24 if binary else sum(1 for _ in records_file)
+            if records_count != pair_count:
+                return False, f"{what}: {records_count} records streamed for {pair_count} pairs."
+
+            condensed_path = os.path.join(directory, "condensed")
+            seqs.finalise_stream(records_path, condensed_path, binary, "condensed")
+            condensed = read_condensed_matrix(condensed_path)
+            if len(condensed) != pair_count:
+                return False, f"{what}: the condensed matrix holds {len(condensed)} of {pair_count} pairs."
+
+            for (i, j), distance in zip(upper_pairs, condensed):
+                if distance != expected.get_distance(i, j):
+                    return False, f"{what}: condensed distance between {i} and {j} did not match.\n" \
+                                  f"Yields: {distance}\n" \
+                                  f"Expected: {expected.get_distance(i, j)}"
+
+            phylip_path = os.path.join(directory, "phylip")
+            seqs.finalise_stream(records_path, phylip_path, binary, "phylip")
+            phylip = read_distmat(phylip_path)
+            if len(phylip) != size:
+                return False, f"{what}: the PHYLIP matrix holds {len(phylip)} of {size} sequences."
+
+            for i, (_, distances) in enumerate(phylip):
+                for j in range(i):
+                    if abs(distances[j] - expected.get_distance(i, j)) >= 0.00005:
+                        return False, f"{what}: PHYLIP distance between {i} and {j} did not match.\n" \
+                                      f"Yields: {distances[j]}\n" \
+                                      f"Expected: {expected.get_distance(i, j)}"
+
+    streamed = {}
+    stream_be = BandingEstimator()
+    stream_be.set_file_input(fasta_path)
+    seqs = execute_fixed_model(stream_be, nucleotide)
+    seqs.stream_to_callback(lambda seq_id1, seq_id2, distance, lnl: streamed.__setitem__(
+        (min(seq_id1, seq_id2), max(seq_id1, seq_id2)), distance))
+    seqs.calculate_distances()
+    seqs.stream_stop()
+
+    if len(streamed) != pair_count:
+        return False, f"Callback: {len(streamed)} pairs streamed of {pair_count}."
+
+    for (i, j), distance in streamed.items():
+        if distance != expected.get_distance(i, j):
+            return False, f"Callback: distance between {i} and {j} did not match.\n" \
+                          f"Yields: {distance}\n" \
+                          f"Expected: {expected.get_distance(i, j)}"
+
+    return True, ""
+
+
+def test_neighbours(fasta_path: str, nucleotide: bool, k: int = 3):
+    """Calculates a sample in sparse mode and compares the distances to the neighbours of
+    every sequence with the dense matrix. Neighbour lists are symmetric and the other pairs
+    are reported as not computed.
+    """
+
+    expected = dense_reference(fasta_path, nucleotide)
+
+    sparse_be = BandingEstimator()
+    sparse_be.set_file_input(fasta_path)
+    seqs = execute_fixed_model(sparse_be, nucleotide)
+    seqs.calculate_neighbours(k)
+
+    neighbours = [dict(seqs.neighbours(i)) for i in range(len(seqs))]
+
+    for i in range(len(seqs)):
+        if len(neighbours[i]) < min(k, len(seqs) - 1):
+            return False, f"Sequence {i} has {len(neighbours[i])} neighbours, k is {k}."
+
+        for j, distance in neighbours[i].items():
+            if i not in neighbours[j]:
+                return False, f"{j} is a neighbour of {i}, but not the other way round."
+
+            if distance != expected.get_distance(i, j):
+                return False, f"Sparse distance between {i} and {j} did not match.\n" \
+                              f"Yields: {distance}\n" \
+                              f"Expected: {expected.get_distance(i, j)}"
+
+        for j in range(len(seqs)):
+            if j == i:
+                continue
+
+            distance, computed = seqs.get_sparse_distance(i, j)
+            if computed != (j in neighbours[i]) or (computed and distance != neighbours[i][j]):
+                return False, f"The sparse distance between {i} and {j} does not match its neighbour list."
+
+    return True, ""
+
+
+def resume_checkpoint(fasta_path: str, nucleotide: bool, checkpoint_path: str) -> Sequences:
+    """Resume a sample from a checkpoint and calculate the remaining distances.
+    """
+
+    be = BandingEstimator()
+    be.set_file_input(fasta_path)
+    execute_fixed_model(be, nucleotide)
+    seqs = be.resume(checkpoint_path)
+    seqs.calculate_distances()
+    return seqs
+
+
+def test_checkpoint(fasta_path: str, nucleotide: bool, shard_count: int = 3):
+    """Interrupts a calculation after a checkpoint, resumes it and compares the result with
+    an uninterrupted run. The last appended block is torn or corrupted before resuming, the
+    checkpoint has to ignore it, and a checkpoint cut off in its header must be rejected.
+    """
+
+    expected = dense_reference(fasta_path, nucleotide)
+
+    with tempfile.TemporaryDirectory() as directory:
+        checkpoint_path = os.path.join(directory, "checkpoint")
+
+        # The first save writes the whole state, the second appends the pairs of shard 1
+        interrupted_be = BandingEstimator()
+        interrupted_be.set_file_input(fasta_path)
+        seqs = execute_fixed_model(interrupted_be, nucleotide)
+        seqs.set_checkpoint(checkpoint_path, 0, 0)
+        seqs.calculate_shard(0, shard_count)
+        seqs.save_checkpoint()
+        base_size = os.path.getsize(checkpoint_path)
+        seqs.calculate_shard(1, shard_count)
+        seqs.save_checkpoint()
+        del seqs
+
+        with open(checkpoint_path, "rb") as checkpoint_file:
+            checkpoint = checkpoint_file.read()
+
+        if len(checkpoint) <= base_size:
+            return False, "The second checkpoint did not append a block."
+
+        # A block ends with the time of its last (index, time) record and the checksum
+        corrupted = bytearray(checkpoint)
+        corrupted[-16:-8] = bytes(a ^ b for a, b in zip(corrupted[-16:-8], b"\x5a" * 8))
+
+        for what, data in [("Resumed checkpoint", checkpoint),
+                           ("Torn checkpoint block", checkpoint[:-4]),
+                           ("Checkpoint block with a bad checksum", bytes(corrupted))]:
+            with open(checkpoint_path, "wb") as checkpoint_file:
+                checkpoint_file.write(data)
+
+            result, message = compare_sequences(resume_checkpoint(fasta_path, nucleotide, checkpoint_path),
+                                                expected, what)
+            if not result:
+                return result, message
+
+        with open(checkpoint_path, "wb") as checkpoint_file:
+            checkpoint_file.write(checkpoint[:base_size // 2])
+
+        try:
+            resume_checkpoint(fasta_path, nucleotide, checkpoint_path)
+        except PAHMMError:
+            pass
+        else:
+            return False, "A checkpoint cut off in its header was resumed."
+
+    return True, ""
+
+
+def execute_estimated_model(be: BandingEstimator, nucleotide: bool, other: bool = False) -> Sequences:
+    """Apply a model estimated on the sequences, or the other model of the alphabet.
+    """
+
+    if nucleotide:
+        return be.execute_gtr_model() if other else be.execute_hky85_model()
+    else:
+        return be.execute_wag_model() if other else be.execute_lg_model()
+
+
+def read_model_entries(model_path: str) -> dict:
+    """Read a model parameter file as a dictionary of its lines by their keys.
+    """
+
+    with open(model_path) as model_file:
+        return dict(line.rstrip("\n").split(" ", 1) for line in model_file if " " in line)
+
+
+def rewrite_indel_parameters(model_path: str, indel: str):
+    """Replace the indel parameters of a model parameter file.
+    """
+
+    with open(model_path) as model_file:
+        lines = [f"indel {indel}\n" if line.startswith("indel ") else line for line in model_file]
+    with open(model_path, "w") as model_file:
+        model_file.writelines(lines)
+
+
+def test_model_file(fasta_path: str, nucleotide: bool):
+    """Estimates a model once and reuses it from a model parameter file and from the model
+    cache. Reusing must yield identical distances and must not estimate again, which parameters
+    changed in the file show. A file of another model must be rejected.
+    """
+
+    changed_indel = "0.0625 0.25"
+
+    with tempfile.TemporaryDirectory() as directory:
+        model_path = os.path.join(directory, "model")
+        cache_directory = os.path.join(directory, "cache")
+        os.mkdir(cache_directory)
+
+        be = BandingEstimator()
+        be.set_file_input(fasta_path)
+        be.set_model_cache(cache_directory)
+        expected = execute_estimated_model(be, nucleotide)
+        expected.calculate_distances()
+        expected.save_model(model_path)
+
+        cache_files = os.listdir(cache_directory)
+        if len(cache_files) != 1:
+            return False, f"The model cache holds {len(cache_files)} files instead of 1."
+
+        for what, setup in [("Model file", lambda reuse_be: reuse_be.set_model_file(model_path)),
+                            ("Model cache", lambda reuse_be: reuse_be.set_model_cache(cache_directory))]:
+            reuse_be = BandingEstimator()
+            reuse_be.set_file_input(fasta_path)
+            setup(reuse_be)
+            seqs = execute_estimated_model(reuse_be, nucleotide)
+            seqs.calculate_distances()
+
+            if len(seqs) != len(expected):
+                return False, f"{what}: {len(seqs)} sequences instead of {len(expected)}."
+
+            for i in range(len(seqs)):
+                for j in range(i):
+                    if seqs.get_distance(i, j) != expected.get_distance(i, j):
+                        return False, f"{what}: distance between {i} and {j} is not identical.\n" \
+                                      f"Yields: {seqs.get_distance(i, j)}\n" \
+                                      f"Expected: {expected.get_distance(i, j)}"
+
+        # An estimation would replace the changed parameters
+        rewrite_indel_parameters(model_path, changed_indel)
+        rewrite_indel_parameters(os.path.join(cache_directory, cache_files[0]), changed_indel)
+
+        for what, setup in [("Model file", lambda reuse_be: reuse_be.set_model_file(model_path)),
+                            ("Model cache", lambda reuse_be: reuse_be.set_model_cache(cache_directory))]:
+            reuse_be = BandingEstimator()
+            reuse_be.set_file_input(fasta_path)
+            setup(reuse_be)
+            reused_path = os.path.join(directory, "reused")
+            execute_estimated_model(reuse_be, nucleotide).save_model(reused_path)
+
+            if read_model_entries(reused_path)["indel"] != changed_indel:
+                return False, f"{what}: the model was estimated instead of read."
+
+        reuse_be = BandingEstimator()
+        reuse_be.set_file_input(fasta_path)
+        reuse_be.set_model_file(model_path)
+        try:
+            execute_estimated_model(reuse_be, nucleotide, other=True)
+        except PAHMMError:
+            pass
+        else:
+            return False, "A model file of another model was accepted."
+
+    return True, ""
+
+
+def test_estimation_threads(fasta_path: str, nucleotide: bool, threads: int = 4):
+    """Estimates the models of a sample on one and on several worker threads. The grid
+    search and the triplets reduce in a fixed order, so the estimates and the distances
+    have to be identical.
+    """
+
+    with tempfile.TemporaryDirectory() as directory:
+        for other in [False, True]:
+            results = []
+            for estimation_threads in [1, threads]:
+                be = BandingEstimator()
+                be.set_file_input(fasta_path)
+                be.set_estimation_threads(estimation_threads)
+                seqs = execute_estimated_model(be, nucleotide, other)
+                seqs.calculate_distances()
+
+                model_path = os.path.join(directory, f"model-{estimation_threads}")
+                seqs.save_model(model_path)
+                results.append((seqs, read_model_entries(model_path)))
+
+            (expected, expected_entries), (seqs, entries) = results
+            if entries != expected_entries:
+                return False, f"The {entries['model']} estimates differ on {threads} threads:\n" \
+                              f"Yields: {entries}\n" \
+                              f"Expected: {expected_entries}"
+
+            for i in range(len(seqs)):
+                for j in range(i):
+                    if seqs.get_distance(i, j) != expected.get_distance(i, j):
+                        return False, f"{entries['model']} on {threads} threads: distance between " \
+                                      f"{i} and {j} is not identical.\n" \
+                                      f"Yields: {seqs.get_distance(i, j)}\n" \
+                                      f"Expected: {expected.get_distance(i, j)}"
+
+    return True, ""
+
+
+# Tests of the library against itself, they run once for each sample.
+LIBRARY_TESTS = [
+    ("add_sequences", test_add_sequences),
+    ("query", test_query),
+    ("shards", test_shards),
+    ("gradient", test_gradient),
+    ("anchor_banding", test_anchor_banding),
+    ("viterbi", test_viterbi),
+    ("anchored_forward", test_anchored_forward),
+    ("posteriors", test_posteriors),
+    ("triangle_bounds", test_triangle_bounds),
+    ("ptcache", test_ptcache),
+    ("pair_storage", test_pair_storage),
+    ("duplicates", test_duplicates),
+    ("stream", test_stream),
+    ("neighbours", test_neighbours),
+    ("checkpoint", test_checkpoint),
+    ("model_file", test_model_file),
+    ("estimation_threads", test_estimation_threads),
+]
+
+
+def run_fasta_tests(fasta_path: str, nucleotide: bool) -> bool:
+    """Compares the tool and the library on a sample with every test of its alphabet.
+    """
+
+    result = True
+
+    # Select the right tests
+    if nucleotide:
+        tests = NUCLEOTIDE_TESTS
+    else:
+        tests = AMINO_ACID_TESTS
+
+    for test in tests:
+        model = test["model"]
+        parameters = test["parameters"]
+        alpha = test["alpha"]
+        gamma_rate_categories = test["gamma_rate_categories"]
+
+        print(f"Testing {os.path.basename(fasta_path)} (model={model}, params={parameters}, "
+              f"a={alpha}, cat={gamma_rate_categories}): ", end="")
+
+        test_result, message = test_fasta(fasta_path, model, parameters, alpha, gamma_rate_categories)
+
+        if test_result:
+            print("\033[32m" + "Success" + "\033[39m")
+        else:
+            print("\033[31m" + "Failure" + "\033[39m")
+
+        if message:
+            print(message)
+
+        result = result and test_result
+
+    return result
+
+
 def main():
     total_result = True
 
@@ -221,23 +1165,32 @@ def main():
                 if not filename.endswith(".fasta"):
                     continue
 
-                # Select the right tests
-                if nucleotide:
-                    tests = NUCLEOTIDE_TESTS
-                else:
-                    tests = AMINO_ACID_TESTS
+                fasta_path = dirpath + "/" + filename
+                total_result = run_fasta_tests(fasta_path, nucleotide) and total_result
+
+    with tempfile.TemporaryDirectory() as directory:
+        for nucleotide, count, length, seed in RELATED_SAMPLES:
+            alphabet = NUCLEIC_ACID_ALPHABED if nucleotide else AMINOACID_ALPHABED
+            fasta_path = f"{directory}/related_{'na' if nucleotide else 'aa'}{count}x{length}.fasta"
+
+            with open(fasta_path, "w") as fasta_file:
+                fasta_file.write(generate_related_sample(count, length, alphabet, 0.05, 0.25, 0.05, seed))
 
-                for test in tests:
-                    model = test["model"]
-                    parameters = test["parameters"]
-                    alpha = test["alpha"]
-                    gamma_rate_categories = test["gamma_rate_categories"]
+            total_result = run_fasta_tests(fasta_path, nucleotide) and total_result
+
+    for subdir, nucleotide in [("amino_acid", False), ("nucleotide", True)]:
+        for dirpath, dirnames, filenames in os.walk("samples" + "/" + subdir):
+            for filename in filenames:
+                if not filename.endswith(".fasta"):
+                    continue
 
-                    print(f"Testing {filename} (model={model}, params={parameters}, "
-                          f"a={alpha}, cat={gamma_rate_categories}): ", end="")
+                for name, test in LIBRARY_TESTS:
+                    print(f"Testing {filename} ({name}): ", end="")
 
-                    fasta_path = dirpath + "/" + filename
-                    result, message = test_fasta(fasta_path, model, parameters, alpha, gamma_rate_categories)
+                    try:
+                        result, message = test(dirpath + "/" + filename, nucleotide)
+                    except PAHMMError as error:
+                        result, message = False, str(error)
 
                     if result:
                         print("\033[32m" + "Success" + "\033[39m")